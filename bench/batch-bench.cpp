@@ -0,0 +1,77 @@
+// Measures rows per second of a predicate filtered by the columnar batch
+// evaluator and by the scalar tree walking evaluator, one row at a time.
+// Takes the number of rows as an optional argument.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "loxt/batch_eval.hpp"
+#include "loxt/eval.hpp"
+#include "loxt/lexer.hpp"
+#include "loxt/parser.hpp"
+
+namespace {
+
+constexpr std::size_t Default_Rows = 10'000'000;
+constexpr const char* Predicate = "price * qty > 100 and qty < 4 or price == 3";
+
+using Clock = std::chrono::steady_clock;
+
+template <class Fn>
+auto rows_per_second(std::size_t rows, Fn&& fn) -> double {
+  auto start = Clock::now();
+  fn();
+  auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  return static_cast<double>(rows) / elapsed;
+}
+
+}  // namespace
+
+auto main(int argc, char* argv[]) -> int {
+  std::size_t rows = argc > 1 ? std::stoul(argv[1]) : Default_Rows;
+
+  // Deterministic columns so runs are comparable: prices 0 to 96 in steps
+  // of 0.5, quantities 1 to 7.
+  std::vector<double> price(rows);
+  std::vector<double> qty(rows);
+  for (std::size_t row = 0; row < rows; ++row) {
+    price[row] = static_cast<double>(row * 7919 % 193) / 2;
+    qty[row] = static_cast<double>(row % 7 + 1);
+  }
+
+  std::string source = Predicate;
+  auto toks = loxt::lex(source);
+  loxt::Parser parser{toks};
+  parser.parse();
+
+  loxt::BatchEvaluator batch{parser.tree(), *toks};
+  batch.bind("price", std::span<const double>{price});
+  batch.bind("qty", std::span<const double>{qty});
+  std::size_t batch_matches = 0;
+  auto batch_rate = rows_per_second(
+      rows, [&] { batch_matches = batch.filter(rows).size(); });
+
+  loxt::Evaluator scalar{*toks, parser.slots()};
+  auto price_id = *toks->find_identifier("price");
+  auto qty_id = *toks->find_identifier("qty");
+  std::size_t scalar_matches = 0;
+  auto scalar_rate = rows_per_second(rows, [&] {
+    for (std::size_t row = 0; row < rows; ++row) {
+      scalar.bind(price_id, loxt::Value{price[row]});
+      scalar.bind(qty_id, loxt::Value{qty[row]});
+      scalar_matches += scalar.evaluate(parser.tree()).truthy() ? 1 : 0;
+    }
+  });
+
+  std::printf("%s\n%zu rows, %zu match\n", Predicate, rows, batch_matches);
+  std::printf("batch  %8.1fM rows/s\nscalar %8.1fM rows/s\nspeedup %.2fx\n",
+              batch_rate / 1e6, scalar_rate / 1e6, batch_rate / scalar_rate);
+  if (batch_matches != scalar_matches) {
+    std::printf("mismatch: scalar matched %zu rows\n", scalar_matches);
+    return 1;
+  }
+}
@@ -0,0 +1,93 @@
+// Compares the tree walking evaluator with closure compiled expressions on
+// a deep chain and on a wide balanced tree of the same number of leaves.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "loxt/closure.hpp"
+#include "loxt/eval.hpp"
+#include "loxt/lexer.hpp"
+#include "loxt/parser.hpp"
+
+namespace {
+
+constexpr std::size_t Leaves = 1024;
+constexpr std::size_t Iterations = 2000;
+
+// x * 1 + x * 2 + ... : one left leaning chain.
+auto deep_source() -> std::string {
+  std::string source = "x";
+  for (std::size_t leaf = 1; leaf < Leaves; ++leaf) {
+    source += leaf % 2 == 0 ? " + x * " : " - x / ";
+    source += std::to_string(leaf % 7 + 1);
+  }
+  return source;
+}
+
+// ((x + 1) - (x * 2)) ... : a balanced tree, log2(Leaves) levels deep.
+auto wide_source(std::size_t leaves, std::size_t& next) -> std::string {
+  if (leaves == 1) {
+    return ++next % 2 == 0 ? "x" : std::to_string(next % 7 + 1);
+  }
+  auto lhs = wide_source(leaves / 2, next);
+  auto rhs = wide_source(leaves / 2, next);
+  return "(" + lhs + (next % 3 == 0 ? " * " : " + ") + rhs + ")";
+}
+
+template <class Fn>
+auto time_ns(Fn&& fn) -> double {
+  auto start = std::chrono::steady_clock::now();
+  double sink = 0;
+  for (std::size_t iter = 0; iter < Iterations; ++iter) {
+    sink += fn(static_cast<double>(iter));
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  // Keep the result observable so the loop is not optimised away.
+  if (sink == 0.5) {
+    std::puts("");
+  }
+  return std::chrono::duration<double, std::nano>(elapsed).count() /
+         Iterations;
+}
+
+void run(std::string_view label, const std::string& source) {
+  auto toks = loxt::lex(source);
+  loxt::Parser parser{toks};
+  parser.parse();
+  auto x = *parser.slots().find(*toks->find_identifier("x"));
+
+  loxt::Evaluator evaluator{*toks, parser.slots()};
+  auto tree_ns = time_ns([&](double value) {
+    evaluator.bind("x", loxt::Value{value});
+    return evaluator.evaluate(parser.tree()).as_number();
+  });
+
+  std::vector<loxt::Value> env(parser.slots().size());
+  auto closure_ns = [&](loxt::StaticType type) {
+    loxt::ClosureCompiler compiler{*toks};
+    compiler.declare("x", type);
+    auto compiled = compiler.compile(parser.tree());
+    return time_ns([&](double value) {
+      env[x] = loxt::Value{value};
+      return compiled(env).as_number();
+    });
+  };
+  auto any_ns = closure_ns(loxt::StaticType::Any);
+  auto number_ns = closure_ns(loxt::StaticType::Number);
+
+  std::printf("%-5s tree %9.0f ns  closure(Any) %9.0f ns  "
+              "closure(Number) %9.0f ns  speedup %.2fx\n",
+              label.data(), tree_ns, any_ns, number_ns, tree_ns / number_ns);
+}
+
+}  // namespace
+
+auto main() -> int {
+  std::size_t next = 0;
+  run("deep", deep_source());
+  run("wide", wide_source(Leaves, next));
+}
@@ -0,0 +1,84 @@
+// Measures requests per second and latency percentiles of a loxt server.
+// With a socket path argument it drives a running `loxt --serve`; without
+// one it starts a server in process on a temporary socket.
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "loxt/server.hpp"
+
+namespace {
+
+constexpr std::size_t Clients = 4;
+constexpr std::size_t Requests = 5000;
+
+using Clock = std::chrono::steady_clock;
+
+auto percentile(std::vector<double>& samples, double fraction) -> double {
+  auto rank = static_cast<std::size_t>(
+      fraction * static_cast<double>(samples.size() - 1));
+  std::ranges::nth_element(samples, samples.begin() + rank);
+  return samples[rank];
+}
+
+void run(const std::string& path) {
+  std::vector<std::vector<double>> latencies(Clients);
+  std::vector<std::thread> clients;
+  auto start = Clock::now();
+  for (std::size_t id = 0; id < Clients; ++id) {
+    clients.emplace_back([&, id] {
+      loxt::Client client{path};
+      auto& samples = latencies[id];
+      samples.reserve(Requests);
+      for (std::size_t idx = 0; idx < Requests; ++idx) {
+        auto source = std::to_string(idx) + " * (2 + 3) - \"a\" == \"a\"";
+        auto kind = static_cast<loxt::RequestKind>(idx % 3);
+        auto sent = Clock::now();
+        client.send(kind, source);
+        samples.push_back(
+            std::chrono::duration<double, std::micro>(Clock::now() - sent)
+                .count());
+      }
+    });
+  }
+  for (auto& client : clients) {
+    client.join();
+  }
+  auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+  std::vector<double> all;
+  for (const auto& samples : latencies) {
+    all.insert(all.end(), samples.begin(), samples.end());
+  }
+  std::printf("%zu clients  %9.0f requests/s  p50 %7.1f us  p99 %7.1f us\n",
+              Clients, static_cast<double>(all.size()) / elapsed,
+              percentile(all, 0.5), percentile(all, 0.99));
+}
+
+}  // namespace
+
+auto main(int argc, char const* argv[]) -> int {
+  if (argc > 1) {
+    run(argv[1]);
+    return 0;
+  }
+
+  auto path = (std::filesystem::temp_directory_path() /
+               ("loxt-bench-" + std::to_string(::getpid()) + ".sock"))
+                  .string();
+  loxt::Server server{Clients};
+  server.listen(path);
+  std::thread runner{[&] { server.run(); }};
+  run(path);
+  server.stop();
+  runner.join();
+}
@@ -1,54 +1,355 @@
+#include <algorithm>
 #include <argparse/argparse.hpp>
 #include <cstdlib>
+#include <filesystem>
+#include <format>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <loxt/cache.hpp>
+#include <loxt/dump.hpp>
 #include <loxt/lexer.hpp>
+#include <loxt/parser.hpp>
+#include <loxt/server.hpp>
+#include <loxt/session.hpp>
+#include <loxt/thread_pool.hpp>
 #include <sstream>
 #include <string>
+#include <system_error>
+#include <vector>
 
-auto run_file(const std::string& path) -> void {
+namespace {
+
+// Tokens the REPL session may hold before it forgets the lines behind them.
+constexpr std::size_t Repl_Token_Limit = std::size_t{1} << 16;
+
+auto read_file(const std::string& path) -> std::string {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    throw "Cannot open file";
+  }
+  std::stringstream stream;
+  stream << file.rdbuf();
+  return stream.str();
+}
+
+auto print_diagnostics(const loxt::TokenList& toks, std::size_t first = 0)
+    -> void {
+  const auto& diags = toks.diagnostics();
+  for (auto idx = first; idx < diags.size(); ++idx) {
+    const auto& diag = diags[idx];
+    std::cout << diag.loc.line << ':' << diag.loc.column
+              << ": Error: " << diag.message << "\n\n";
+  }
+}
+
+struct BatchResult {
+  bool ok = false;
+  std::size_t tokens = 0;
+  std::size_t bytes = 0;
+  std::string message;
+};
+
+auto memory_usage(const loxt::Artifact& artifact) -> std::size_t {
+  return artifact.tokens->memory_usage().total() +
+         (artifact.tree ? artifact.tree->memory_usage().total() : 0);
+}
+
+auto print_memory(const loxt::TokenList& toks, const loxt::ExprTree* tree)
+    -> void {
+  auto usage = toks.memory_usage();
+  auto tree_usage = tree != nullptr ? tree->memory_usage()
+                                    : treeceratops::tree_memory{};
+  std::cerr << std::format(
+      "memory: {} bytes\n"
+      "  tokens       {}\n"
+      "  interner     {}\n"
+      "  literals     {}\n"
+      "  diagnostics  {}\n"
+      "  nodes        {}\n"
+      "  child lists  {}\n"
+      "  metadata     {}\n",
+      usage.total() + tree_usage.total(), usage.tokens, usage.interner,
+      usage.literals, usage.diagnostics, tree_usage.nodes,
+      tree_usage.child_lists, tree_usage.metadata);
+}
+
+// A cache applies the depth limit it was created with.
+auto lex_and_parse(const std::string& contents, loxt::ScriptCache* cache,
+                   std::size_t max_depth) -> loxt::Artifact {
+  if (cache != nullptr) {
+    return cache->parse(contents);
+  }
+  auto toks = loxt::lex(contents);
+  if (toks->has_error()) {
+    return {toks, std::nullopt};
+  }
+  loxt::Parser parser{toks};
+  parser.set_max_depth(max_depth);
+  parser.parse();
+  return {toks, std::move(parser.tree())};
+}
+
+auto check_file(const std::string& path, loxt::ScriptCache* cache,
+                std::size_t max_depth) -> BatchResult {
+  BatchResult result;
+  try {
+    std::string contents = read_file(path);
+    auto artifact = lex_and_parse(contents, cache, max_depth);
+    result.tokens = artifact.tokens->size();
+    result.bytes = memory_usage(artifact);
+    if (artifact.tokens->has_error()) {
+      const auto& diag = artifact.tokens->diagnostics().front();
+      result.message = std::to_string(diag.loc.line) + ':' +
+                       std::to_string(diag.loc.column) + ": " + diag.message;
+      return result;
+    }
+  } catch (const char* err) {
+    result.message = err;
+    return result;
+  } catch (const std::exception& err) {
+    result.message = err.what();
+    return result;
+  }
+  result.ok = true;
+  return result;
+}
+
+// Expands directories into the regular files below them. The order is
+// sorted so batch output does not depend on directory iteration order.
+auto collect_paths(const std::vector<std::string>& inputs)
+    -> std::vector<std::string> {
+  std::vector<std::string> paths;
+  for (const auto& input : inputs) {
+    if (std::filesystem::is_directory(input)) {
+      std::vector<std::string> found;
+      for (const auto& entry :
+           std::filesystem::recursive_directory_iterator(input)) {
+        if (entry.is_regular_file()) {
+          found.push_back(entry.path().string());
+        }
+      }
+      std::ranges::sort(found);
+      paths.insert(paths.end(), found.begin(), found.end());
+    } else {
+      paths.push_back(input);
+    }
+  }
+  return paths;
+}
+
+}  // namespace
+
+auto run_file(const std::string& path, const std::string& dump,
+              loxt::DumpFormat format, loxt::ScriptCache* cache, bool stats,
+              std::size_t max_depth) -> int {
   std::string contents;
+  try {
+    contents = read_file(path);
+  } catch (const char* err) {
+    std::cerr << path << ": error: " << err << '\n';
+    return EXIT_FAILURE;
+  }
+  loxt::DumpWriter writer{std::cout};
+  if (dump == "ast") {
+    loxt::Artifact artifact;
+    try {
+      artifact = lex_and_parse(contents, cache, max_depth);
+    } catch (const char* err) {
+      std::cerr << path << ": error: " << err << '\n';
+      return EXIT_FAILURE;
+    } catch (const std::exception& err) {
+      std::cerr << path << ": error: " << err.what() << '\n';
+      return EXIT_FAILURE;
+    }
+    print_diagnostics(*artifact.tokens);
+    if (!artifact.tree) {
+      return EXIT_FAILURE;
+    }
+    loxt::dump_ast(writer, *artifact.tree, *artifact.tokens, format);
+    if (stats) {
+      writer.flush();
+      print_memory(*artifact.tokens, &*artifact.tree);
+    }
+    return EXIT_SUCCESS;
+  }
+
+  auto toks = cache != nullptr ? cache->lex(contents) : loxt::lex(contents);
+  print_diagnostics(*toks);
+  loxt::dump_tokens(writer, *toks, format);
+  if (format == loxt::DumpFormat::Text) {
+    writer.format("{}\n", static_cast<int>(toks->has_error()));
+  }
+  if (stats) {
+    writer.flush();
+    print_memory(*toks, nullptr);
+  }
+  return toks->has_error() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+auto run_batch(const std::vector<std::string>& inputs, std::size_t jobs,
+               loxt::ScriptCache* cache, bool stats, std::size_t max_depth)
+    -> int {
+  auto paths = collect_paths(inputs);
+  std::vector<BatchResult> results(paths.size());
   {
-    std::ifstream file(path);
-    std::stringstream stream;
-    stream << file.rdbuf();
-    contents = stream.str();
+    loxt::ThreadPool pool{jobs};
+    loxt::parallel_for(pool, paths.size(), [&](std::size_t idx) {
+      results[idx] = check_file(paths[idx], cache, max_depth);
+    });
   }
-  auto toks = loxt::lex(contents);
-  for (const auto& tok : *toks) {
-    std::cout << toks->to_string(tok) << '\n';
+
+  std::size_t failed = 0;
+  std::size_t bytes = 0;
+  for (std::size_t idx = 0; idx < paths.size(); ++idx) {
+    const auto& result = results[idx];
+    bytes += result.bytes;
+    if (result.ok && stats) {
+      std::cout << paths[idx] << ": ok (" << result.tokens << " tokens, "
+                << result.bytes << " bytes)\n";
+    } else if (result.ok) {
+      std::cout << paths[idx] << ": ok (" << result.tokens << " tokens)\n";
+    } else {
+      ++failed;
+      std::cout << paths[idx] << ": error: " << result.message << '\n';
+    }
+  }
+  std::cout << paths.size() << " files, " << failed << " failed";
+  if (stats) {
+    std::cout << ", " << bytes << " bytes";
+  }
+  std::cout << '\n';
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+auto parse_dump_format(const std::string& name) -> loxt::DumpFormat {
+  if (name == "text") {
+    return loxt::DumpFormat::Text;
+  }
+  if (name == "jsonl") {
+    return loxt::DumpFormat::Jsonl;
+  }
+  if (name == "binary") {
+    return loxt::DumpFormat::Binary;
   }
-  std::cout << toks->has_error() << '\n';
+  throw std::runtime_error("Unknown dump format '" + name + "'");
 }
 
 auto run_interpreter() -> void {
+  loxt::Session session;
   std::string line;
   for (;;) {
     std::cout << "loxt> ";
-    std::getline(std::cin, line);
-    for (auto toks = loxt::lex(line); auto tok : *toks) {
-      std::cout << toks->to_string(tok) << '\n';
+    if (!std::getline(std::cin, line)) {
+      break;
     }
+    // Earlier lines are never looked at again, so forget them rather than
+    // keep every line of a long session.
+    if (session.tokens().size() >= Repl_Token_Limit) {
+      session.clear();
+    }
+    auto& toks = session.tokens();
+    auto reported = toks.diagnostics().size();
+    auto range = session.lex(std::move(line));
+    print_diagnostics(toks, reported);
+    for (auto idx = range.begin; idx < range.end; ++idx) {
+      std::cout << toks.to_string(toks[idx]) << '\n';
+    }
+  }
+}
+
+auto run_server(const std::string& path, std::size_t jobs,
+                std::size_t max_depth) -> int {
+  loxt::Server server{jobs, max_depth};
+  try {
+    server.listen(path);
+  } catch (const std::system_error& err) {
+    std::cerr << path << ": error: " << err.what() << '\n';
+    return EXIT_FAILURE;
   }
+  std::cerr << "serving on " << path << '\n';
+  server.run();
+  return EXIT_SUCCESS;
 }
 
 auto main(int argc, char const* argv[]) -> int {
   argparse::ArgumentParser program(argv[0]);
-  program.add_argument("file").nargs(argparse::nargs_pattern::optional);
+  program.add_argument("files")
+      .help("files or directories to process")
+      .nargs(argparse::nargs_pattern::any);
+  program.add_argument("-j", "--jobs")
+      .help("worker threads for batch and server mode (0 = all cores)")
+      .default_value(0)
+      .scan<'i', int>();
+  program.add_argument("--dump")
+      .help("what to dump for a single file: tokens or ast")
+      .default_value(std::string{"tokens"});
+  program.add_argument("--format")
+      .help("dump format: text, jsonl or binary")
+      .default_value(std::string{"text"});
+  program.add_argument("--cache-dir")
+      .help("directory of cached token lists and trees keyed by content");
+  program.add_argument("--stats")
+      .help("report the memory held by each script's tokens and tree")
+      .default_value(false)
+      .implicit_value(true);
+  program.add_argument("--serve")
+      .help("answer lex, parse and evaluate requests on this Unix socket");
+  program.add_argument("--max-depth")
+      .help("deepest nesting of parentheses and unary operators to parse "
+            "(0 = no limit)")
+      .default_value(static_cast<int>(loxt::Default_Max_Depth))
+      .scan<'i', int>();
 
+  loxt::DumpFormat format{};
   try {
     program.parse_args(argc, argv);
+    format = parse_dump_format(program.get<std::string>("--format"));
+    if (auto dump = program.get<std::string>("--dump");
+        dump != "tokens" && dump != "ast") {
+      throw std::runtime_error("Unknown dump kind '" + dump + "'");
+    }
   } catch (const std::runtime_error& err) {
     std::cerr << err.what() << '\n';
     std::cerr << program;
     std::exit(EXIT_FAILURE);
   }
 
-  if (program.present("file").has_value()) {
-    run_file(program.get<std::string>("file"));
-  } else {
+  auto jobs =
+      static_cast<std::size_t>(std::max(program.get<int>("--jobs"), 0));
+  if (jobs == 0) {
+    jobs = std::thread::hardware_concurrency();
+  }
+  auto max_depth =
+      static_cast<std::size_t>(std::max(program.get<int>("--max-depth"), 0));
+  if (max_depth == 0) {
+    max_depth = std::numeric_limits<std::size_t>::max();
+  }
+  if (auto socket = program.present("--serve")) {
+    return run_server(*socket, jobs, max_depth);
+  }
+
+  auto files = program.present<std::vector<std::string>>("files")
+                   .value_or(std::vector<std::string>{});
+  if (files.empty()) {
     run_interpreter();
+    return 0;
+  }
+
+  std::optional<loxt::ScriptCache> cache;
+  if (auto dir = program.present("--cache-dir")) {
+    cache.emplace(*dir, max_depth);
+  }
+  loxt::ScriptCache* cache_ptr = cache ? &*cache : nullptr;
+
+  bool batch = files.size() > 1 || program.is_used("--jobs") ||
+               std::filesystem::is_directory(files.front());
+  if (!batch) {
+    std::ios::sync_with_stdio(false);
+    return run_file(files.front(), program.get<std::string>("--dump"), format,
+                    cache_ptr, program.get<bool>("--stats"), max_depth);
   }
 
-  return 0;
+  return run_batch(files, jobs, cache_ptr, program.get<bool>("--stats"),
+                   max_depth);
 }
@@ -1,13 +1,22 @@
 #pragma once
 
 #include <cstdint>
+#include <treeceratops/frozen_tree.hpp>
 #include <treeceratops/tree.hpp>
 
 #include "../lexer.hpp"
 
 namespace loxt {
 
-enum class ExprKind : std::uint8_t { Root, Binary, Paren, Literal, Unary, Nil };
+enum class ExprKind : std::uint8_t {
+  Root,
+  Binary,
+  Paren,
+  Literal,
+  Unary,
+  Nil,
+  Variable
+};
 
 enum class BinaryOpKind : std::uint8_t {
   Or,
@@ -28,8 +37,14 @@ auto to_string(BinaryOpKind kind) -> std::string;
 
 enum class UnaryOpKind : std::uint8_t { Not, Neg };
 
+auto to_string(UnaryOpKind kind) -> std::string;
+
 enum class LiteralKind : std::uint8_t { String, Number, Bool };
 
+// Index of a variable in a flat environment, assigned by resolve().
+using Slot = std::uint32_t;
+constexpr Slot Unresolved_Slot = ~Slot{0};
+
 struct ExprData {
   ExprKind kind;
   union {
@@ -46,20 +61,29 @@ struct ExprData {
     struct {
       UnaryOpKind uOp;
     };
+    struct {
+      Identifier identifier;
+      Slot slot;
+    };
   };
 
-  explicit ExprData(ExprKind in_kind, BinaryOpKind b_op)
+  constexpr explicit ExprData(ExprKind in_kind, BinaryOpKind b_op)
       : kind{in_kind}, bOp{b_op} {}
-  explicit ExprData(ExprKind in_kind, LiteralKind l_kind, Literal lit)
+  constexpr explicit ExprData(ExprKind in_kind, LiteralKind l_kind, Literal lit)
       : kind{in_kind}, literalKind{l_kind}, literalVal(lit) {}
-  explicit ExprData(ExprKind in_kind, LiteralKind l_kind, bool lit)
+  constexpr explicit ExprData(ExprKind in_kind, LiteralKind l_kind, bool lit)
       : kind{in_kind}, literalKind{l_kind}, boolVal{lit} {}
-  explicit ExprData(ExprKind in_kind, UnaryOpKind u_op)
+  constexpr explicit ExprData(ExprKind in_kind, UnaryOpKind u_op)
       : kind{in_kind}, uOp{u_op} {}
-  explicit ExprData(ExprKind in_kind) : kind{in_kind} {}
+  constexpr explicit ExprData(ExprKind in_kind, Identifier ident)
+      : kind{in_kind}, identifier{ident}, slot{Unresolved_Slot} {}
+  // Initialises a union member so the result is usable in constant
+  // expressions.
+  constexpr explicit ExprData(ExprKind in_kind) : kind{in_kind}, bOp{} {}
 };
 
 using ExprTree = treeceratops::tree<ExprData>;
+using FrozenExprTree = treeceratops::frozen_tree<ExprData>;
 
 class Expr;
 class RootExpr;
@@ -70,6 +94,7 @@ class StringExpr;
 class BoolExpr;
 class UnaryExpr;
 class NilExpr;
+class VariableExpr;
 
 class Visitor {
  public:
@@ -81,20 +106,31 @@ class Visitor {
   virtual void visit(BoolExpr& expr) = 0;
   virtual void visit(UnaryExpr& expr) = 0;
   virtual void visit(NilExpr& expr) = 0;
+  virtual void visit(VariableExpr& expr) = 0;
+
+  // Called by Expr::walk() once everything below `expr` has been visited.
+  virtual void leave(Expr& /*expr*/) {}
 };
 
+// Read-only handle on one node of a tree. Handles never modify the tree, so
+// threads may visit a shared tree concurrently once it is built.
 class Expr {
  public:
-  Expr(ExprTree& tree, const ExprTree::iterator& node)
+  Expr(const ExprTree& tree, const ExprTree::const_iterator& node)
       : tree_(tree), node_(node) {}
 
   void accept(Visitor& visitor);
 
+  // Visits this node and everything below it in pre-order, keeping the
+  // pending nodes on the heap so any depth of nesting can be walked. Visitors
+  // driven this way must not accept() children themselves.
+  void walk(Visitor& visitor);
+
   [[nodiscard]] auto e_kind() const -> ExprKind { return node_->kind; }
 
  protected:
-  ExprTree& tree_;
-  ExprTree::iterator node_;
+  const ExprTree& tree_;
+  ExprTree::const_iterator node_;
 };
 
 class RootExpr : public Expr {
@@ -102,6 +138,15 @@ class RootExpr : public Expr {
   [[nodiscard]] auto expr() const -> Expr {
     return {tree_, tree_.child<0>(node_)};
   }
+  // A root built by parse_range() or merge_trees() holds one expression per
+  // statement.
+  [[nodiscard]] auto expr_count() const -> std::size_t {
+    return node_.child_count();
+  }
+  [[nodiscard]] auto expr(std::size_t idx) const -> Expr {
+    auto node = node_;
+    return {tree_, node.child(idx)};
+  }
 };
 
 class BinaryExpr : public Expr {
@@ -147,4 +192,12 @@ class UnaryExpr : public Expr {
 
 class NilExpr : public Expr {};
 
+class VariableExpr : public Expr {
+ public:
+  [[nodiscard]] auto identifier() const -> Identifier {
+    return node_->identifier;
+  }
+  [[nodiscard]] auto slot() const -> Slot { return node_->slot; }
+};
+
 }  // namespace loxt
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "../lexer.hpp"
+#include "expr.hpp"
+
+namespace loxt {
+
+// Rebuilds `tree` with structurally identical subtrees merged into a single
+// node, turning it into a DAG. Nodes are keyed on their ExprData and the ids
+// of their already merged children, and literals compare by value through
+// `tokens`, so two copies of "abc" share a node even though they have
+// different literal indices.
+//
+// In the result only the children lists are authoritative: a shared node
+// keeps the parent and sibling links of the first node that referenced it.
+// Walk it through children (Expr, child<Idx>, iterator::child) rather than
+// with the pre-order iterator, which would skip shared nodes.
+//
+// This is a pass over a finished tree, so peak memory is that of the
+// unshared tree plus the result; only what stays resident afterwards
+// shrinks.
+auto hash_cons(const ExprTree& tree, const TokenList& tokens) -> ExprTree;
+
+}  // namespace loxt
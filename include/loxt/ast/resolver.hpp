@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+#include "../lexer.hpp"
+#include "expr.hpp"
+
+namespace loxt {
+
+// Environment slots of the variables one tree reads. Slots are dense, so an
+// environment is a flat array of size() values, and the layout stays valid
+// for every evaluation of the same tree.
+class SlotLayout {
+ public:
+  [[nodiscard]] auto size() const -> std::size_t {
+    return identifiers_.size();
+  }
+
+  [[nodiscard]] auto identifier(Slot slot) const -> Identifier {
+    return identifiers_[slot];
+  }
+
+  // The slot of `ident`, if the tree reads it.
+  [[nodiscard]] auto find(Identifier ident) const -> std::optional<Slot> {
+    if (ident >= slots_.size() || slots_[ident] == Unresolved_Slot) {
+      return std::nullopt;
+    }
+    return slots_[ident];
+  }
+
+ private:
+  friend auto resolve(ExprTree& tree, const TokenList& tokens) -> SlotLayout;
+
+  std::vector<Identifier> identifiers_;
+  // Indexed by Identifier.
+  std::vector<Slot> slots_;
+};
+
+// Gives every distinct variable in `tree` a slot, in order of first use, and
+// records it in the Variable nodes. Resolving the same tree again yields the
+// same layout. Works on hash-consed trees too, since every node is visited
+// once whatever its parents.
+auto resolve(ExprTree& tree, const TokenList& tokens) -> SlotLayout;
+
+}  // namespace loxt
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "../lexer.hpp"
+#include "expr.hpp"
+
+namespace loxt {
+
+// Static type of an expression. Any is a value whose type is only known at
+// run time.
+enum class StaticType : std::uint8_t { Nil, Bool, Number, String, Any };
+
+// The static type of every node of one tree, indexed by node id. Nodes not
+// reachable from the root are Any.
+using NodeTypes = std::vector<StaticType>;
+
+// Propagates literal types up the tree. A node is typed whenever evaluating
+// it can only yield that type or throw, so `x - 1` is a Number even though
+// x is Any. Variables take their type from `declared`, or are Any.
+//
+// Operators whose operands are proven to be of the wrong type throw the
+// message evaluation would, even where short circuiting would never run
+// them, so `"a" - 1` is rejected before anything is evaluated.
+auto infer_types(const ExprTree& tree,
+                 const std::unordered_map<Identifier, StaticType>& declared =
+                     {}) -> NodeTypes;
+
+}  // namespace loxt
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+#include "ast/expr.hpp"
+#include "eval.hpp"
+#include "lexer.hpp"
+
+namespace loxt {
+
+// Rows evaluated per pass. Big enough to amortise per-node work, small
+// enough that every intermediate result of an expression stays in cache.
+constexpr std::size_t Batch_Size = 1024;
+
+// One input column, indexed by row.
+using Column = std::variant<std::span<const double>, std::span<const bool>,
+                            std::span<const std::string>>;
+
+// Evaluates one expression over many rows at once. Variables are bound to
+// columns and the tree is compiled to a flat list of typed operations. Each
+// operation then runs as one tight loop over a batch of rows, with no
+// dispatch per row. `and` and `or` narrow the set of live rows with a
+// selection vector, so their right operand is only computed for rows the
+// left operand did not decide.
+//
+// Types are fixed per column, so most operations are typed once, when the
+// expression is compiled. Where the type can change from row to row, as
+// for `and` and `or` over operands of different types, results are boxed
+// Values and their consumers check types per row. Errors proven while
+// compiling, like adding a number column to a string column or reading an
+// unbound variable, are only thrown if a row reaches them, so an untaken
+// `and`/`or` operand does not change the result.
+class BatchEvaluator {
+ public:
+  BatchEvaluator(const ExprTree& tree, const TokenList& tokens);
+
+  // Binding a name the source never mentions has no effect. Every column
+  // must hold at least as many rows as are later evaluated.
+  void bind(std::string_view name, Column column);
+
+  // Indices of the rows for which the expression is truthy.
+  auto filter(std::size_t rows) -> std::vector<std::size_t>;
+
+  // The value of the expression for every row.
+  auto evaluate(std::size_t rows) -> std::vector<Value>;
+
+ private:
+  enum class Type : std::uint8_t { Nil, Bool, Number, String, Any };
+
+  // Rows of the current batch an operation is computed for: either all of
+  // [0, count) or the listed offsets.
+  struct Selection {
+    const std::uint16_t* rows;
+    std::size_t count;
+    bool dense;
+  };
+
+  // A compiled node. `numbers`, `flags`, `strings` or `values`, depending
+  // on `type`, point at the current batch of results: into a bound column,
+  // at a broadcast literal or at the operation's own buffer.
+  struct Op {
+    ExprKind kind;
+    std::uint8_t op = 0;
+    Type type = Type::Nil;
+    std::size_t lhs = 0;
+    std::size_t rhs = 0;
+    Identifier column = 0;
+    // Thrown once the operands ran, if any row reaches the operation.
+    const char* error = nullptr;
+
+    const double* numbers = nullptr;
+    const bool* flags = nullptr;
+    const std::string* strings = nullptr;
+    const Value* values = nullptr;
+
+    std::vector<double> number_store{};
+    std::unique_ptr<bool[]> flag_store{};
+    std::vector<std::string> string_store{};
+    std::vector<Value> value_store{};
+    std::vector<std::uint16_t> selection{};
+  };
+
+  void compile();
+  auto compile(ExprTree::const_iterator node) -> std::size_t;
+  auto compile_binary(Op op, ExprTree::const_iterator node) -> std::size_t;
+  void allocate(Op& op);
+
+  // Runs the batch of `count` rows starting at `offset`.
+  void run(std::size_t offset, std::size_t count);
+  void eval(std::size_t index, const Selection& sel);
+  void eval_logical(Op& op, const Selection& sel);
+  void eval_equality(Op& op, const Selection& sel);
+  void eval_numeric(Op& op, const Selection& sel);
+
+  auto truthy(const Op& op, std::size_t row) const -> bool;
+  auto value(const Op& op, std::size_t row) const -> Value;
+  // Stores a result computed by the checked, per row path.
+  static void store(Op& op, std::size_t row, Value value);
+
+  const ExprTree& tree_;
+  const TokenList& tokens_;
+  std::unordered_map<Identifier, Column> columns_;
+  std::vector<Op> ops_;
+  std::size_t root_ = 0;
+  bool compiled_ = false;
+};
+
+}  // namespace loxt
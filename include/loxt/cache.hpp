@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "ast/expr.hpp"
+#include "lexer.hpp"
+
+namespace loxt {
+
+constexpr std::uint32_t Cache_Format_Version = 3;
+
+auto content_hash(std::string_view source) -> std::uint64_t;
+
+// A lexed, and optionally parsed, script.
+struct Artifact {
+  std::shared_ptr<TokenList> tokens;
+  std::optional<ExprTree> tree;
+};
+
+// Encodes the token list and tree of `source` into the on-disk cache
+// format. Source positions are stored as offsets, so the image does not
+// depend on where the source or the file is mapped. The source itself is
+// stored too, so a hit can be checked byte for byte.
+auto serialize(const TokenList& tokens, const ExprTree* tree) -> std::string;
+
+// Rebuilds an artifact from a cache image. Returns nothing if the image is
+// malformed, from another format version or was built from other source.
+auto deserialize(std::string_view image, const std::string& source)
+    -> std::optional<Artifact>;
+
+// Directory of serialised artifacts keyed by the content hash of their
+// source. Lookups map the file and rebuild the token list and tree from it
+// in place of lexing and parsing. Safe to share between threads.
+class ScriptCache {
+ public:
+  explicit ScriptCache(std::filesystem::path directory);
+  // Parses with a depth limit other than Default_Max_Depth, see
+  // Parser::set_max_depth(). Trees parsed under another limit are kept
+  // apart, so a lookup never returns one nested deeper than this limit.
+  ScriptCache(std::filesystem::path directory, std::size_t max_depth);
+
+  // Both keep a reference to `source` in the returned tokens, so it must
+  // outlive them, as with lex().
+  auto lex(const std::string& source) -> std::shared_ptr<TokenList>;
+  auto parse(const std::string& source) -> Artifact;
+
+  [[nodiscard]] auto hits() const -> std::size_t { return hits_; }
+  [[nodiscard]] auto misses() const -> std::size_t { return misses_; }
+
+ private:
+  auto path_for(const std::string& source) const -> std::filesystem::path;
+  auto load(const std::string& source) -> std::optional<Artifact>;
+  void store(const std::string& source, const TokenList& tokens,
+             const ExprTree* tree);
+
+  std::filesystem::path directory_;
+  std::size_t max_depth_;
+  std::atomic<std::size_t> hits_{0};
+  std::atomic<std::size_t> misses_{0};
+};
+
+}  // namespace loxt
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <functional>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+
+#include "ast/expr.hpp"
+#include "ast/types.hpp"
+#include "eval.hpp"
+#include "lexer.hpp"
+
+namespace loxt {
+
+// Variable values, indexed by the slots resolve() assigned, so a flat
+// vector of SlotLayout::size() values.
+using Environment = std::span<const Value>;
+
+// An expression compiled into nested function objects. Each node is bound
+// to its operands when compiled and specialised on its operator and operand
+// types, so evaluation runs without switching on node or literal kinds and
+// without boxing intermediate results. Only operands typed Any fall back to
+// run-time type checks.
+class CompiledExpr {
+ public:
+  [[nodiscard]] auto type() const -> StaticType { return type_; }
+
+  auto operator()(Environment env) const -> Value { return value_(env); }
+
+  // Truthiness of the result, for predicates. Never boxes the result.
+  [[nodiscard]] auto test(Environment env) const -> bool {
+    return truthy_(env);
+  }
+
+ private:
+  friend class ClosureCompiler;
+
+  CompiledExpr(StaticType type, std::function<Value(Environment)> value,
+               std::function<bool(Environment)> truthy)
+      : type_{type}, value_{std::move(value)}, truthy_{std::move(truthy)} {}
+
+  StaticType type_;
+  std::function<Value(Environment)> value_;
+  std::function<bool(Environment)> truthy_;
+};
+
+class ClosureCompiler {
+ public:
+  explicit ClosureCompiler(const TokenList& tokens) : tokens_{tokens} {}
+
+  // Fixes the type of a variable. Undeclared variables are typed Any. A
+  // declared variable holding another type at run time throws.
+  void declare(std::string_view name, StaticType type);
+
+  // Operators applied to operands of known wrong types compile to nodes
+  // that throw when they run, so an untaken `and`/`or` operand still
+  // evaluates as it does under Evaluator. The tree must have been resolved.
+  auto compile(const ExprTree& tree) -> CompiledExpr;
+
+ private:
+  const TokenList& tokens_;
+  std::unordered_map<Identifier, StaticType> types_;
+};
+
+}  // namespace loxt
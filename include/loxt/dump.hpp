@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <format>
+#include <iterator>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#include "ast/expr.hpp"
+#include "lexer.hpp"
+
+namespace loxt {
+
+enum class DumpFormat : std::uint8_t { Text, Jsonl, Binary };
+
+constexpr std::size_t Default_Dump_Buffer_Size = (1 << 16);
+
+// Accumulates output in one reusable buffer and hands it to the stream in
+// large writes. Formatting goes straight into the buffer, so nothing is
+// allocated per record once the buffer has reached its capacity.
+class DumpWriter {
+ public:
+  explicit DumpWriter(std::ostream& out,
+                      std::size_t capacity = Default_Dump_Buffer_Size)
+      : out_(out), capacity_(capacity) {
+    buffer_.reserve(capacity_ + Flush_Slack);
+  }
+  DumpWriter(const DumpWriter&) = delete;
+  auto operator=(const DumpWriter&) -> DumpWriter& = delete;
+  ~DumpWriter() { flush(); }
+
+  template <class... Args>
+  void format(std::format_string<Args...> fmt, Args&&... args) {
+    std::format_to(std::back_inserter(buffer_), fmt,
+                   std::forward<Args>(args)...);
+    maybe_flush();
+  }
+
+  // Calls fn with an output iterator appending to the buffer.
+  template <class Fn>
+  void append(Fn&& fn) {
+    fn(std::back_inserter(buffer_));
+    maybe_flush();
+  }
+
+  void write(std::string_view str) {
+    buffer_.append(str);
+    maybe_flush();
+  }
+
+  void put(char chr) {
+    buffer_.push_back(chr);
+    maybe_flush();
+  }
+
+  // Appends str as the contents of a JSON string literal.
+  void write_json_escaped(std::string_view str);
+
+  // Little endian fixed width integers for the binary format.
+  void write_u8(std::uint8_t value) { put(static_cast<char>(value)); }
+  void write_u32(std::uint32_t value);
+  void write_u64(std::uint64_t value);
+
+  void flush() {
+    out_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+    buffer_.clear();
+  }
+
+ private:
+  static constexpr std::size_t Flush_Slack = 256;
+
+  void maybe_flush() {
+    if (buffer_.size() >= capacity_) {
+      flush();
+    }
+  }
+
+  std::ostream& out_;
+  std::size_t capacity_;
+  std::string buffer_;
+};
+
+// Binary dumps start with a four byte magic followed by a u32 version.
+constexpr std::string_view Token_Dump_Magic = "LXTK";
+constexpr std::string_view Ast_Dump_Magic = "LXAS";
+constexpr std::uint32_t Dump_Version = 1;
+
+void dump_tokens(DumpWriter& writer, const TokenList& tokens,
+                 DumpFormat format);
+
+void dump_ast(DumpWriter& writer, const ExprTree& tree, const TokenList& tokens,
+              DumpFormat format);
+
+// Same output as above, except that JSONL node ids are pre-order indices.
+void dump_ast(DumpWriter& writer, const FrozenExprTree& tree,
+              const TokenList& tokens, DumpFormat format);
+
+}  // namespace loxt
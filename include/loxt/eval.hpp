@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "ast/expr.hpp"
+#include "ast/resolver.hpp"
+#include "ast/types.hpp"
+#include "lexer.hpp"
+#include "rope.hpp"
+
+namespace loxt {
+
+// A runtime value: nil, a boolean, a number or a string.
+class Value {
+ public:
+  Value() = default;
+  explicit Value(bool value) : value_{value} {}
+  explicit Value(double value) : value_{value} {}
+  explicit Value(std::string value) : value_{std::move(value)} {}
+  // Without this a string literal would pick the bool constructor.
+  explicit Value(const char* value) : value_{std::string{value}} {}
+
+  [[nodiscard]] auto is_nil() const -> bool {
+    return std::holds_alternative<std::monostate>(value_);
+  }
+  [[nodiscard]] auto is_bool() const -> bool {
+    return std::holds_alternative<bool>(value_);
+  }
+  [[nodiscard]] auto is_number() const -> bool {
+    return std::holds_alternative<double>(value_);
+  }
+  [[nodiscard]] auto is_string() const -> bool {
+    return std::holds_alternative<std::string>(value_);
+  }
+
+  [[nodiscard]] auto as_bool() const -> bool { return std::get<bool>(value_); }
+  [[nodiscard]] auto as_number() const -> double {
+    return std::get<double>(value_);
+  }
+  [[nodiscard]] auto as_string() const -> const std::string& {
+    return std::get<std::string>(value_);
+  }
+
+  // nil and false are falsey, everything else is truthy.
+  [[nodiscard]] auto truthy() const -> bool {
+    return !is_nil() && (!is_bool() || as_bool());
+  }
+
+  // Values of different types are never equal.
+  friend auto operator==(const Value& lhs, const Value& rhs) -> bool = default;
+
+ private:
+  std::variant<std::monostate, bool, double, std::string> value_;
+};
+
+auto to_string(const Value& value) -> std::string;
+
+// Operator semantics shared by the evaluators. `and` and `or` are not
+// handled here, since they decide whether their right operand runs at all.
+auto apply(BinaryOpKind op, const Value& lhs, const Value& rhs) -> Value;
+auto apply(UnaryOpKind op, const Value& operand) -> Value;
+// An arithmetic or comparison operator on operands already known to be
+// numbers.
+auto numeric(BinaryOpKind op, double left, double right) -> Value;
+
+class EvalCache;
+
+// Tree walking evaluator. Variables live in a flat array indexed by the
+// slots resolve() assigned, and type errors are thrown as strings like
+// parse errors. The tree must have been resolved into `layout`. String
+// concatenations are built as ropes over the literal pool and the bound
+// variables, so a chain of n pieces is flattened once instead of copied n
+// times.
+class Evaluator {
+ public:
+  Evaluator(const TokenList& tokens, const SlotLayout& layout)
+      : tokens_{tokens}, layout_{layout}, slots_(layout.size()) {}
+
+  // Binding a name the tree never reads has no effect.
+  void bind(std::string_view name, Value value);
+  void bind(Identifier ident, Value value) {
+    if (auto slot = layout_.find(ident)) {
+      slots_[*slot] = std::move(value);
+    }
+  }
+
+  // Reuses the values of pure subtrees, those reading no variable, from
+  // `cache`, and stores the ones it has to compute. The cache must outlive
+  // the evaluator.
+  void use_cache(EvalCache& cache) { cache_ = &cache; }
+
+  // Skips the operand type checks of arithmetic and comparisons whose
+  // operands `types` proves to be numbers. `types` must come from
+  // infer_types() on the trees evaluated, with the variables' declared types
+  // matching what is bound, and must outlive the evaluator.
+  void use_types(const NodeTypes& types) { types_ = &types; }
+
+  auto evaluate(const ExprTree& tree) -> Value;
+  // Value of each expression under the root, for trees holding one per
+  // statement like those parse_range() builds.
+  auto evaluate_all(const ExprTree& tree) -> std::vector<Value>;
+  auto evaluate(ExprTree::const_iterator node) -> Value;
+  // Walks a frozen copy of a resolved tree in one pass over its nodes, for
+  // trees evaluated many times. The cache and the types are keyed by the
+  // ids of the tree they were built for, so neither applies here.
+  auto evaluate(const FrozenExprTree& tree) -> Value;
+
+ private:
+  // A concatenation operand. Strings are always ropes.
+  using Operand = std::variant<Value, Rope>;
+
+  // Finds the largest pure operator subtrees of `tree` and their keys. Kept
+  // until a different tree, or another generation of this one, is seen.
+  void index_pure_subtrees(const ExprTree& tree);
+  // Key of `node` if its value may come from the cache.
+  auto cache_key(ExprTree::const_iterator node) const -> const std::string*;
+  static auto cache_key(FrozenExprTree::cursor /*node*/)
+      -> const std::string* {
+    return nullptr;
+  }
+  // Whether `types` proves both operands of `node` to be numbers.
+  auto numeric_operands(ExprTree::const_iterator node) const -> bool;
+  static auto numeric_operands(FrozenExprTree::cursor /*node*/) -> bool {
+    return false;
+  }
+
+  // The walk is shared by both tree forms; `Cursor` is ExprTree's iterator
+  // or FrozenExprTree's cursor.
+  template <class Cursor>
+  auto evaluate_node(Cursor node) -> Value;
+  template <class Cursor>
+  auto evaluate_uncached(Cursor node) -> Value;
+  template <class Cursor>
+  auto binary(Cursor node) -> Value;
+  template <class Cursor>
+  auto add(Cursor node) -> Value;
+  template <class Cursor>
+  auto add_operands(Cursor node) -> Operand;
+  template <class Cursor>
+  auto concat_operand(Cursor node) -> Operand;
+  auto literal(const ExprData& data) const -> Value;
+
+  const TokenList& tokens_;
+  const SlotLayout& layout_;
+  // Unbound slots are empty.
+  std::vector<std::optional<Value>> slots_;
+
+  const NodeTypes* types_ = nullptr;
+  EvalCache* cache_ = nullptr;
+  const ExprTree* indexed_ = nullptr;
+  std::uint64_t indexed_generation_ = 0;
+  std::unordered_map<std::size_t, std::string> keys_;
+
+  // Holds the ropes of the outermost concatenation being evaluated.
+  StringArena arena_;
+  bool concatenating_ = false;
+};
+
+}  // namespace loxt
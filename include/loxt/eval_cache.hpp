@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "ast/expr.hpp"
+#include "eval.hpp"
+#include "lexer.hpp"
+
+namespace loxt {
+
+// Canonical encoding of the subtree at `node`: every node's ExprData in
+// pre-order, with literals by value rather than by index, so equal
+// expressions from different token lists get equal keys. Empty if the
+// subtree reads a variable, since only pure subtrees can be reused.
+auto structural_key(ExprTree::const_iterator node, const TokenList& tokens)
+    -> std::optional<std::string>;
+
+// Bounded map from structural_key() to the value of that subtree. Entries
+// are split over independently locked shards by key hash, and each shard
+// evicts its least recently used entry when full. Safe to share between
+// threads.
+class EvalCache {
+ public:
+  explicit EvalCache(std::size_t capacity);
+
+  auto find(const std::string& key) -> std::optional<Value>;
+  void insert(const std::string& key, const Value& value);
+
+  // Process wide cache, used by evaluators that opt in with use_cache().
+  static auto shared() -> EvalCache&;
+
+  [[nodiscard]] auto capacity() const -> std::size_t;
+  [[nodiscard]] auto size() const -> std::size_t;
+  [[nodiscard]] auto hits() const -> std::size_t { return hits_; }
+  [[nodiscard]] auto misses() const -> std::size_t { return misses_; }
+  [[nodiscard]] auto hit_rate() const -> double {
+    auto total = hits() + misses();
+    return total == 0 ? 0.0
+                      : static_cast<double>(hits()) /
+                            static_cast<double>(total);
+  }
+
+ private:
+  static constexpr std::size_t Max_Shards = 16;
+
+  struct Shard {
+    mutable std::mutex mutex;
+    // Most recently used first. The index's keys view the list's keys.
+    std::list<std::pair<std::string, Value>> entries;
+    std::unordered_map<std::string_view, decltype(entries)::iterator> index;
+    std::size_t capacity = 0;
+  };
+
+  auto shard_for(const std::string& key) -> Shard&;
+
+  std::vector<std::unique_ptr<Shard>> shards_;
+  std::atomic<std::size_t> hits_{0};
+  std::atomic<std::size_t> misses_{0};
+};
+
+}  // namespace loxt
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "ast/expr.hpp"
+#include "lexer.hpp"
+
+namespace loxt::detail {
+
+// The expression grammar, shared by Parser and static_expr(). It is
+// recursive descent over an explicit stack of frames, so input nesting
+// never grows the call stack. The Builder reads the tokens and stores the
+// nodes:
+//   peek() -> TokenKind          the current token
+//   advance()                    moves past it
+//   push(parent, data) -> Node   appends a node for it under parent
+//   make_parent(node, child)     moves child under node, as its last child
+//   literal() -> Literal         pool index of the current Number or String
+//   identifier() -> Identifier   id of the current Identifier
+template <class Builder>
+class Grammar {
+ public:
+  using Node = typename Builder::Node;
+
+  // Parenthesised and unary operands deeper than `max_depth` throw.
+  constexpr Grammar(Builder& builder, std::size_t max_depth)
+      : builder_{builder}, max_depth_{max_depth} {}
+
+  // Parses one expression under `parent`, which is already inside `depth`
+  // parentheses and unary operators, and returns its outermost node.
+  constexpr auto expression(Node parent, std::size_t depth = 0) -> Node {
+    std::vector<Frame> frames;
+    auto operand = descend(frames, Level::Or, parent, depth);
+    while (!frames.empty()) {
+      auto frame = frames.back();
+      frames.pop_back();
+      if (frame.level == Level::Paren) {
+        if (!at(TokenKind::RightParen())) {
+          throw "hanging paren";
+        }
+        builder_.advance();
+        operand = *frame.node;
+        continue;
+      }
+
+      // The operand finishes either the left operand or, if an operator was
+      // pending, its right one, which makes the operator the left operand.
+      auto lhs = frame.node.value_or(operand);
+      if (!at_operator(frame.level)) {
+        operand = lhs;
+        continue;
+      }
+      auto current = builder_.push(
+          frame.parent, ExprData{ExprKind::Binary, binary_op(builder_.peek())});
+      builder_.advance();
+      builder_.make_parent(current, lhs);
+      frames.push_back({frame.level, frame.parent, current, frame.depth});
+      auto next = static_cast<Level>(static_cast<int>(frame.level) + 1);
+      operand = descend(frames, next, current, frame.depth);
+    }
+    return operand;
+  }
+
+ private:
+  // Grammar rules, loosest first. Only the binary levels and Paren, which
+  // waits for the ')', are ever left waiting on the frame stack.
+  enum class Level : std::uint8_t {
+    Or,
+    And,
+    Equality,
+    Comparison,
+    Term,
+    Factor,
+    Unary,
+    Paren
+  };
+
+  // A grammar rule waiting for the operand it asked for. For a binary level
+  // `node` is the operator whose right operand is being parsed, if any; for
+  // Paren it is the outermost node of the operand the '(' started, which is
+  // a unary operator applied to the Paren or the Paren itself. `depth`
+  // counts the parentheses and unary operators around the rule.
+  struct Frame {
+    Level level;
+    Node parent;
+    std::optional<Node> node;
+    std::size_t depth;
+  };
+
+  static constexpr auto binary_op(TokenKind kind) -> BinaryOpKind {
+    switch (kind.kind()) {
+      case TokenKind::Kind::Or:
+        return BinaryOpKind::Or;
+      case TokenKind::Kind::And:
+        return BinaryOpKind::And;
+      case TokenKind::Kind::EqualEqual:
+        return BinaryOpKind::Eq;
+      case TokenKind::Kind::BangEqual:
+        return BinaryOpKind::Neq;
+      case TokenKind::Kind::Greater:
+        return BinaryOpKind::Gt;
+      case TokenKind::Kind::GreaterEqual:
+        return BinaryOpKind::Ge;
+      case TokenKind::Kind::Less:
+        return BinaryOpKind::Lt;
+      case TokenKind::Kind::LessEqual:
+        return BinaryOpKind::Le;
+      case TokenKind::Kind::Minus:
+        return BinaryOpKind::Minus;
+      case TokenKind::Kind::Plus:
+        return BinaryOpKind::Add;
+      case TokenKind::Kind::BackSlash:
+        return BinaryOpKind::Div;
+      case TokenKind::Kind::Asterisk:
+        return BinaryOpKind::Mul;
+      default:
+        throw "Invalid binary operator";
+    }
+  }
+
+  template <class... Kinds>
+  constexpr auto at(Kinds... kinds) const -> bool {
+    auto current = builder_.peek();
+    return ((current == kinds) || ...);
+  }
+
+  // Pushes frames for the rules from `level` down to Factor, then parses
+  // unary operators and '('s down to the first leaf. Returns the operand the
+  // last pushed frame is waiting for.
+  constexpr auto descend(std::vector<Frame>& frames, Level level, Node parent,
+                         std::size_t depth) -> Node {
+    // The outermost unary operator in front of the current leaf or '('.
+    std::optional<Node> outer;
+    for (;;) {
+      for (; level < Level::Unary;
+           level = static_cast<Level>(static_cast<int>(level) + 1)) {
+        frames.push_back({level, parent, std::nullopt, depth});
+      }
+      bool nests =
+          at(TokenKind::Bang(), TokenKind::Minus(), TokenKind::LeftParen());
+      if (nests && ++depth > max_depth_) {
+        throw "Expression nested too deeply";
+      }
+      if (at(TokenKind::Bang(), TokenKind::Minus())) {
+        auto uop = at(TokenKind::Bang()) ? UnaryOpKind::Not : UnaryOpKind::Neg;
+        parent = builder_.push(parent, ExprData{ExprKind::Unary, uop});
+        builder_.advance();
+        outer = outer.value_or(parent);
+        continue;
+      }
+      if (at(TokenKind::LeftParen())) {
+        parent = builder_.push(parent, ExprData{ExprKind::Paren});
+        builder_.advance();
+        frames.push_back(
+            {Level::Paren, parent, outer.value_or(parent), depth});
+        outer.reset();
+        level = Level::Or;
+        continue;
+      }
+      auto leaf = primary(parent);
+      return outer.value_or(leaf);
+    }
+  }
+
+  constexpr auto at_operator(Level level) const -> bool {
+    switch (level) {
+      case Level::Or:
+        return at(TokenKind::Or());
+      case Level::And:
+        return at(TokenKind::And());
+      case Level::Equality:
+        return at(TokenKind::BangEqual(), TokenKind::EqualEqual());
+      case Level::Comparison:
+        return at(TokenKind::Greater(), TokenKind::GreaterEqual(),
+                  TokenKind::Less(), TokenKind::LessEqual());
+      case Level::Term:
+        return at(TokenKind::Minus(), TokenKind::Plus());
+      case Level::Factor:
+        return at(TokenKind::BackSlash(), TokenKind::Asterisk());
+      default:
+        return false;
+    }
+  }
+
+  constexpr auto primary(Node parent) -> Node {
+    std::optional<ExprData> data;
+    switch (builder_.peek().kind()) {
+      case TokenKind::Kind::Nil:
+        data = ExprData{ExprKind::Nil};
+        break;
+      case TokenKind::Kind::False:
+      case TokenKind::Kind::True:
+        data = ExprData{ExprKind::Literal, LiteralKind::Bool,
+                        at(TokenKind::True())};
+        break;
+      case TokenKind::Kind::Number:
+        data = ExprData{ExprKind::Literal, LiteralKind::Number,
+                        builder_.literal()};
+        break;
+      case TokenKind::Kind::String:
+        data = ExprData{ExprKind::Literal, LiteralKind::String,
+                        builder_.literal()};
+        break;
+      case TokenKind::Kind::Identifier:
+        data = ExprData{ExprKind::Variable, builder_.identifier()};
+        break;
+      default:
+        throw "Failed to parse expr";
+    }
+    auto node = builder_.push(parent, *data);
+    builder_.advance();
+    return node;
+  }
+
+  Builder& builder_;
+  std::size_t max_depth_;
+};
+
+}  // namespace loxt::detail
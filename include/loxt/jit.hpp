@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "ast/expr.hpp"
+#include "ast/resolver.hpp"
+#include "ast/types.hpp"
+#include "eval.hpp"
+#include "lexer.hpp"
+
+namespace loxt {
+
+constexpr std::size_t Default_Jit_Threshold = 1000;
+
+// Whether this build can generate machine code: an x86-64 POSIX target,
+// configured without LOXT_JIT=OFF.
+auto jit_supported() -> bool;
+
+// Machine code for one numeric or boolean expression, using SSE2 scalar
+// double instructions. Variables are read from an array of doubles indexed
+// by slot, booleans as 0 or 1.
+class JitExpr {
+ public:
+  // Number or Bool.
+  [[nodiscard]] auto type() const -> StaticType { return type_; }
+
+  // The type each slot must hold, Number or Bool.
+  [[nodiscard]] auto slot_types() const -> const std::vector<StaticType>& {
+    return slot_types_;
+  }
+
+  // The number, or 1 for true and 0 for false.
+  auto operator()(const double* slots) const -> double { return fn_(slots); }
+
+ private:
+  friend class JitCompiler;
+
+  using Fn = double (*)(const double*);
+
+  JitExpr(std::shared_ptr<void> code, Fn fn, StaticType type,
+          std::vector<StaticType> slot_types)
+      : code_{std::move(code)},
+        fn_{fn},
+        type_{type},
+        slot_types_{std::move(slot_types)} {}
+
+  // The executable mapping, unmapped with the last copy.
+  std::shared_ptr<void> code_;
+  Fn fn_;
+  StaticType type_;
+  std::vector<StaticType> slot_types_;
+};
+
+class JitCompiler {
+ public:
+  explicit JitCompiler(const TokenList& tokens) : tokens_{tokens} {}
+
+  // Variables must be declared Number or Bool to be compiled.
+  void declare(std::string_view name, StaticType type);
+
+  // Returns nothing unless the tree only uses number and bool literals,
+  // declared variables and the operators on them that cannot fail, or if
+  // the build cannot generate code. Proven type errors throw, as in
+  // infer_types(). The tree must have been resolved.
+  auto compile(const ExprTree& tree) -> std::optional<JitExpr>;
+
+ private:
+  const TokenList& tokens_;
+  std::unordered_map<Identifier, StaticType> types_;
+};
+
+// An expression that is interpreted until it has been evaluated `threshold`
+// times and is then compiled to machine code. Anything the JIT does not
+// support keeps running on the interpreter, as does any call binding a
+// variable to another type than declared. The interpreter walks a frozen
+// copy of the tree, taken once at construction.
+class TieredExpr {
+ public:
+  TieredExpr(const TokenList& tokens, const ExprTree& tree,
+             const SlotLayout& layout,
+             std::size_t threshold = Default_Jit_Threshold)
+      : compiler_{tokens},
+        tree_{tree},
+        frozen_{treeceratops::freeze(tree)},
+        layout_{layout},
+        evaluator_{tokens, layout},
+        threshold_{threshold},
+        numbers_(layout.size()) {}
+
+  // Must precede the first evaluation.
+  void declare(std::string_view name, StaticType type) {
+    compiler_.declare(name, type);
+  }
+
+  // `env` is indexed by slot, as for compiled closures, and must hold a
+  // value for every slot of the layout. Values past the layout are ignored.
+  auto evaluate(std::span<const Value> env) -> Value;
+
+  [[nodiscard]] auto jitted() const -> bool { return jit_.has_value(); }
+
+ private:
+  auto interpret(std::span<const Value> env) -> Value;
+
+  JitCompiler compiler_;
+  const ExprTree& tree_;
+  FrozenExprTree frozen_;
+  const SlotLayout& layout_;
+  Evaluator evaluator_;
+  std::size_t threshold_;
+  std::size_t count_ = 0;
+  std::optional<JitExpr> jit_;
+  std::vector<double> numbers_;
+};
+
+}  // namespace loxt
@@ -1,88 +1,304 @@
 #pragma once
 
+#include <algorithm>
+#include <bit>
 #include <cstdint>
+#include <format>
+#include <iterator>
 #include <memory>
+#include <optional>
+#include <span>
 #include <string>
 #include <string_view>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace loxt {
 
 constexpr std::size_t Default_Block_Size = (1 << 15);
+constexpr std::size_t Min_Block_Size = (1 << 4);
 
+// Append only vector whose elements never move. Storage is a list of blocks
+// that start at a small power of two and double until they reach blockSize,
+// so short inputs stay cheap while long ones settle on large blocks.
 template <class T, std::size_t blockSize = Default_Block_Size>
 class StaticVector {
+  static_assert(std::has_single_bit(blockSize) && blockSize >= Min_Block_Size);
+
   template <class S>
   using Block = std::vector<S>;
 
  public:
-  class Iterator {
+  // Random access iterator. It caches a pointer into the current block so
+  // stepping and dereferencing are plain pointer operations; jumps go
+  // through the constant time index to block mapping. Iterators stay valid
+  // when elements are appended: one positioned past the allocated blocks,
+  // like end() of a full block, finds its block when it is next used.
+  template <bool Const>
+  class BasicIterator {
+    using Owner = std::conditional_t<Const, const StaticVector, StaticVector>;
+
    public:
-    Iterator() = delete;
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = std::conditional_t<Const, const T*, T*>;
+    using reference = std::conditional_t<Const, const T&, T&>;
+
+    BasicIterator() = default;
+
+    // Iterator converts to ConstIterator.
+    template <bool OtherConst>
+      requires(Const && !OtherConst)
+    // NOLINTNEXTLINE(google-explicit-constructor)
+    BasicIterator(const BasicIterator<OtherConst>& other)
+        : m_Vector(other.m_Vector),
+          m_Index(other.m_Index),
+          m_Ptr(other.m_Ptr),
+          m_BlockEnd(other.m_BlockEnd) {}
+
+    auto operator*() const -> reference { return *get(); }
+    auto operator->() const -> pointer { return get(); }
+    auto operator[](difference_type off) const -> reference {
+      return *(*this + off);
+    }
 
-    auto operator++() -> Iterator& {
-      element++;
-      if (element == block->size()) {
-        block++;
-        element = 0;
+    auto operator++() -> BasicIterator& {
+      ++m_Index;
+      if (m_Ptr == nullptr || ++m_Ptr == m_BlockEnd) {
+        seek();
       }
       return *this;
     }
 
-    auto operator*() -> T& { return *(block->begin() + element); }
+    auto operator++(int) -> BasicIterator {
+      auto old = *this;
+      ++*this;
+      return old;
+    }
+
+    auto operator--() -> BasicIterator& { return *this -= 1; }
+
+    auto operator--(int) -> BasicIterator {
+      auto old = *this;
+      --*this;
+      return old;
+    }
+
+    auto operator+=(difference_type off) -> BasicIterator& {
+      m_Index += off;
+      seek();
+      return *this;
+    }
+
+    auto operator-=(difference_type off) -> BasicIterator& {
+      return *this += -off;
+    }
+
+    friend auto operator+(BasicIterator iter, difference_type off)
+        -> BasicIterator {
+      return iter += off;
+    }
+
+    friend auto operator+(difference_type off, BasicIterator iter)
+        -> BasicIterator {
+      return iter += off;
+    }
+
+    friend auto operator-(BasicIterator iter, difference_type off)
+        -> BasicIterator {
+      return iter -= off;
+    }
+
+    friend auto operator-(const BasicIterator& lhs, const BasicIterator& rhs)
+        -> difference_type {
+      return static_cast<difference_type>(lhs.m_Index) -
+             static_cast<difference_type>(rhs.m_Index);
+    }
+
+    friend auto operator==(const BasicIterator& lhs, const BasicIterator& rhs)
+        -> bool {
+      return lhs.m_Index == rhs.m_Index;
+    }
 
-    auto operator->() -> T* { return (block->begin() + element).operator->(); }
+    friend auto operator<=>(const BasicIterator& lhs,
+                            const BasicIterator& rhs) {
+      return lhs.m_Index <=> rhs.m_Index;
+    }
 
-    auto operator<=>(const Iterator& rhs) const = default;
+    // Position of the element in the vector.
+    [[nodiscard]] auto index() const -> std::size_t { return m_Index; }
 
    private:
-    Iterator(const typename std::vector<Block<T>>::iterator& blk,
-             std::size_t elem)
-        : block(blk), element(elem) {}
+    BasicIterator(Owner* vec, std::size_t idx) : m_Vector(vec), m_Index(idx) {
+      seek();
+    }
 
-    friend class StaticVector<T>;
+    // Caches the element's address, or null while its block is not
+    // allocated yet.
+    void seek() {
+      auto [block, element] = m_Vector->locate(m_Index);
+      if (block < m_Vector->m_Blocks.size()) {
+        auto& blk = m_Vector->m_Blocks[block];
+        m_Ptr = blk.data() + element;
+        m_BlockEnd = blk.data() + m_Vector->block_capacity(block);
+      } else {
+        m_Ptr = nullptr;
+        m_BlockEnd = nullptr;
+      }
+    }
+
+    // The element's address, looked up again if its block was allocated
+    // after the iterator was positioned.
+    [[nodiscard]] auto get() const -> pointer {
+      if (m_Ptr != nullptr) {
+        return m_Ptr;
+      }
+      auto [block, element] = m_Vector->locate(m_Index);
+      return m_Vector->m_Blocks[block].data() + element;
+    }
+
+    friend class StaticVector;
+    template <bool>
+    friend class BasicIterator;
 
-    typename std::vector<Block<T>>::iterator block;
-    std::size_t element = 0;
+    Owner* m_Vector = nullptr;
+    std::size_t m_Index = 0;
+    pointer m_Ptr = nullptr;
+    pointer m_BlockEnd = nullptr;
   };
 
-  StaticVector() { new_block(); }
+  using Iterator = BasicIterator<false>;
+  using ConstIterator = BasicIterator<true>;
 
-  auto begin() -> Iterator { return {m_Blocks.begin(), 0}; }
+  // The first block holds first_block elements, rounded up to a power of
+  // two and clamped to [Min_Block_Size, blockSize]. Nothing is allocated
+  // until the first element is added.
+  explicit StaticVector(std::size_t first_block = Min_Block_Size)
+      : m_FirstBlock(
+            std::bit_ceil(std::clamp(first_block, Min_Block_Size, blockSize))) {
+  }
 
-  auto end() -> Iterator { return {m_Blocks.end(), 0}; }
+  // Iterators point into this vector, so copying or moving it would leave
+  // them behind.
+  StaticVector(const StaticVector&) = delete;
+  auto operator=(const StaticVector&) -> StaticVector& = delete;
+  StaticVector(StaticVector&&) = delete;
+  auto operator=(StaticVector&&) -> StaticVector& = delete;
+  ~StaticVector() = default;
+
+  auto begin() -> Iterator { return {this, 0}; }
+  auto end() -> Iterator { return {this, m_Size}; }
+  [[nodiscard]] auto begin() const -> ConstIterator { return {this, 0}; }
+  [[nodiscard]] auto end() const -> ConstIterator { return {this, m_Size}; }
+  [[nodiscard]] auto cbegin() const -> ConstIterator { return begin(); }
+  [[nodiscard]] auto cend() const -> ConstIterator { return end(); }
 
   auto operator[](std::size_t idx) -> T& {
-    return m_Blocks[idx / blockSize][idx % blockSize];
+    auto [block, element] = locate(idx);
+    return m_Blocks[block][element];
+  }
+
+  auto operator[](std::size_t idx) const -> const T& {
+    auto [block, element] = locate(idx);
+    return m_Blocks[block][element];
   }
 
   auto push_back(const T& element) {
+    back_block().push_back(element);
     ++m_Size;
-    m_Blocks.back().push_back(element);
-    if (m_Blocks.back().size() == blockSize) {
-      new_block();
-    }
   }
 
   template <class... Args>
   auto emplace_back(Args&&... args) -> void {
+    back_block().emplace_back(std::forward<Args>(args)...);
     ++m_Size;
-    m_Blocks.back().emplace_back(std::forward<Args>(args)...);
-    if (m_Blocks.back().size() == blockSize) {
-      new_block();
+  }
+
+  // Allocates the blocks needed to hold count elements up front.
+  void reserve(std::size_t count) {
+    if (count == 0) {
+      return;
     }
+    auto [last, element] = locate(count - 1);
+    while (m_Blocks.size() <= last) {
+      add_block();
+    }
+  }
+
+  // Drops every element but keeps the first block's allocation.
+  void clear() {
+    if (m_Blocks.size() > 1) {
+      m_Blocks.erase(m_Blocks.begin() + 1, m_Blocks.end());
+    }
+    if (!m_Blocks.empty()) {
+      m_Blocks.front().clear();
+    }
+    m_Size = 0;
   }
 
   [[nodiscard]] auto size() const -> std::size_t { return m_Size; }
 
+  // The elements as contiguous runs, one per allocated block, for bulk
+  // algorithms. Trailing reserved blocks are empty.
+  [[nodiscard]] auto block_count() const -> std::size_t {
+    return m_Blocks.size();
+  }
+  auto block(std::size_t idx) -> std::span<T> { return m_Blocks[idx]; }
+  [[nodiscard]] auto block(std::size_t idx) const -> std::span<const T> {
+    return m_Blocks[idx];
+  }
+
+  // Bytes held by the blocks and the block table, including reserved but
+  // unused capacity. Heap memory owned by the elements is not included.
+  [[nodiscard]] auto memory_usage() const -> std::size_t {
+    std::size_t bytes = m_Blocks.capacity() * sizeof(Block<T>);
+    for (const auto& block : m_Blocks) {
+      bytes += block.capacity() * sizeof(T);
+    }
+    return bytes;
+  }
+
  private:
-  void new_block() {
+  [[nodiscard]] auto block_capacity(std::size_t block) const -> std::size_t {
+    auto growing = static_cast<std::size_t>(std::countr_zero(blockSize) -
+                                            std::countr_zero(m_FirstBlock));
+    return block < growing ? m_FirstBlock << block : blockSize;
+  }
+
+  // Maps an element index to (block, offset) in constant time. The growing
+  // blocks hold first, 2 * first, ... elements, blockSize - first in total.
+  [[nodiscard]] auto locate(std::size_t idx) const
+      -> std::pair<std::size_t, std::size_t> {
+    std::size_t growing_total = blockSize - m_FirstBlock;
+    if (idx < growing_total) {
+      std::size_t block = std::bit_width(idx / m_FirstBlock + 1) - 1;
+      return {block, idx - m_FirstBlock * ((std::size_t{1} << block) - 1)};
+    }
+    auto growing = static_cast<std::size_t>(std::countr_zero(blockSize) -
+                                            std::countr_zero(m_FirstBlock));
+    idx -= growing_total;
+    return {growing + idx / blockSize, idx % blockSize};
+  }
+
+  void add_block() {
     m_Blocks.emplace_back();
-    m_Blocks.back().reserve(blockSize);
+    m_Blocks.back().reserve(block_capacity(m_Blocks.size() - 1));
+  }
+
+  // The block the next element goes into.
+  auto back_block() -> Block<T>& {
+    auto [block, element] = locate(m_Size);
+    if (block == m_Blocks.size()) {
+      add_block();
+    }
+    return m_Blocks[block];
   }
 
   std::vector<Block<T>> m_Blocks;
+  std::size_t m_FirstBlock;
   std::size_t m_Size = 0;
 };
 
@@ -98,17 +314,17 @@ class TokenKind {
 
   TokenKind() = delete;
 
-  friend auto operator==(TokenKind lhs, TokenKind rhs) -> bool {
+  friend constexpr auto operator==(TokenKind lhs, TokenKind rhs) -> bool {
     return lhs.m_Kind == rhs.m_Kind;
   }
 
-  friend auto operator!=(TokenKind lhs, TokenKind rhs) -> bool {
+  friend constexpr auto operator!=(TokenKind lhs, TokenKind rhs) -> bool {
     return lhs.m_Kind != rhs.m_Kind;
   }
 
   [[nodiscard]] auto name() const -> const std::string&;
 
-  [[nodiscard]] auto kind() const -> Kind { return m_Kind; }
+  [[nodiscard]] constexpr auto kind() const -> Kind { return m_Kind; }
 
  private:
   constexpr explicit TokenKind(Kind kind) : m_Kind(kind) {}
@@ -139,15 +355,58 @@ struct Token {
       : kind(in_kind), identifier(extra_id), loc(in_loc) {}
 };
 
+struct Artifact;
+struct TokenBatch;
+
+// Half open range of token indices in a TokenList.
+struct TokenRange {
+  std::size_t begin;
+  std::size_t end;
+};
+
+struct Diagnostic {
+  SourceLocation loc;
+  std::string message;
+};
+
+// Heap bytes held by a TokenList, by component. Sizes come from container
+// capacities; hash table nodes are estimated from their element size. The
+// source text and identifier spellings are views and are not counted.
+struct TokenListMemory {
+  std::size_t tokens = 0;
+  std::size_t interner = 0;
+  std::size_t literals = 0;
+  std::size_t diagnostics = 0;
+
+  [[nodiscard]] auto total() const -> std::size_t {
+    return tokens + interner + literals + diagnostics;
+  }
+};
+
 class TokenList {
  public:
   using Iterator = StaticVector<Token>::Iterator;
+  using ConstIterator = StaticVector<Token>::ConstIterator;
 
   [[nodiscard]] auto begin() -> Iterator { return m_Tokens.begin(); }
   [[nodiscard]] auto end() -> Iterator { return m_Tokens.end(); }
+  [[nodiscard]] auto begin() const -> ConstIterator { return m_Tokens.begin(); }
+  [[nodiscard]] auto end() const -> ConstIterator { return m_Tokens.end(); }
 
   [[nodiscard]] auto size() const -> std::size_t { return m_Tokens.size(); }
 
+  [[nodiscard]] auto operator[](std::size_t idx) -> Token& {
+    return m_Tokens[idx];
+  }
+
+  [[nodiscard]] auto operator[](std::size_t idx) const -> const Token& {
+    return m_Tokens[idx];
+  }
+
+  [[nodiscard]] auto tokens() const -> const StaticVector<Token>& {
+    return m_Tokens;
+  }
+
   [[nodiscard]] auto identifier(Identifier ident) const
       -> const std::string_view& {
     return m_Identifiers[ident];
@@ -162,14 +421,67 @@ class TokenList {
     return m_NumberLiteral[literal];
   }
 
-  [[nodiscard]] auto source() const -> const std::string& { return m_Source; }
+  // The interned id of `name`, if the source used it as an identifier.
+  [[nodiscard]] auto find_identifier(std::string_view name) const
+      -> std::optional<Identifier> {
+    if (auto iter = m_IdentifierMap.find(name); iter != m_IdentifierMap.end()) {
+      return iter->second;
+    }
+    return std::nullopt;
+  }
+
+  [[nodiscard]] auto identifier_count() const -> std::size_t {
+    return m_Identifiers.size();
+  }
+
+  [[nodiscard]] auto string_literal_count() const -> std::size_t {
+    return m_StringLiteral.size();
+  }
+
+  [[nodiscard]] auto number_literal_count() const -> std::size_t {
+    return m_NumberLiteral.size();
+  }
+
+  // The source most recently lexed into this list.
+  [[nodiscard]] auto source() const -> const std::string& { return *m_Source; }
 
   [[nodiscard]] auto to_string(const Token& token) const -> std::string;
 
+  template <class OutputIt>
+  auto format_to(OutputIt out, const Token& token) const -> OutputIt {
+    out = std::format_to(out, "{{kind: {}, line: {}, column: {}",
+                         token.kind.name(), token.loc.line, token.loc.column);
+    if (token.kind == TokenKind::Identifier()) {
+      out = std::format_to(out, ", identifier: {}",
+                           identifier(token.identifier));
+    } else if (token.kind == TokenKind::String()) {
+      out = std::format_to(out, ", literal: \"{}\"",
+                           string_literal(token.literal));
+    } else if (token.kind == TokenKind::Number()) {
+      out = std::format_to(out, ", literal: {}", number_literal(token.literal));
+    }
+    *out++ = '}';
+    return out;
+  }
+
   [[nodiscard]] auto has_error() const -> bool { return m_HasError; }
 
+  [[nodiscard]] auto diagnostics() const -> const std::vector<Diagnostic>& {
+    return m_Diagnostics;
+  }
+
+  [[nodiscard]] auto memory_usage() const -> TokenListMemory;
+
  private:
-  explicit TokenList(const std::string& source) : m_Source(source) {}
+  explicit TokenList(std::size_t expected_tokens);
+
+  // Lexes source onto the end of the list, finishing with an Eof token.
+  void lex_source(const std::string& source);
+
+  void report(SourceLocation loc, std::string message) {
+    m_HasError = true;
+    m_Diagnostics.push_back({loc, std::move(message)});
+  }
 
   StaticVector<Token> m_Tokens;
   std::unordered_map<std::string_view, Identifier> m_IdentifierMap;
@@ -177,13 +489,40 @@ class TokenList {
   std::vector<std::string> m_StringLiteral;
   std::vector<uint64_t> m_NumberLiteral;
 
+  std::vector<Diagnostic> m_Diagnostics;
+
   bool m_HasError = false;
 
-  const std::string& m_Source;
+  const std::string* m_Source;
 
+  friend class Session;
   friend auto lex(const std::string& source) -> std::shared_ptr<TokenList>;
+  friend auto lex_batch(std::span<const std::string> sources) -> TokenBatch;
+  friend auto deserialize(std::string_view image, const std::string& source)
+      -> std::optional<Artifact>;
 };
 
 auto lex(const std::string& source) -> std::shared_ptr<TokenList>;
 
+// Many sources lexed into one TokenList, so they share its token blocks,
+// identifier interner and literal pools. Each source's tokens end with
+// their own Eof and can be parsed with Parser::parse_range().
+struct TokenBatch {
+  std::shared_ptr<TokenList> tokens;
+  // The tokens of each source, in input order.
+  std::vector<TokenRange> ranges;
+  // Source i's diagnostics are [diagnostics[i], diagnostics[i + 1]), the
+  // last one running to the end of tokens->diagnostics().
+  std::vector<std::size_t> diagnostics;
+};
+
+// The first token block is sized for all of `sources`, which must outlive
+// the batch, as with lex().
+auto lex_batch(std::span<const std::string> sources) -> TokenBatch;
+
+// Rough token count for a source, used to size the first token block.
+inline auto estimate_tokens(const std::string& source) -> std::size_t {
+  return source.size() / 4 + 1;
+}
+
 }  // namespace loxt
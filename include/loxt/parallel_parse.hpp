@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "ast/expr.hpp"
+#include "lexer.hpp"
+#include "thread_pool.hpp"
+
+namespace loxt {
+
+// Parses a source made of many independent ';'-separated expressions.
+// The token list is cut into roughly equal chunks at ';' boundaries and the
+// chunks are parsed concurrently on `pool`. Each result tree has a Root
+// whose children are that chunk's expressions, in source order. Throws the
+// first parse error in source order, as the sequential parser would.
+auto parse_statements(const std::shared_ptr<TokenList>& tokens,
+                      ThreadPool& pool) -> std::vector<ExprTree>;
+
+// Moves the expressions of every tree under a single Root, keeping their
+// order. Nodes are relocated in parallel, one task per input tree.
+auto merge_trees(std::vector<ExprTree>&& trees, ThreadPool& pool) -> ExprTree;
+
+}  // namespace loxt
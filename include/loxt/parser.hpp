@@ -1,32 +1,174 @@
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
 #include "ast/expr.hpp"
+#include "ast/hash_cons.hpp"
+#include "ast/resolver.hpp"
+#include "ast/types.hpp"
+#include "grammar.hpp"
 #include "lexer.hpp"
 
 namespace loxt {
 
+// How the parser lays out its result. HashConsed merges structurally
+// identical subtrees once parsing finishes, see hash_cons().
+enum class BuildMode : std::uint8_t { Tree, HashConsed };
+
+// Tokens [first, first + removed) of a token list were replaced by tokens
+// [first, first + inserted) of its successor. Everything else is unchanged.
+struct TokenEdit {
+  std::size_t first;
+  std::size_t removed;
+  std::size_t inserted;
+};
+
+// The edit turning `before` into `after`, from their common prefix and
+// suffix. Tokens compare by kind and spelling, so the two lists may intern
+// identifiers and literals differently.
+auto token_edit(const TokenList& before, const TokenList& after) -> TokenEdit;
+
+// Default for Parser::set_max_depth(). The evaluators and compilers recurse
+// into every parenthesised and unary operand; at this nesting they use well
+// under a default 8 MiB thread stack, even unoptimised.
+constexpr std::size_t Default_Max_Depth = 4096;
+
+struct ParserMemory {
+  TokenListMemory tokens;
+  treeceratops::tree_memory tree;
+
+  [[nodiscard]] auto total() const -> std::size_t {
+    return tokens.total() + tree.total();
+  }
+};
+
 class Parser {
  public:
-  explicit Parser(const std::shared_ptr<TokenList>& tokens);
+  explicit Parser(std::shared_ptr<const TokenList> tokens,
+                  BuildMode mode = BuildMode::Tree);
+  // Reads `tokens` without sharing ownership, so parsers on many threads do
+  // not contend on one reference count. `tokens` must outlive the parser.
+  explicit Parser(const TokenList& tokens, BuildMode mode = BuildMode::Tree)
+      // An empty owner makes a pointer with no control block.
+      : Parser{std::shared_ptr<const TokenList>{
+                   std::shared_ptr<const TokenList>{}, &tokens},
+               mode} {}
 
   auto tree() -> ExprTree& { return tree_; }
+  [[nodiscard]] auto tree() const -> const ExprTree& { return tree_; }
+
+  // Environment slots of the variables in tree(), filled in by parse().
+  [[nodiscard]] auto slots() const -> const SlotLayout& { return slots_; }
+
+  // Makes parse() and reparse() infer the static type of every node, so
+  // operands of a proven wrong type throw there as parse errors. Variables
+  // are Any.
+  void set_type_check(bool enabled) { type_check_ = enabled; }
+
+  // Filled in by parse() when type checking is enabled, see infer_types().
+  [[nodiscard]] auto types() const -> const NodeTypes& { return types_; }
 
+  // Parenthesised and unary operands deeper than `depth` are a parse error
+  // rather than a tree that recursive consumers cannot walk. Flat chains
+  // like a - b - c - ... do not nest and never count. Parsing itself keeps
+  // its state on the heap, so without a limit only memory bounds the
+  // nesting.
+  void set_max_depth(std::size_t depth) { max_depth_ = depth; }
+
+  // Memory held by the token list the parser reads and the tree it built.
+  [[nodiscard]] auto memory_usage() const -> ParserMemory {
+    return {tokens_->memory_usage(), tree_.memory_usage()};
+  }
+
+  // Parses the whole list as one expression.
   void parse() {
     tree_.push_root(ExprData{ExprKind::Root});
+    anchors_.push_back(token_index());
     auto root = tree_.begin();
     expression(root);
+    if (!(peek() == TokenKind::Eof())) {
+      throw "Unexpected token after expression";
+    }
+    if (mode_ == BuildMode::HashConsed) {
+      tree_ = hash_cons(tree_, *tokens_);
+    }
+    analyse();
   }
 
+  // Parses the ';'-separated expressions in tokens [first, last) as children
+  // of a single root. `last` is either one past a ';' or the Eof token, and
+  // the final expression may leave out its ';' when it ends at Eof.
+  // Variables are left unresolved, since ranges are parsed to be merged;
+  // call resolve() on the merged tree.
+  void parse_range(std::size_t first, std::size_t last);
+
+  // Brings tree() up to date with `tokens`, which is the previously parsed
+  // list with `edit` applied. Only the inside of the innermost parenthesis
+  // around the edit is parsed again and spliced in; every node outside it
+  // keeps its id and only has its literal or identifier index refreshed.
+  // Falls back to a full parse, which renumbers every node, when no
+  // parenthesis encloses the edit, when the edit changes the parenthesis
+  // structure, in HashConsed mode, or once more than half the stored nodes
+  // are ones that earlier reparses detached.
+  void reparse(const std::shared_ptr<const TokenList>& tokens,
+               TokenEdit edit);
+
  private:
-  auto expression(ExprTree::iterator parent) -> ExprTree::iterator;
-  auto equality(ExprTree::iterator parent) -> ExprTree::iterator;
-  auto comparison(ExprTree::iterator parent) -> ExprTree::iterator;
-  auto term(ExprTree::iterator parent) -> ExprTree::iterator;
-  auto factor(ExprTree::iterator parent) -> ExprTree::iterator;
-  auto unary(ExprTree::iterator parent) -> ExprTree::iterator;
-  auto primary(ExprTree::iterator parent) -> ExprTree::iterator;
-
-  std::shared_ptr<TokenList> tokens_;
-  TokenList::Iterator current_;
+  friend class detail::Grammar<Parser>;
+  using Node = ExprTree::iterator;
+
+  // `depth` counts the parentheses and unary operators around `parent`.
+  auto expression(ExprTree::iterator parent, std::size_t depth = 0)
+      -> ExprTree::iterator;
+
+  // The builder interface of detail::Grammar.
+  [[nodiscard]] auto peek() const -> TokenKind { return current_->kind; }
+  void advance() { ++current_; }
+  void make_parent(ExprTree::iterator node, ExprTree::iterator child) {
+    tree_.make_parent(node, child);
+  }
+  [[nodiscard]] auto literal() const -> Literal { return current_->literal; }
+  [[nodiscard]] auto identifier() const -> Identifier {
+    return current_->identifier;
+  }
+
+  // Appends a node for the current token under parent.
+  auto push(ExprTree::iterator parent, const ExprData& data)
+      -> ExprTree::iterator;
+  auto token_index() const -> std::size_t {
+    return static_cast<std::size_t>(current_ - tokens_->begin());
+  }
+  // A Paren node and the token indices of its '(' and ')'.
+  struct ParenSpan {
+    ExprTree::iterator node;
+    std::size_t open;
+    std::size_t close;
+  };
+
+  // The innermost Paren whose inside contains the whole edit, in the
+  // previous token list.
+  auto enclosing_paren(const TokenList& tokens, TokenEdit edit)
+      -> std::optional<ParenSpan>;
+  void detach(ExprTree::iterator node);
+  void parse_again();
+  // Resolves the finished tree and, if enabled, infers its types.
+  void analyse();
+
+  std::shared_ptr<const TokenList> tokens_;
+  TokenList::ConstIterator current_;
   ExprTree tree_;
+  // Token each node was built from, by node id: the operator of a Binary or
+  // Unary, the '(' of a Paren, the token of a leaf. Detached nodes hold
+  // Dead_Anchor.
+  std::vector<std::size_t> anchors_;
+  std::size_t dead_ = 0;
+  SlotLayout slots_;
+  NodeTypes types_;
+  bool type_check_ = false;
+  BuildMode mode_;
+  std::size_t max_depth_ = Default_Max_Depth;
 };
 
 }  // namespace loxt
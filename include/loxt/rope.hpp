@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace loxt {
+
+// Bump allocator for strings built during one evaluation. Memory is only
+// given back all at once by reset(), which keeps the first block for the
+// next evaluation.
+class StringArena {
+ public:
+  static constexpr std::size_t Default_Block_Size = 4096;
+
+  explicit StringArena(std::size_t block_size = Default_Block_Size)
+      : block_size_{block_size} {}
+
+  auto allocate(std::size_t size, std::size_t align) -> void*;
+  // Copy of `text` that lives until the next reset().
+  auto copy(std::string_view text) -> std::string_view;
+
+  void reset();
+
+  [[nodiscard]] auto bytes_used() const -> std::size_t { return used_; }
+
+ private:
+  struct Block {
+    std::unique_ptr<std::byte[]> data;
+    std::size_t size;
+  };
+
+  std::size_t block_size_;
+  std::vector<Block> blocks_;
+  std::size_t offset_ = 0;
+  std::size_t used_ = 0;
+};
+
+// Immutable string built by concatenation. Strings of up to Inline_Capacity
+// bytes are stored in the handle itself; longer ones are nodes in a
+// StringArena, either a leaf viewing text or the concatenation of two
+// nodes. Concatenating is constant time and copies nothing, and the bytes
+// are only laid out once, by flatten(). A rope must not outlive its arena
+// or the text it views.
+class Rope {
+ public:
+  static constexpr std::size_t Inline_Capacity = 15;
+
+  Rope() = default;
+
+  // Shares `text`, which must outlive the rope, unless it fits inline.
+  static auto view(std::string_view text, StringArena& arena) -> Rope;
+  // Copies `text` into the arena unless it fits inline.
+  static auto copy(std::string_view text, StringArena& arena) -> Rope;
+  static auto concat(const Rope& lhs, const Rope& rhs, StringArena& arena)
+      -> Rope;
+
+  [[nodiscard]] auto size() const -> std::size_t {
+    return node_ != nullptr ? node_->size : inline_size_;
+  }
+  [[nodiscard]] auto is_inline() const -> bool { return node_ == nullptr; }
+
+  // The whole string, copied out with a single allocation.
+  [[nodiscard]] auto flatten() const -> std::string;
+
+ private:
+  // A leaf when `text` is set, otherwise left followed by right.
+  struct Node {
+    std::size_t size;
+    const char* text;
+    const Node* left;
+    const Node* right;
+  };
+
+  // The rope as a node, moving inline bytes into the arena if needed.
+  [[nodiscard]] auto as_node(StringArena& arena) const -> const Node*;
+
+  const Node* node_ = nullptr;
+  std::array<char, Inline_Capacity> inline_{};
+  std::uint8_t inline_size_ = 0;
+};
+
+}  // namespace loxt
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string_view>
+
+#include "lexer.hpp"
+#include "unicode.hpp"
+
+namespace loxt {
+
+enum class ScanError : std::uint8_t {
+  None,
+  Unterminated_String,
+  Number_Too_Large,
+  Unrecognized_Character,
+};
+
+constexpr auto scan_error_message(ScanError error) -> const char* {
+  switch (error) {
+    case ScanError::None:
+      break;
+    case ScanError::Unterminated_String:
+      return "String is unterminated";
+    case ScanError::Number_Too_Large:
+      return "Number literal is too large";
+    case ScanError::Unrecognized_Character:
+      return "Unrecognized character";
+  }
+  return "";
+}
+
+// The token scan_token() found at the start of its input.
+struct ScannedToken {
+  // Empty for whitespace and comments; Error for malformed input.
+  std::optional<TokenKind> kind;
+  // Bytes consumed, never 0.
+  std::size_t length = 1;
+  ScanError error = ScanError::None;
+  // Value of a Number.
+  std::uint64_t number = 0;
+};
+
+struct KeywordSpelling {
+  std::string_view spelling;
+  TokenKind kind;
+};
+
+inline constexpr KeywordSpelling Keyword_Spellings[] = {
+#define LOXT_KEYWORD_TOKEN(name, spelling) {spelling, TokenKind::name()},
+#include "token_kinds.def"
+};
+
+constexpr auto keyword_kind(std::string_view spelling)
+    -> std::optional<TokenKind> {
+  // Length and first byte reject most candidates without a compare.
+  for (const auto& keyword : Keyword_Spellings) {
+    if (keyword.spelling.size() == spelling.size() &&
+        keyword.spelling[0] == spelling[0] && keyword.spelling == spelling) {
+      return keyword.kind;
+    }
+  }
+  return std::nullopt;
+}
+
+// Scans the token at the start of `text`, which must be non-empty, well
+// formed UTF-8. This is the whole lexical grammar, shared by lex() and
+// static_expr(), which differ only in where the tokens go and in
+// `ident_char(rest, start)`: the byte length of the non-ASCII identifier
+// character, or identifier start character, at the front of `rest`, or 0.
+template <class IdentChar>
+constexpr auto scan_token(std::string_view text, IdentChar ident_char)
+    -> ScannedToken {
+  auto one_or_two = [&](char second, TokenKind two, TokenKind one) {
+    if (text.size() > 1 && text[1] == second) {
+      return ScannedToken{two, 2};
+    }
+    return ScannedToken{one, 1};
+  };
+
+  char chr = text[0];
+  switch (chr) {
+    case '(':
+      return {TokenKind::LeftParen()};
+    case ')':
+      return {TokenKind::RightParen()};
+    case '{':
+      return {TokenKind::LeftBrace()};
+    case '}':
+      return {TokenKind::RightBrace()};
+    case ',':
+      return {TokenKind::Comma()};
+    case '.':
+      return {TokenKind::Period()};
+    case '-':
+      return {TokenKind::Minus()};
+    case '+':
+      return {TokenKind::Plus()};
+    case ';':
+      return {TokenKind::SemiColon()};
+    case '*':
+      return {TokenKind::Asterisk()};
+    case '!':
+      return one_or_two('=', TokenKind::BangEqual(), TokenKind::Bang());
+    case '=':
+      return one_or_two('=', TokenKind::EqualEqual(), TokenKind::Equal());
+    case '<':
+      return one_or_two('=', TokenKind::LessEqual(), TokenKind::Less());
+    case '>':
+      return one_or_two('=', TokenKind::GreaterEqual(), TokenKind::Greater());
+    case '/':
+      if (text.size() > 1 && text[1] == '/') {
+        return {std::nullopt, std::min(text.find('\n'), text.size())};
+      }
+      return {TokenKind::BackSlash()};
+    case '"': {
+      auto close = text.find('"', 1);
+      if (close == std::string_view::npos) {
+        return {TokenKind::Error(), text.size(),
+                ScanError::Unterminated_String};
+      }
+      return {TokenKind::String(), close + 1};
+    }
+    default:
+      break;
+  }
+
+  if (is_char_class(chr, Char_Digit)) {
+    constexpr auto Max = std::numeric_limits<std::uint64_t>::max();
+    ScannedToken token{TokenKind::Number(), 0};
+    for (; token.length < text.size() &&
+           is_char_class(text[token.length], Char_Digit);
+         ++token.length) {
+      auto digit = static_cast<std::uint64_t>(text[token.length] - '0');
+      if (token.number > (Max - digit) / 10) {
+        token.kind = TokenKind::Error();
+        token.error = ScanError::Number_Too_Large;
+      }
+      token.number = token.number * 10 + digit;
+    }
+    return token;
+  }
+
+  auto identifier = [&](std::size_t pos, bool start) -> std::size_t {
+    if (!is_ascii(text[pos])) {
+      return ident_char(text.substr(pos), start);
+    }
+    return is_char_class(text[pos], start ? Char_Ident_Start
+                                          : Char_Ident_Continue)
+               ? 1
+               : 0;
+  };
+  if (auto length = identifier(0, true); length != 0) {
+    while (length < text.size()) {
+      auto next = identifier(length, false);
+      if (next == 0) {
+        break;
+      }
+      length += next;
+    }
+    return {keyword_kind(text.substr(0, length))
+                .value_or(TokenKind::Identifier()),
+            length};
+  }
+
+  if (is_char_class(chr, Char_Space)) {
+    return {std::nullopt};
+  }
+  // A multi-byte character is one error, not one per byte.
+  std::size_t length =
+      is_ascii(chr) ? 1 : std::countl_one(static_cast<unsigned char>(chr));
+  return {TokenKind::Error(), length, ScanError::Unrecognized_Character};
+}
+
+}  // namespace loxt
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+namespace loxt {
+
+// Requests and responses on the wire are a 4 byte little endian payload
+// length, one byte of kind or status, then the payload. A request's payload
+// is source text; a response's is the result or the error message.
+enum class RequestKind : std::uint8_t { Lex, Parse, Evaluate };
+
+constexpr std::size_t Max_Request_Size = std::size_t{16} << 20;
+
+struct Response {
+  bool ok = false;
+  std::string body;
+};
+
+// Long running loxt process answering requests over a Unix domain socket.
+// Each worker thread keeps one Session, whose token blocks, interner and
+// literal pools are cleared but not freed between requests, and evaluation
+// shares EvalCache::shared(), so requests after the first run warm.
+// run() polls the open connections itself and hands each request to the
+// pool, so a worker is held only while it reads, answers and writes one
+// request and idle connections cost no worker.
+class Server {
+ public:
+  explicit Server(std::size_t threads = std::thread::hardware_concurrency());
+  // Parses with a depth limit other than Default_Max_Depth, see
+  // Parser::set_max_depth().
+  Server(std::size_t threads, std::size_t max_depth)
+      : pool_{threads}, max_depth_{max_depth} {}
+  Server(const Server&) = delete;
+  auto operator=(const Server&) -> Server& = delete;
+  ~Server();
+
+  // Binds `path`, replacing any stale socket there. Throws std::system_error
+  // if the socket cannot be set up.
+  void listen(const std::string& path);
+
+  // Accepts connections until stop() and returns once the requests in
+  // flight are answered. Connections still open then are closed.
+  void run();
+
+  // Safe to call from any thread, including before run().
+  void stop();
+
+  // Answers one request. Lex lists the tokens, Parse dumps the tree as text
+  // and Evaluate prints the value of each ';'-separated expression, one per
+  // line. Lexer diagnostics and parse or evaluation errors fail the request;
+  // handle() itself never throws, so one bad request cannot stop the server.
+  auto handle(RequestKind kind, std::string source) -> Response;
+
+  [[nodiscard]] auto requests() const -> std::size_t { return requests_; }
+
+ private:
+  void serve_request(int client);
+  void wake();
+  auto respond(RequestKind kind, std::string source) -> Response;
+
+  ThreadPool pool_;
+  std::size_t max_depth_;
+  std::string path_;
+  std::atomic<int> listener_{-1};
+  // Self-pipe that wakes run()'s poll() on stop() and when a connection is
+  // handed back after its request.
+  int wake_read_ = -1;
+  int wake_write_ = -1;
+  std::mutex mutex_;
+  std::vector<int> returned_;
+  std::atomic<bool> stopping_{false};
+  std::atomic<std::size_t> requests_{0};
+};
+
+// Blocking connection to a Server, for tools and tests. Not thread safe;
+// use one client per thread.
+class Client {
+ public:
+  explicit Client(const std::string& path);
+  Client(const Client&) = delete;
+  auto operator=(const Client&) -> Client& = delete;
+  ~Client();
+
+  // Throws std::system_error if the connection fails.
+  auto send(RequestKind kind, std::string_view source) -> Response;
+
+ private:
+  int socket_ = -1;
+};
+
+}  // namespace loxt
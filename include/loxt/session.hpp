@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <string>
+
+#include "lexer.hpp"
+
+namespace loxt {
+
+// Interactive lexing session. Every line is lexed onto one shared
+// TokenList, so the identifier interner, literal pools and token blocks are
+// reused between lines instead of being rebuilt for each one.
+class Session {
+ public:
+  Session();
+
+  // Lexes line onto the session's tokens and returns the range it added,
+  // which ends with an Eof token. The session keeps the line alive.
+  auto lex(std::string line) -> TokenRange;
+
+  [[nodiscard]] auto tokens() -> TokenList& { return *m_Tokens; }
+  [[nodiscard]] auto shared_tokens() const -> std::shared_ptr<TokenList> {
+    return m_Tokens;
+  }
+
+  // Forgets every line, keeping the token list's first block.
+  void clear();
+
+ private:
+  std::deque<std::string> m_Lines;
+  std::shared_ptr<TokenList> m_Tokens;
+};
+
+}  // namespace loxt
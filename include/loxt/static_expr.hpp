@@ -0,0 +1,345 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "ast/expr.hpp"
+#include "eval.hpp"
+#include "grammar.hpp"
+#include "lexer.hpp"
+#include "scanner.hpp"
+
+namespace loxt {
+
+// A string literal usable as a template argument.
+template <std::size_t Length>
+struct FixedString {
+  char chars[Length]{};
+
+  // Implicit, so that static_expr<"1 + 2">() works.
+  consteval FixedString(const char (&str)[Length]) {  // NOLINT
+    std::copy_n(str, Length, chars);
+  }
+
+  [[nodiscard]] constexpr auto view() const -> std::string_view {
+    return {chars, Length - 1};
+  }
+};
+
+// Table sizes of a StaticExpr, known once its source has been parsed.
+struct StaticExprShape {
+  std::size_t nodes;
+  std::size_t numbers;
+  std::size_t strings;
+  std::size_t names;
+  std::size_t text;
+};
+
+// A range of a StaticExpr's copy of its source.
+struct TextSpan {
+  std::size_t offset;
+  std::size_t length;
+};
+
+// Nodes are stored in pre-order, as in a frozen_tree: the first child
+// follows its parent and a subtree is the range [id, id + subtree_size).
+struct StaticNode {
+  ExprData data{ExprKind::Nil};
+  std::size_t subtree_size = 1;
+};
+
+namespace detail {
+
+struct StaticToken {
+  TokenKind kind;
+  std::size_t offset;
+  std::size_t length;
+  std::uint64_t number;
+};
+
+// lex() restricted to ASCII, stopping at the first error.
+constexpr auto static_lex(std::string_view source)
+    -> std::vector<StaticToken> {
+  auto ascii_only = [](std::string_view /*rest*/,
+                       bool /*start*/) -> std::size_t {
+    throw "Static expressions must be ASCII";
+  };
+  std::vector<StaticToken> tokens;
+  std::size_t pos = 0;
+  while (pos < source.size()) {
+    auto token = scan_token(source.substr(pos), ascii_only);
+    if (token.error != ScanError::None) {
+      throw scan_error_message(token.error);
+    }
+    if (token.kind) {
+      tokens.push_back({*token.kind, pos, token.length, token.number});
+    }
+    pos += token.length;
+  }
+  tokens.push_back({TokenKind::Eof(), pos, 0, 0});
+  return tokens;
+}
+
+// Runs the grammar of Parser, building linked nodes that flatten() then
+// lays out in pre-order. Parse errors are the parser's; a constant
+// evaluation that throws one fails to compile.
+class StaticParser {
+ public:
+  constexpr explicit StaticParser(std::string_view source)
+      : source_{source}, tokens_{static_lex(source)} {
+    nodes_.push_back({ExprData{ExprKind::Root}});
+    Grammar<StaticParser>{*this, std::numeric_limits<std::size_t>::max()}
+        .expression(0);
+    if (peek() != TokenKind::Eof()) {
+      throw "Unexpected token after expression";
+    }
+  }
+
+  [[nodiscard]] constexpr auto shape() const -> StaticExprShape {
+    return {nodes_.size(), numbers_.size(), strings_.size(), names_.size(),
+            source_.size()};
+  }
+
+  [[nodiscard]] constexpr auto flatten() const -> std::vector<StaticNode> {
+    std::vector<StaticNode> out;
+    out.reserve(nodes_.size());
+    // Pairs of a node and where its StaticNode is, once it has been laid
+    // out and is waiting for its subtree size.
+    std::vector<std::pair<std::size_t, std::size_t>> stack{{0, No_Node}};
+    while (!stack.empty()) {
+      auto [node, self] = stack.back();
+      stack.pop_back();
+      if (self != No_Node) {
+        out[self].subtree_size = out.size() - self;
+        continue;
+      }
+      auto data = nodes_[node].data;
+      if (data.kind == ExprKind::Variable) {
+        // Identifiers double as slots, numbered in order of first use.
+        data.slot = static_cast<Slot>(data.identifier);
+      }
+      stack.emplace_back(node, out.size());
+      out.push_back({data, 1});
+      const auto& children = nodes_[node].children;
+      for (auto child = nodes_[node].child_count; child-- > 0;) {
+        stack.emplace_back(children[child], No_Node);
+      }
+    }
+    return out;
+  }
+
+  [[nodiscard]] constexpr auto numbers() const
+      -> const std::vector<std::uint64_t>& {
+    return numbers_;
+  }
+  [[nodiscard]] constexpr auto strings() const
+      -> const std::vector<TextSpan>& {
+    return strings_;
+  }
+  [[nodiscard]] constexpr auto names() const -> const std::vector<TextSpan>& {
+    return names_;
+  }
+
+ private:
+  friend class Grammar<StaticParser>;
+  using Node = std::size_t;
+
+  static constexpr std::size_t No_Node = ~std::size_t{0};
+
+  // A node ends up with at most two children, but briefly holds a third
+  // when an operator is pushed next to the left operand it then adopts.
+  struct LinkedNode {
+    ExprData data;
+    std::size_t parent = No_Node;
+    std::array<std::size_t, 3> children{};
+    std::size_t child_count = 0;
+  };
+
+  // The builder interface of Grammar.
+  [[nodiscard]] constexpr auto peek() const -> TokenKind {
+    return tokens_[current_].kind;
+  }
+
+  constexpr void advance() { ++current_; }
+
+  constexpr auto push(Node parent, const ExprData& data) -> Node {
+    nodes_.push_back({data});
+    link(parent, nodes_.size() - 1);
+    return nodes_.size() - 1;
+  }
+
+  constexpr void make_parent(Node node, Node child) {
+    auto& old = nodes_[nodes_[child].parent];
+    auto* end = old.children.begin() + old.child_count;
+    std::remove(old.children.begin(), end, child);
+    --old.child_count;
+    link(node, child);
+  }
+
+  constexpr auto literal() -> Literal {
+    const auto& token = tokens_[current_];
+    if (token.kind == TokenKind::Number()) {
+      numbers_.push_back(token.number);
+      return static_cast<Literal>(numbers_.size() - 1);
+    }
+    strings_.push_back({token.offset + 1, token.length - 2});
+    return static_cast<Literal>(strings_.size() - 1);
+  }
+
+  constexpr auto identifier() -> Identifier {
+    const auto& token = tokens_[current_];
+    auto spelling = source_.substr(token.offset, token.length);
+    for (std::size_t idx = 0; idx < names_.size(); ++idx) {
+      if (source_.substr(names_[idx].offset, names_[idx].length) ==
+          spelling) {
+        return static_cast<Identifier>(idx);
+      }
+    }
+    names_.push_back({token.offset, token.length});
+    return static_cast<Identifier>(names_.size() - 1);
+  }
+
+  constexpr void link(Node parent, Node child) {
+    auto& node = nodes_[parent];
+    node.children[node.child_count++] = child;
+    nodes_[child].parent = parent;
+  }
+
+  std::string_view source_;
+  std::vector<StaticToken> tokens_;
+  std::size_t current_ = 0;
+  std::vector<LinkedNode> nodes_;
+  std::vector<std::uint64_t> numbers_;
+  std::vector<TextSpan> strings_;
+  std::vector<TextSpan> names_;
+};
+
+}  // namespace detail
+
+// An expression lexed, parsed and resolved during compilation into
+// fixed-size tables, for scripts embedded in C++ source. Use static_expr()
+// to build one. Variables are numbered into slots in order of first use,
+// like resolve() does; find_slot() gives the index to fill in the values
+// passed to evaluate().
+template <StaticExprShape Shape>
+class StaticExpr {
+ public:
+  consteval explicit StaticExpr(std::string_view source) {
+    detail::StaticParser parser{source};
+    auto nodes = parser.flatten();
+    std::copy(nodes.begin(), nodes.end(), nodes_.begin());
+    std::copy(parser.numbers().begin(), parser.numbers().end(),
+              numbers_.begin());
+    std::copy(parser.strings().begin(), parser.strings().end(),
+              strings_.begin());
+    std::copy(parser.names().begin(), parser.names().end(), names_.begin());
+    std::copy(source.begin(), source.end(), text_.begin());
+  }
+
+  [[nodiscard]] constexpr auto nodes() const -> std::span<const StaticNode> {
+    return nodes_;
+  }
+
+  [[nodiscard]] constexpr auto number_literal(Literal literal) const
+      -> std::uint64_t {
+    return numbers_[literal];
+  }
+
+  [[nodiscard]] constexpr auto string_literal(Literal literal) const
+      -> std::string_view {
+    return text(strings_[literal]);
+  }
+
+  [[nodiscard]] constexpr auto slot_count() const -> std::size_t {
+    return Shape.names;
+  }
+
+  [[nodiscard]] constexpr auto name(Slot slot) const -> std::string_view {
+    return text(names_[slot]);
+  }
+
+  [[nodiscard]] constexpr auto find_slot(std::string_view name) const
+      -> std::optional<Slot> {
+    for (std::size_t slot = 0; slot < Shape.names; ++slot) {
+      if (text(names_[slot]) == name) {
+        return static_cast<Slot>(slot);
+      }
+    }
+    return std::nullopt;
+  }
+
+  // `slots` holds a value for every slot, with the semantics of Evaluator.
+  auto evaluate(std::span<const Value> slots) const -> Value {
+    return evaluate(0, slots);
+  }
+
+ private:
+  [[nodiscard]] constexpr auto text(TextSpan span) const -> std::string_view {
+    return {text_.data() + span.offset, span.length};
+  }
+
+  auto evaluate(std::size_t node, std::span<const Value> slots) const
+      -> Value {
+    const auto& data = nodes_[node].data;
+    switch (data.kind) {
+      case ExprKind::Root:
+      case ExprKind::Paren:
+        return evaluate(node + 1, slots);
+      case ExprKind::Binary: {
+        auto lhs = evaluate(node + 1, slots);
+        auto rhs = node + 1 + nodes_[node + 1].subtree_size;
+        if (data.bOp == BinaryOpKind::And) {
+          return lhs.truthy() ? evaluate(rhs, slots) : lhs;
+        }
+        if (data.bOp == BinaryOpKind::Or) {
+          return lhs.truthy() ? lhs : evaluate(rhs, slots);
+        }
+        return apply(data.bOp, lhs, evaluate(rhs, slots));
+      }
+      case ExprKind::Unary:
+        return apply(data.uOp, evaluate(node + 1, slots));
+      case ExprKind::Nil:
+        return Value{};
+      case ExprKind::Variable:
+        if (data.slot >= slots.size()) {
+          throw "Undefined variable";
+        }
+        return slots[data.slot];
+      case ExprKind::Literal:
+        switch (data.literalKind) {
+          case LiteralKind::Number:
+            return Value{static_cast<double>(numbers_[data.literalVal])};
+          case LiteralKind::String:
+            return Value{std::string{string_literal(data.literalVal)}};
+          case LiteralKind::Bool:
+            return Value{data.boolVal};
+        }
+    }
+    throw "Unknown expression kind";
+  }
+
+  std::array<StaticNode, Shape.nodes> nodes_{};
+  std::array<std::uint64_t, Shape.numbers> numbers_{};
+  std::array<TextSpan, Shape.strings> strings_{};
+  std::array<TextSpan, Shape.names> names_{};
+  std::array<char, Shape.text> text_{};
+};
+
+// Parses Source at compile time. A syntax error in Source is a compile
+// error, reported at the throw that rejected it.
+template <FixedString Source>
+consteval auto static_expr() {
+  constexpr auto Shape = detail::StaticParser{Source.view()}.shape();
+  return StaticExpr<Shape>{Source.view()};
+}
+
+}  // namespace loxt
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace loxt {
+
+// Fixed size pool of workers, each owning a task deque. Workers pop their own
+// work LIFO and steal FIFO from the other workers when they run dry. Tasks
+// submitted from a worker go to that worker's deque.
+class ThreadPool {
+ public:
+  explicit ThreadPool(
+      std::size_t threads = std::thread::hardware_concurrency());
+  ThreadPool(const ThreadPool&) = delete;
+  auto operator=(const ThreadPool&) -> ThreadPool& = delete;
+  ~ThreadPool();
+
+  void submit(std::function<void()> task);
+
+  // Blocks until every submitted task has finished. If any task threw, the
+  // first exception is rethrown here once, after the rest have finished.
+  void wait();
+
+  [[nodiscard]] auto size() const -> std::size_t { return workers_.size(); }
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  void run(std::size_t self);
+  auto pop(std::size_t self, std::function<void()>& task) -> bool;
+  auto steal(std::size_t self, std::function<void()>& task) -> bool;
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> workers_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  std::atomic<std::size_t> queued_{0};
+  std::size_t pending_ = 0;
+  std::exception_ptr error_;
+  std::atomic<std::size_t> next_queue_{0};
+  bool stop_ = false;
+};
+
+// Runs fn(i) for every i in [0, count) on the pool and waits for completion.
+template <class Fn>
+void parallel_for(ThreadPool& pool, std::size_t count, Fn&& fn) {
+  for (std::size_t idx = 0; idx < count; ++idx) {
+    pool.submit([&fn, idx] { fn(idx); });
+  }
+  pool.wait();
+}
+
+}  // namespace loxt
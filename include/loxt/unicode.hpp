@@ -0,0 +1,63 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace loxt {
+
+// Byte classes for the lexer's ASCII fast path. Unlike <cctype> these are a
+// single table load and do not depend on the locale.
+enum CharClass : std::uint8_t {
+  Char_Digit = 1U << 0U,
+  Char_Ident_Start = 1U << 1U,
+  Char_Ident_Continue = 1U << 2U,
+  Char_Space = 1U << 3U,
+};
+
+inline constexpr auto Ascii_Classes = [] {
+  std::array<std::uint8_t, 256> table{};
+  for (int chr = '0'; chr <= '9'; ++chr) {
+    table[chr] = Char_Digit | Char_Ident_Continue;
+  }
+  for (int chr = 'a'; chr <= 'z'; ++chr) {
+    table[chr] = Char_Ident_Start | Char_Ident_Continue;
+    table[chr - 'a' + 'A'] = Char_Ident_Start | Char_Ident_Continue;
+  }
+  table['_'] = Char_Ident_Start | Char_Ident_Continue;
+  for (char chr : {' ', '\t', '\n', '\v', '\f', '\r'}) {
+    table[static_cast<unsigned char>(chr)] = Char_Space;
+  }
+  return table;
+}();
+
+constexpr auto is_char_class(char chr, CharClass cls) -> bool {
+  return (Ascii_Classes[static_cast<unsigned char>(chr)] & cls) != 0;
+}
+
+constexpr auto is_ascii(char chr) -> bool {
+  return static_cast<unsigned char>(chr) < 0x80;
+}
+
+struct DecodedChar {
+  char32_t code_point;
+  // Bytes consumed, or 0 if the sequence is malformed.
+  std::size_t length;
+};
+
+// Decodes the code point at the start of `text`, rejecting truncated and
+// overlong sequences, surrogates and values past U+10FFFF.
+auto decode_utf8(std::string_view text) -> DecodedChar;
+
+// Returns the offset of the first byte that is not part of a well formed
+// UTF-8 sequence, or npos if `text` is valid. Runs of ASCII are skipped a
+// vector at a time.
+auto validate_utf8(std::string_view text) -> std::size_t;
+
+// Unicode identifier properties (UAX #31), with '_' treated as a start
+// character as in most languages.
+auto is_xid_start(char32_t code_point) -> bool;
+auto is_xid_continue(char32_t code_point) -> bool;
+
+}  // namespace loxt
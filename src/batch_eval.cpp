@@ -0,0 +1,502 @@
+#include <algorithm>
+#include <loxt/batch_eval.hpp>
+
+namespace loxt {
+
+namespace {
+
+// Calls fn(row) for every row of the selection. The dense case is a plain
+// counted loop the compiler can vectorise.
+template <class Selection, class Fn>
+void for_each_row(const Selection& sel, Fn&& fn) {
+  if (sel.dense) {
+    for (std::size_t row = 0; row < sel.count; ++row) {
+      fn(row);
+    }
+  } else {
+    for (std::size_t idx = 0; idx < sel.count; ++idx) {
+      fn(static_cast<std::size_t>(sel.rows[idx]));
+    }
+  }
+}
+
+}  // namespace
+
+BatchEvaluator::BatchEvaluator(const ExprTree& tree, const TokenList& tokens)
+    : tree_{tree}, tokens_{tokens} {}
+
+void BatchEvaluator::bind(std::string_view name, Column column) {
+  if (auto ident = tokens_.find_identifier(name)) {
+    columns_.insert_or_assign(*ident, column);
+    compiled_ = false;
+  }
+}
+
+auto BatchEvaluator::filter(std::size_t rows) -> std::vector<std::size_t> {
+  compile();
+  std::vector<std::size_t> selected;
+  for (std::size_t offset = 0; offset < rows; offset += Batch_Size) {
+    std::size_t count = std::min(Batch_Size, rows - offset);
+    run(offset, count);
+    const Op& root = ops_[root_];
+    for (std::size_t row = 0; row < count; ++row) {
+      if (truthy(root, row)) {
+        selected.push_back(offset + row);
+      }
+    }
+  }
+  return selected;
+}
+
+auto BatchEvaluator::evaluate(std::size_t rows) -> std::vector<Value> {
+  compile();
+  std::vector<Value> values;
+  values.reserve(rows);
+  for (std::size_t offset = 0; offset < rows; offset += Batch_Size) {
+    std::size_t count = std::min(Batch_Size, rows - offset);
+    run(offset, count);
+    const Op& root = ops_[root_];
+    for (std::size_t row = 0; row < count; ++row) {
+      values.push_back(value(root, row));
+    }
+  }
+  return values;
+}
+
+void BatchEvaluator::compile() {
+  if (compiled_) {
+    return;
+  }
+  ops_.clear();
+  root_ = compile(tree_.begin());
+  compiled_ = true;
+}
+
+auto BatchEvaluator::compile(ExprTree::const_iterator node) -> std::size_t {
+  const auto& data = *node;
+  Op op{.kind = data.kind};
+  switch (data.kind) {
+    case ExprKind::Root:
+    case ExprKind::Paren:
+      return compile(node.child(0));
+    case ExprKind::Binary:
+      op.op = static_cast<std::uint8_t>(data.bOp);
+      return compile_binary(std::move(op), node);
+    case ExprKind::Nil:
+      break;
+    case ExprKind::Literal:
+      // Literals are broadcast once, so kernels never special-case them.
+      switch (data.literalKind) {
+        case LiteralKind::Number:
+          op.type = Type::Number;
+          allocate(op);
+          std::ranges::fill(op.number_store,
+                            static_cast<double>(
+                                tokens_.number_literal(data.literalVal)));
+          break;
+        case LiteralKind::String:
+          op.type = Type::String;
+          allocate(op);
+          std::ranges::fill(op.string_store,
+                            tokens_.string_literal(data.literalVal));
+          break;
+        case LiteralKind::Bool:
+          op.type = Type::Bool;
+          allocate(op);
+          std::fill_n(op.flag_store.get(), Batch_Size, data.boolVal);
+          break;
+      }
+      break;
+    case ExprKind::Variable: {
+      auto column = columns_.find(data.identifier);
+      if (column == columns_.end()) {
+        op.error = "Undefined variable";
+        op.type = Type::Any;
+        break;
+      }
+      constexpr Type Column_Types[] = {Type::Number, Type::Bool, Type::String};
+      op.column = data.identifier;
+      op.type = Column_Types[column->second.index()];
+      break;
+    }
+    case ExprKind::Unary: {
+      op.op = static_cast<std::uint8_t>(data.uOp);
+      op.lhs = compile(node.child(0));
+      if (data.uOp == UnaryOpKind::Neg) {
+        auto operand = ops_[op.lhs].type;
+        if (operand != Type::Number && operand != Type::Any) {
+          op.error = "Operand must be a number";
+        }
+        op.type = Type::Number;
+      } else {
+        op.type = Type::Bool;
+      }
+      allocate(op);
+      break;
+    }
+  }
+  ops_.push_back(std::move(op));
+  return ops_.size() - 1;
+}
+
+auto BatchEvaluator::compile_binary(Op op, ExprTree::const_iterator node)
+    -> std::size_t {
+  op.lhs = compile(node.child(0));
+  op.rhs = compile(node.child(1));
+  Type lhs = ops_[op.lhs].type;
+  Type rhs = ops_[op.rhs].type;
+  // Any operands are checked per row instead.
+  auto numbers = [&] {
+    return (lhs == Type::Number || lhs == Type::Any) &&
+           (rhs == Type::Number || rhs == Type::Any);
+  };
+  switch (static_cast<BinaryOpKind>(op.op)) {
+    case BinaryOpKind::And:
+    case BinaryOpKind::Or:
+      op.type = lhs == rhs ? lhs : Type::Any;
+      op.selection.resize(Batch_Size);
+      break;
+    case BinaryOpKind::Eq:
+    case BinaryOpKind::Neq:
+      op.type = Type::Bool;
+      break;
+    case BinaryOpKind::Add:
+      if (lhs == Type::Any || rhs == Type::Any) {
+        op.type = Type::Any;
+      } else if (lhs == rhs && (lhs == Type::Number || lhs == Type::String)) {
+        op.type = lhs;
+      } else {
+        op.type = Type::Any;
+        op.error = "Operands must be two numbers or two strings";
+      }
+      break;
+    case BinaryOpKind::Gt:
+    case BinaryOpKind::Ge:
+    case BinaryOpKind::Lt:
+    case BinaryOpKind::Le:
+      op.type = Type::Bool;
+      if (!numbers()) {
+        op.error = "Operands must be numbers";
+      }
+      break;
+    case BinaryOpKind::Minus:
+    case BinaryOpKind::Div:
+    case BinaryOpKind::Mul:
+      op.type = Type::Number;
+      if (!numbers()) {
+        op.error = "Operands must be numbers";
+      }
+      break;
+  }
+  allocate(op);
+  ops_.push_back(std::move(op));
+  return ops_.size() - 1;
+}
+
+void BatchEvaluator::allocate(Op& op) {
+  switch (op.type) {
+    case Type::Nil:
+      break;
+    case Type::Bool:
+      op.flag_store = std::make_unique<bool[]>(Batch_Size);
+      op.flags = op.flag_store.get();
+      break;
+    case Type::Number:
+      op.number_store.resize(Batch_Size);
+      op.numbers = op.number_store.data();
+      break;
+    case Type::String:
+      op.string_store.resize(Batch_Size);
+      op.strings = op.string_store.data();
+      break;
+    case Type::Any:
+      op.value_store.resize(Batch_Size);
+      op.values = op.value_store.data();
+      break;
+  }
+}
+
+void BatchEvaluator::run(std::size_t offset, std::size_t count) {
+  for (auto& op : ops_) {
+    if (op.kind != ExprKind::Variable || op.error != nullptr) {
+      continue;
+    }
+    std::visit(
+        [&](auto column) {
+          if (column.size() < offset + count) {
+            throw "Column is shorter than the row count";
+          }
+          using Element = typename decltype(column)::value_type;
+          if constexpr (std::is_same_v<Element, double>) {
+            op.numbers = column.data() + offset;
+          } else if constexpr (std::is_same_v<Element, bool>) {
+            op.flags = column.data() + offset;
+          } else {
+            op.strings = column.data() + offset;
+          }
+        },
+        columns_.at(op.column));
+  }
+  eval(root_, Selection{nullptr, count, true});
+}
+
+void BatchEvaluator::eval(std::size_t index, const Selection& sel) {
+  Op& op = ops_[index];
+  if (op.error != nullptr) {
+    if (op.kind == ExprKind::Binary || op.kind == ExprKind::Unary) {
+      eval(op.lhs, sel);
+    }
+    if (op.kind == ExprKind::Binary) {
+      eval(op.rhs, sel);
+    }
+    if (sel.count > 0) {
+      throw op.error;
+    }
+    return;
+  }
+  switch (op.kind) {
+    case ExprKind::Binary:
+      switch (static_cast<BinaryOpKind>(op.op)) {
+        case BinaryOpKind::And:
+        case BinaryOpKind::Or:
+          eval_logical(op, sel);
+          break;
+        case BinaryOpKind::Eq:
+        case BinaryOpKind::Neq:
+          eval_equality(op, sel);
+          break;
+        default:
+          eval_numeric(op, sel);
+          break;
+      }
+      break;
+    case ExprKind::Unary: {
+      eval(op.lhs, sel);
+      const Op& operand = ops_[op.lhs];
+      if (static_cast<UnaryOpKind>(op.op) == UnaryOpKind::Neg &&
+          operand.type == Type::Any) {
+        for_each_row(sel, [&](std::size_t row) {
+          store(op, row, apply(UnaryOpKind::Neg, value(operand, row)));
+        });
+      } else if (static_cast<UnaryOpKind>(op.op) == UnaryOpKind::Neg) {
+        double* out = op.number_store.data();
+        const double* in = operand.numbers;
+        for_each_row(sel, [&](std::size_t row) { out[row] = -in[row]; });
+      } else {
+        bool* out = op.flag_store.get();
+        for_each_row(sel, [&](std::size_t row) {
+          out[row] = !truthy(operand, row);
+        });
+      }
+      break;
+    }
+    default:
+      // Literals, nil and columns already hold their values.
+      break;
+  }
+}
+
+void BatchEvaluator::eval_logical(Op& op, const Selection& sel) {
+  eval(op.lhs, sel);
+  const Op& lhs = ops_[op.lhs];
+  bool is_and = static_cast<BinaryOpKind>(op.op) == BinaryOpKind::And;
+
+  // The left operand is the result unless it leaves the row undecided, in
+  // which case the row is queued for the right operand.
+  std::size_t live = 0;
+  auto copy_from = [this, &op](const Op& src, std::size_t row) {
+    switch (op.type) {
+      case Type::Nil:
+        break;
+      case Type::Bool:
+        op.flag_store[row] = src.flags[row];
+        break;
+      case Type::Number:
+        op.number_store[row] = src.numbers[row];
+        break;
+      case Type::String:
+        op.string_store[row] = src.strings[row];
+        break;
+      case Type::Any:
+        op.value_store[row] = value(src, row);
+        break;
+    }
+  };
+  for_each_row(sel, [&](std::size_t row) {
+    copy_from(lhs, row);
+    if (truthy(lhs, row) == is_and) {
+      op.selection[live++] = static_cast<std::uint16_t>(row);
+    }
+  });
+  if (live == 0) {
+    return;
+  }
+
+  Selection rest{op.selection.data(), live, false};
+  eval(op.rhs, rest);
+  const Op& rhs = ops_[op.rhs];
+  for_each_row(rest, [&](std::size_t row) { copy_from(rhs, row); });
+}
+
+void BatchEvaluator::eval_equality(Op& op, const Selection& sel) {
+  eval(op.lhs, sel);
+  eval(op.rhs, sel);
+  const Op& lhs = ops_[op.lhs];
+  const Op& rhs = ops_[op.rhs];
+  bool negate = static_cast<BinaryOpKind>(op.op) == BinaryOpKind::Neq;
+  bool* out = op.flag_store.get();
+
+  if (lhs.type == Type::Any || rhs.type == Type::Any) {
+    for_each_row(sel, [&](std::size_t row) {
+      out[row] = (value(lhs, row) == value(rhs, row)) != negate;
+    });
+    return;
+  }
+  if (lhs.type != rhs.type || lhs.type == Type::Nil) {
+    // Values of different types are never equal, nil always equals nil.
+    bool equal = lhs.type == rhs.type;
+    for_each_row(sel, [&](std::size_t row) { out[row] = equal != negate; });
+    return;
+  }
+  switch (lhs.type) {
+    case Type::Bool:
+      for_each_row(sel, [&](std::size_t row) {
+        out[row] = (lhs.flags[row] == rhs.flags[row]) != negate;
+      });
+      break;
+    case Type::Number:
+      for_each_row(sel, [&](std::size_t row) {
+        out[row] = (lhs.numbers[row] == rhs.numbers[row]) != negate;
+      });
+      break;
+    case Type::String:
+      for_each_row(sel, [&](std::size_t row) {
+        out[row] = (lhs.strings[row] == rhs.strings[row]) != negate;
+      });
+      break;
+    case Type::Nil:
+    case Type::Any:
+      break;
+  }
+}
+
+void BatchEvaluator::eval_numeric(Op& op, const Selection& sel) {
+  eval(op.lhs, sel);
+  eval(op.rhs, sel);
+  const Op& lhs = ops_[op.lhs];
+  const Op& rhs = ops_[op.rhs];
+
+  if (lhs.type == Type::Any || rhs.type == Type::Any) {
+    auto bop = static_cast<BinaryOpKind>(op.op);
+    for_each_row(sel, [&](std::size_t row) {
+      store(op, row, apply(bop, value(lhs, row), value(rhs, row)));
+    });
+    return;
+  }
+  if (op.type == Type::String) {
+    std::string* out = op.string_store.data();
+    for_each_row(sel, [&](std::size_t row) {
+      out[row].assign(lhs.strings[row]);
+      out[row] += rhs.strings[row];
+    });
+    return;
+  }
+
+  const double* left = lhs.numbers;
+  const double* right = rhs.numbers;
+  double* num = op.number_store.data();
+  bool* flag = op.flag_store.get();
+  switch (static_cast<BinaryOpKind>(op.op)) {
+    case BinaryOpKind::Add:
+      for_each_row(sel, [&](std::size_t row) {
+        num[row] = left[row] + right[row];
+      });
+      break;
+    case BinaryOpKind::Minus:
+      for_each_row(sel, [&](std::size_t row) {
+        num[row] = left[row] - right[row];
+      });
+      break;
+    case BinaryOpKind::Mul:
+      for_each_row(sel, [&](std::size_t row) {
+        num[row] = left[row] * right[row];
+      });
+      break;
+    case BinaryOpKind::Div:
+      for_each_row(sel, [&](std::size_t row) {
+        num[row] = left[row] / right[row];
+      });
+      break;
+    case BinaryOpKind::Gt:
+      for_each_row(sel, [&](std::size_t row) {
+        flag[row] = left[row] > right[row];
+      });
+      break;
+    case BinaryOpKind::Ge:
+      for_each_row(sel, [&](std::size_t row) {
+        flag[row] = left[row] >= right[row];
+      });
+      break;
+    case BinaryOpKind::Lt:
+      for_each_row(sel, [&](std::size_t row) {
+        flag[row] = left[row] < right[row];
+      });
+      break;
+    case BinaryOpKind::Le:
+      for_each_row(sel, [&](std::size_t row) {
+        flag[row] = left[row] <= right[row];
+      });
+      break;
+    default:
+      throw "Unknown binary operator";
+  }
+}
+
+auto BatchEvaluator::truthy(const Op& op, std::size_t row) const -> bool {
+  switch (op.type) {
+    case Type::Nil:
+      return false;
+    case Type::Bool:
+      return op.flags[row];
+    case Type::Number:
+    case Type::String:
+      return true;
+    case Type::Any:
+      return op.values[row].truthy();
+  }
+  return false;
+}
+
+auto BatchEvaluator::value(const Op& op, std::size_t row) const -> Value {
+  switch (op.type) {
+    case Type::Nil:
+      return Value{};
+    case Type::Bool:
+      return Value{op.flags[row]};
+    case Type::Number:
+      return Value{op.numbers[row]};
+    case Type::String:
+      return Value{op.strings[row]};
+    case Type::Any:
+      return op.values[row];
+  }
+  return Value{};
+}
+
+void BatchEvaluator::store(Op& op, std::size_t row, Value value) {
+  switch (op.type) {
+    case Type::Bool:
+      op.flag_store[row] = value.as_bool();
+      break;
+    case Type::Number:
+      op.number_store[row] = value.as_number();
+      break;
+    case Type::Any:
+      op.value_store[row] = std::move(value);
+      break;
+    default:
+      throw "Unexpected result type";
+  }
+}
+
+}  // namespace loxt
@@ -0,0 +1,672 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <bit>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <loxt/cache.hpp>
+#include <loxt/parser.hpp>
+#include <thread>
+#include <vector>
+
+namespace loxt {
+
+namespace {
+
+static_assert(std::endian::native == std::endian::little,
+              "The cache format is stored little endian");
+
+constexpr std::string_view Cache_Magic = "LXCA";
+constexpr std::uint32_t No_Node = 0xffffffff;
+constexpr std::uint32_t Has_Tree = 1;
+
+constexpr TokenKind Kinds[] = {
+#define LOXT_TOKEN(name) TokenKind::name(),
+#include <loxt/token_kinds.def>
+};
+
+// Image layout: Header, then the token, identifier, string literal, number
+// literal, node and child arrays in that order, each padded to 8 bytes. The
+// section sizes follow from the counts in the header.
+struct Header {
+  char magic[4];
+  std::uint32_t version;
+  std::uint64_t source_hash;
+  std::uint64_t source_size;
+  std::uint32_t flags;
+  std::uint32_t root;
+  std::uint32_t tokens;
+  std::uint32_t identifiers;
+  std::uint32_t strings;
+  std::uint32_t numbers;
+  std::uint32_t nodes;
+  std::uint32_t children;
+};
+
+struct TokenRecord {
+  std::uint32_t offset;
+  std::uint32_t line;
+  std::uint32_t column;
+  std::uint32_t extra;
+  std::uint8_t kind;
+  std::uint8_t pad[3];
+};
+
+// A range of the source text.
+struct SpanRecord {
+  std::uint32_t offset;
+  std::uint32_t length;
+};
+
+struct NodeRecord {
+  std::uint32_t parent;
+  std::uint32_t prev;
+  std::uint32_t next;
+  std::uint32_t first_child;
+  std::uint32_t child_count;
+  std::uint32_t literal;
+  std::uint32_t slot;
+  std::uint8_t kind;
+  std::uint8_t sub;
+  std::uint8_t flag;
+  std::uint8_t pad;
+};
+
+class ImageWriter {
+ public:
+  template <class T>
+  void append(const T& record) {
+    const auto* bytes = reinterpret_cast<const char*>(&record);
+    image_.append(bytes, sizeof(T));
+  }
+
+  void append_bytes(std::string_view bytes) { image_.append(bytes); }
+
+  void align() {
+    image_.resize((image_.size() + 7) & ~std::size_t{7}, '\0');
+  }
+
+  auto take() -> std::string { return std::move(image_); }
+
+ private:
+  std::string image_;
+};
+
+class ImageReader {
+ public:
+  explicit ImageReader(std::string_view image) : image_(image) {}
+
+  template <class T>
+  auto read(T& record) -> bool {
+    if (image_.size() - pos_ < sizeof(T)) {
+      return false;
+    }
+    std::memcpy(&record, image_.data() + pos_, sizeof(T));
+    pos_ += sizeof(T);
+    return true;
+  }
+
+  auto read_bytes(std::size_t count) -> std::optional<std::string_view> {
+    if (image_.size() - pos_ < count) {
+      return std::nullopt;
+    }
+    auto bytes = image_.substr(pos_, count);
+    pos_ += count;
+    return bytes;
+  }
+
+  // Whether `count` more records of T fit in the rest of the image, which
+  // bounds what a damaged header can make the reader allocate.
+  template <class T>
+  [[nodiscard]] auto fits(std::uint64_t count) const -> bool {
+    return count <= (image_.size() - pos_) / sizeof(T);
+  }
+
+  void align() {
+    pos_ = std::min((pos_ + 7) & ~std::size_t{7}, image_.size());
+  }
+
+ private:
+  std::string_view image_;
+  std::size_t pos_ = 0;
+};
+
+auto encode_node(const ExprData& data) -> NodeRecord {
+  NodeRecord record{};
+  record.kind = static_cast<std::uint8_t>(data.kind);
+  switch (data.kind) {
+    case ExprKind::Binary:
+      record.sub = static_cast<std::uint8_t>(data.bOp);
+      break;
+    case ExprKind::Unary:
+      record.sub = static_cast<std::uint8_t>(data.uOp);
+      break;
+    case ExprKind::Literal:
+      record.sub = static_cast<std::uint8_t>(data.literalKind);
+      if (data.literalKind == LiteralKind::Bool) {
+        record.flag = data.boolVal ? 1 : 0;
+      } else {
+        record.literal = data.literalVal;
+      }
+      break;
+    case ExprKind::Variable:
+      record.literal = data.identifier;
+      record.slot = data.slot;
+      break;
+    default:
+      break;
+  }
+  return record;
+}
+
+auto decode_node(const NodeRecord& record) -> std::optional<ExprData> {
+  auto kind = static_cast<ExprKind>(record.kind);
+  switch (kind) {
+    case ExprKind::Root:
+    case ExprKind::Paren:
+    case ExprKind::Nil:
+      return ExprData{kind};
+    case ExprKind::Binary:
+      if (record.sub > static_cast<std::uint8_t>(BinaryOpKind::Mul)) {
+        return std::nullopt;
+      }
+      return ExprData{kind, static_cast<BinaryOpKind>(record.sub)};
+    case ExprKind::Unary:
+      if (record.sub > static_cast<std::uint8_t>(UnaryOpKind::Neg)) {
+        return std::nullopt;
+      }
+      return ExprData{kind, static_cast<UnaryOpKind>(record.sub)};
+    case ExprKind::Literal:
+      switch (static_cast<LiteralKind>(record.sub)) {
+        case LiteralKind::Bool:
+          return ExprData{kind, LiteralKind::Bool, record.flag != 0};
+        case LiteralKind::Number:
+        case LiteralKind::String:
+          return ExprData{kind, static_cast<LiteralKind>(record.sub),
+                          static_cast<Literal>(record.literal)};
+      }
+      return std::nullopt;
+    case ExprKind::Variable: {
+      ExprData data{kind, static_cast<Identifier>(record.literal)};
+      data.slot = record.slot;
+      return data;
+    }
+  }
+  return std::nullopt;
+}
+
+auto encode_id(std::optional<treeceratops::node_id> node) -> std::uint32_t {
+  return node ? static_cast<std::uint32_t>(*node) : No_Node;
+}
+
+auto decode_id(std::uint32_t node) -> std::optional<treeceratops::node_id> {
+  if (node == No_Node) {
+    return std::nullopt;
+  }
+  return node;
+}
+
+// Whether the links between decoded nodes, whose ids are already in range,
+// are ones the tree could have built. Children lists must not form a
+// cycle, so recursive walks end. A parent link must name a node that lists
+// the child, and sibling links must step forward through that list, so the
+// pre-order iterator ends too. Hash-consed trees share children, so a
+// listed child may link to another of the nodes listing it.
+auto valid_links(const std::vector<ExprTree::node_type>& nodes) -> bool {
+  // Position of each node in its parent's children, if listed there.
+  constexpr auto Unlisted = std::numeric_limits<std::size_t>::max();
+  std::vector<std::size_t> position(nodes.size(), Unlisted);
+  std::vector<std::size_t> parents(nodes.size(), 0);
+  for (treeceratops::node_id node = 0; node < nodes.size(); ++node) {
+    const auto& children = nodes[node].children;
+    for (std::size_t idx = 0; idx < children.size(); ++idx) {
+      auto child = children[idx];
+      ++parents[child];
+      if (nodes[child].parent == node && position[child] == Unlisted) {
+        position[child] = idx;
+      }
+    }
+  }
+
+  for (treeceratops::node_id node = 0; node < nodes.size(); ++node) {
+    const auto& current = nodes[node];
+    if (!current.parent) {
+      if (parents[node] != 0 || current.prev || current.next) {
+        return false;
+      }
+      continue;
+    }
+    if (position[node] == Unlisted) {
+      return false;
+    }
+    if (current.next &&
+        (nodes[*current.next].parent != current.parent ||
+         nodes[*current.next].prev != node ||
+         position[*current.next] <= position[node])) {
+      return false;
+    }
+    if (current.prev && nodes[*current.prev].next != node) {
+      return false;
+    }
+  }
+
+  // Removes nodes no longer listed by any other until none are left.
+  std::vector<treeceratops::node_id> ready;
+  for (treeceratops::node_id node = 0; node < nodes.size(); ++node) {
+    if (parents[node] == 0) {
+      ready.push_back(node);
+    }
+  }
+  std::size_t removed = 0;
+  while (!ready.empty()) {
+    auto node = ready.back();
+    ready.pop_back();
+    ++removed;
+    for (auto child : nodes[node].children) {
+      if (--parents[child] == 0) {
+        ready.push_back(child);
+      }
+    }
+  }
+  return removed == nodes.size();
+}
+
+// Read-only mapping of a whole file.
+class MappedFile {
+ public:
+  explicit MappedFile(const std::filesystem::path& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return;
+    }
+    struct stat info {};
+    if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+      size_ = static_cast<std::size_t>(info.st_size);
+      void* addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      data_ = addr == MAP_FAILED ? nullptr : static_cast<const char*>(addr);
+    }
+    ::close(fd);
+  }
+  MappedFile(const MappedFile&) = delete;
+  auto operator=(const MappedFile&) -> MappedFile& = delete;
+  ~MappedFile() {
+    if (data_ != nullptr) {
+      ::munmap(const_cast<char*>(data_), size_);
+    }
+  }
+
+  [[nodiscard]] auto view() const -> std::optional<std::string_view> {
+    if (data_ == nullptr) {
+      return std::nullopt;
+    }
+    return std::string_view{data_, size_};
+  }
+
+ private:
+  const char* data_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+}  // namespace
+
+// Word at a time multiplicative hash with a murmur style finaliser. It only
+// needs to spread content, it is not meant to resist collisions on purpose.
+auto content_hash(std::string_view source) -> std::uint64_t {
+  constexpr std::uint64_t Mul = 0x9e3779b97f4a7c15ULL;
+  std::uint64_t hash = source.size() * Mul;
+  std::size_t pos = 0;
+  for (; pos + 8 <= source.size(); pos += 8) {
+    std::uint64_t word = 0;
+    std::memcpy(&word, source.data() + pos, sizeof(word));
+    hash = std::rotl(hash ^ (word * Mul), 29) * Mul;
+  }
+  std::uint64_t tail = 0;
+  std::memcpy(&tail, source.data() + pos, source.size() - pos);
+  hash = std::rotl(hash ^ (tail * Mul), 29) * Mul;
+
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+auto serialize(const TokenList& tokens, const ExprTree* tree) -> std::string {
+  const auto& source = tokens.source();
+  auto offset_of = [&](std::string::const_iterator pos) {
+    return static_cast<std::uint32_t>(pos - source.begin());
+  };
+
+  std::vector<SpanRecord> strings(tokens.string_literal_count());
+  for (const auto& tok : tokens) {
+    if (tok.kind == TokenKind::String()) {
+      strings[tok.literal] = {
+          offset_of(tok.loc.pos) + 1,
+          static_cast<std::uint32_t>(
+              tokens.string_literal(tok.literal).size())};
+    }
+  }
+
+  std::size_t child_count = 0;
+  if (tree != nullptr) {
+    for (const auto& node : tree->nodes()) {
+      child_count += node.children.size();
+    }
+  }
+
+  Header header{};
+  std::memcpy(header.magic, Cache_Magic.data(), sizeof(header.magic));
+  header.version = Cache_Format_Version;
+  header.source_hash = content_hash(source);
+  header.source_size = source.size();
+  header.flags = tree != nullptr ? Has_Tree : 0;
+  header.root = tree != nullptr ? encode_id(tree->root()) : No_Node;
+  header.tokens = static_cast<std::uint32_t>(tokens.size());
+  header.identifiers = static_cast<std::uint32_t>(tokens.identifier_count());
+  header.strings = static_cast<std::uint32_t>(strings.size());
+  header.numbers = static_cast<std::uint32_t>(tokens.number_literal_count());
+  header.nodes =
+      tree != nullptr ? static_cast<std::uint32_t>(tree->nodes().size()) : 0;
+  header.children = static_cast<std::uint32_t>(child_count);
+
+  ImageWriter writer;
+  writer.append(header);
+  writer.append_bytes(source);
+  writer.align();
+  for (const auto& tok : tokens) {
+    TokenRecord record{};
+    record.offset = offset_of(tok.loc.pos);
+    record.line = static_cast<std::uint32_t>(tok.loc.line);
+    record.column = static_cast<std::uint32_t>(tok.loc.column);
+    record.extra = tok.identifier;
+    record.kind = static_cast<std::uint8_t>(tok.kind.kind());
+    writer.append(record);
+  }
+  writer.align();
+  for (Identifier ident = 0; ident < tokens.identifier_count(); ++ident) {
+    auto name = tokens.identifier(ident);
+    writer.append(SpanRecord{static_cast<std::uint32_t>(name.data() -
+                                                        source.data()),
+                             static_cast<std::uint32_t>(name.size())});
+  }
+  writer.align();
+  for (const auto& span : strings) {
+    writer.append(span);
+  }
+  writer.align();
+  for (Literal literal = 0; literal < tokens.number_literal_count();
+       ++literal) {
+    writer.append(tokens.number_literal(literal));
+  }
+  writer.align();
+  if (tree != nullptr) {
+    std::uint32_t first_child = 0;
+    for (const auto& node : tree->nodes()) {
+      auto record = encode_node(node.data);
+      record.parent = encode_id(node.parent);
+      record.prev = encode_id(node.prev);
+      record.next = encode_id(node.next);
+      record.first_child = first_child;
+      record.child_count = static_cast<std::uint32_t>(node.children.size());
+      first_child += record.child_count;
+      writer.append(record);
+    }
+    writer.align();
+    for (const auto& node : tree->nodes()) {
+      for (auto child : node.children) {
+        writer.append(static_cast<std::uint32_t>(child));
+      }
+    }
+    writer.align();
+  }
+  return writer.take();
+}
+
+
+auto deserialize(std::string_view image, const std::string& source)
+    -> std::optional<Artifact> {
+  ImageReader reader{image};
+  Header header{};
+  if (!reader.read(header) ||
+      std::string_view{header.magic, sizeof(header.magic)} != Cache_Magic ||
+      header.version != Cache_Format_Version ||
+      header.source_size != source.size() ||
+      header.source_hash != content_hash(source)) {
+    return std::nullopt;
+  }
+  // The hash only rules out most other sources cheaply; a hit needs the
+  // same bytes, so a colliding script never gets another one's tree.
+  if (reader.read_bytes(source.size()) != std::string_view{source}) {
+    return std::nullopt;
+  }
+  reader.align();
+  if (!reader.fits<TokenRecord>(header.tokens)) {
+    return std::nullopt;
+  }
+
+  auto in_source = [&](std::uint64_t offset, std::uint64_t length) {
+    return offset + length <= source.size();
+  };
+
+  auto list = std::shared_ptr<TokenList>(new TokenList(header.tokens));
+  list->m_Source = &source;
+  for (std::uint32_t idx = 0; idx < header.tokens; ++idx) {
+    TokenRecord record{};
+    if (!reader.read(record) || record.kind >= std::size(Kinds) ||
+        !in_source(record.offset, 0)) {
+      return std::nullopt;
+    }
+    SourceLocation loc{.line = static_cast<int>(record.line),
+                       .column = static_cast<int>(record.column),
+                       .pos = source.begin() + record.offset};
+    list->m_Tokens.emplace_back(Kinds[record.kind], loc, record.extra);
+  }
+  reader.align();
+
+  if (!reader.fits<SpanRecord>(header.identifiers)) {
+    return std::nullopt;
+  }
+  list->m_Identifiers.reserve(header.identifiers);
+  for (std::uint32_t idx = 0; idx < header.identifiers; ++idx) {
+    SpanRecord span{};
+    if (!reader.read(span) || !in_source(span.offset, span.length)) {
+      return std::nullopt;
+    }
+    std::string_view name{source.data() + span.offset, span.length};
+    list->m_Identifiers.push_back(name);
+    list->m_IdentifierMap.emplace(name, idx);
+  }
+  reader.align();
+
+  if (!reader.fits<SpanRecord>(header.strings)) {
+    return std::nullopt;
+  }
+  list->m_StringLiteral.reserve(header.strings);
+  for (std::uint32_t idx = 0; idx < header.strings; ++idx) {
+    SpanRecord span{};
+    if (!reader.read(span) || !in_source(span.offset, span.length)) {
+      return std::nullopt;
+    }
+    list->m_StringLiteral.emplace_back(source.data() + span.offset,
+                                       span.length);
+  }
+  reader.align();
+
+  if (!reader.fits<std::uint64_t>(header.numbers)) {
+    return std::nullopt;
+  }
+  list->m_NumberLiteral.resize(header.numbers);
+  for (auto& number : list->m_NumberLiteral) {
+    if (!reader.read(number)) {
+      return std::nullopt;
+    }
+  }
+  reader.align();
+
+  for (const auto& tok : *list) {
+    if ((tok.kind == TokenKind::Identifier() &&
+         tok.identifier >= header.identifiers) ||
+        (tok.kind == TokenKind::String() && tok.literal >= header.strings) ||
+        (tok.kind == TokenKind::Number() && tok.literal >= header.numbers)) {
+      return std::nullopt;
+    }
+  }
+
+  Artifact artifact{list, std::nullopt};
+  if ((header.flags & Has_Tree) == 0) {
+    return artifact;
+  }
+
+  if (!reader.fits<NodeRecord>(header.nodes)) {
+    return std::nullopt;
+  }
+  std::vector<NodeRecord> records(header.nodes);
+  for (auto& record : records) {
+    if (!reader.read(record)) {
+      return std::nullopt;
+    }
+  }
+  reader.align();
+
+  auto valid_id = [&](std::uint32_t node) {
+    return node == No_Node || node < header.nodes;
+  };
+  // Literal and identifier indices must be in the pools they index.
+  auto valid_data = [&](const ExprData& data) {
+    switch (data.kind) {
+      case ExprKind::Literal:
+        return data.literalKind == LiteralKind::Bool ||
+               data.literalVal < (data.literalKind == LiteralKind::Number
+                                      ? header.numbers
+                                      : header.strings);
+      case ExprKind::Variable:
+        return data.identifier < header.identifiers;
+      default:
+        return true;
+    }
+  };
+  std::vector<ExprTree::node_type> nodes;
+  nodes.reserve(header.nodes);
+  std::uint64_t children_read = 0;
+  for (const auto& record : records) {
+    auto data = decode_node(record);
+    if (!data || !valid_data(*data) || !valid_id(record.parent) ||
+        !valid_id(record.prev) ||
+        !valid_id(record.next) || record.first_child != children_read ||
+        children_read + record.child_count > header.children) {
+      return std::nullopt;
+    }
+    std::vector<treeceratops::node_id> children(record.child_count);
+    for (auto& child : children) {
+      std::uint32_t id = 0;
+      if (!reader.read(id) || id >= header.nodes) {
+        return std::nullopt;
+      }
+      child = id;
+    }
+    children_read += record.child_count;
+    nodes.push_back({decode_id(record.parent), decode_id(record.prev),
+                     decode_id(record.next), *data, std::move(children)});
+  }
+  if (children_read != header.children || !valid_id(header.root) ||
+      (header.root != No_Node && nodes[header.root].parent) ||
+      !valid_links(nodes)) {
+    return std::nullopt;
+  }
+
+  artifact.tree.emplace();
+  artifact.tree->assign(std::move(nodes), decode_id(header.root));
+  return artifact;
+}
+
+ScriptCache::ScriptCache(std::filesystem::path directory)
+    : ScriptCache(std::move(directory), Default_Max_Depth) {}
+
+ScriptCache::ScriptCache(std::filesystem::path directory,
+                         std::size_t max_depth)
+    : directory_(std::move(directory)), max_depth_(max_depth) {
+  std::filesystem::create_directories(directory_);
+}
+
+auto ScriptCache::path_for(const std::string& source) const
+    -> std::filesystem::path {
+  if (max_depth_ != Default_Max_Depth) {
+    return directory_ / std::format("{:016x}.d{}.lxc", content_hash(source),
+                                    max_depth_);
+  }
+  return directory_ / std::format("{:016x}.lxc", content_hash(source));
+}
+
+auto ScriptCache::load(const std::string& source) -> std::optional<Artifact> {
+  MappedFile file{path_for(source)};
+  if (auto image = file.view()) {
+    return deserialize(*image, source);
+  }
+  return std::nullopt;
+}
+
+// Writes to a temporary file first so concurrent readers only ever see
+// complete images.
+void ScriptCache::store(const std::string& source, const TokenList& tokens,
+                        const ExprTree* tree) {
+  auto image = serialize(tokens, tree);
+  auto path = path_for(source);
+  auto temp = path;
+  // Unique across processes sharing the directory and threads within one.
+  temp += std::format(".{}.{}.tmp", ::getpid(),
+                      std::hash<std::thread::id>{}(std::this_thread::get_id()));
+  {
+    std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+    out.write(image.data(), static_cast<std::streamsize>(image.size()));
+    if (!out) {
+      return;
+    }
+  }
+  std::error_code err;
+  std::filesystem::rename(temp, path, err);
+  if (err) {
+    std::filesystem::remove(temp, err);
+  }
+}
+
+auto ScriptCache::lex(const std::string& source)
+    -> std::shared_ptr<TokenList> {
+  if (auto artifact = load(source)) {
+    ++hits_;
+    return artifact->tokens;
+  }
+  ++misses_;
+  auto tokens = loxt::lex(source);
+  if (!tokens->has_error()) {
+    store(source, *tokens, nullptr);
+  }
+  return tokens;
+}
+
+auto ScriptCache::parse(const std::string& source) -> Artifact {
+  auto artifact = load(source);
+  if (artifact && artifact->tree) {
+    ++hits_;
+    return std::move(*artifact);
+  }
+  ++misses_;
+
+  auto tokens = artifact ? artifact->tokens : loxt::lex(source);
+  if (tokens->has_error()) {
+    return {tokens, std::nullopt};
+  }
+  Parser parser{tokens};
+  parser.set_max_depth(max_depth_);
+  parser.parse();
+  Artifact result{tokens, std::move(parser.tree())};
+  store(source, *tokens, &*result.tree);
+  return result;
+}
+
+}  // namespace loxt
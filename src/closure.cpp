@@ -0,0 +1,341 @@
+#include <loxt/closure.hpp>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace loxt {
+
+namespace {
+
+using Nil = std::monostate;
+
+template <class T>
+using Fn = std::function<T(Environment)>;
+
+// A compiled node. The alternative index is the node's StaticType.
+using AnyFn = std::variant<Fn<Nil>, Fn<bool>, Fn<double>, Fn<std::string>,
+                           Fn<Value>>;
+
+template <class T>
+constexpr bool Is_Any = std::is_same_v<T, Value>;
+
+template <class T>
+constexpr bool Is_Number_Like = std::is_same_v<T, double> || Is_Any<T>;
+
+auto box(Nil /*value*/) -> Value { return Value{}; }
+auto box(bool value) -> Value { return Value{value}; }
+auto box(double value) -> Value { return Value{value}; }
+auto box(std::string value) -> Value { return Value{std::move(value)}; }
+
+constexpr auto truthy(Nil /*value*/) -> bool { return false; }
+constexpr auto truthy(bool value) -> bool { return value; }
+constexpr auto truthy(double /*value*/) -> bool { return true; }
+auto truthy(const std::string& /*value*/) -> bool { return true; }
+auto truthy(const Value& value) -> bool { return value.truthy(); }
+
+// Run time checks, only reached through operands typed Any.
+auto number(double value) -> double { return value; }
+auto number(const Value& value) -> double {
+  if (!value.is_number()) {
+    throw "Operands must be numbers";
+  }
+  return value.as_number();
+}
+
+template <class T>
+auto boxed(Fn<T> fn) -> Fn<Value> {
+  if constexpr (Is_Any<T>) {
+    return fn;
+  } else {
+    return [fn = std::move(fn)](Environment env) { return box(fn(env)); };
+  }
+}
+
+template <BinaryOpKind Op>
+constexpr auto arithmetic(double lhs, double rhs) -> double {
+  if constexpr (Op == BinaryOpKind::Add) {
+    return lhs + rhs;
+  } else if constexpr (Op == BinaryOpKind::Minus) {
+    return lhs - rhs;
+  } else if constexpr (Op == BinaryOpKind::Mul) {
+    return lhs * rhs;
+  } else {
+    return lhs / rhs;
+  }
+}
+
+template <BinaryOpKind Op>
+constexpr auto compare(double lhs, double rhs) -> bool {
+  if constexpr (Op == BinaryOpKind::Gt) {
+    return lhs > rhs;
+  } else if constexpr (Op == BinaryOpKind::Ge) {
+    return lhs >= rhs;
+  } else if constexpr (Op == BinaryOpKind::Lt) {
+    return lhs < rhs;
+  } else {
+    return lhs <= rhs;
+  }
+}
+
+// A type error proven while compiling. It is only raised if the node runs,
+// after its operands, as the Evaluator would: an untaken `and`/`or` operand
+// must not change what the expression means.
+template <class... Operands>
+auto type_error(const char* message, Operands... operands) -> AnyFn {
+  return Fn<Value>{[message, operands...](Environment env) -> Value {
+    (operands(env), ...);
+    throw message;
+  }};
+}
+
+template <BinaryOpKind Op>
+constexpr bool Is_Comparison = Op == BinaryOpKind::Gt ||
+                               Op == BinaryOpKind::Ge ||
+                               Op == BinaryOpKind::Lt || Op == BinaryOpKind::Le;
+
+// The callable for one operator and pair of operand types. Every branch
+// below is a separate specialisation chosen while compiling.
+template <BinaryOpKind Op, class L, class R>
+auto specialise(Fn<L> lhs, Fn<R> rhs) -> AnyFn {
+  constexpr bool Any_Operand = Is_Any<L> || Is_Any<R>;
+
+  if constexpr (Op == BinaryOpKind::And || Op == BinaryOpKind::Or) {
+    constexpr bool Is_And = Op == BinaryOpKind::And;
+    if constexpr (std::is_same_v<L, R>) {
+      return Fn<L>{[lhs, rhs](Environment env) -> L {
+        auto left = lhs(env);
+        if (truthy(left) != Is_And) {
+          return left;
+        }
+        return rhs(env);
+      }};
+    } else {
+      // The result is whichever operand decides, so its type varies.
+      return Fn<Value>{[lhs = boxed(lhs), rhs = boxed(rhs)](Environment env) {
+        auto left = lhs(env);
+        if (left.truthy() != Is_And) {
+          return left;
+        }
+        return rhs(env);
+      }};
+    }
+  } else if constexpr (Op == BinaryOpKind::Eq || Op == BinaryOpKind::Neq) {
+    constexpr bool Negate = Op == BinaryOpKind::Neq;
+    if constexpr (std::is_same_v<L, R>) {
+      return Fn<bool>{[lhs, rhs](Environment env) {
+        return (lhs(env) == rhs(env)) != Negate;
+      }};
+    } else if constexpr (Any_Operand) {
+      return Fn<bool>{[lhs = boxed(lhs), rhs = boxed(rhs)](Environment env) {
+        return (lhs(env) == rhs(env)) != Negate;
+      }};
+    } else {
+      // Values of different types are never equal.
+      return Fn<bool>{[](Environment /*env*/) { return Negate; }};
+    }
+  } else if constexpr (Op == BinaryOpKind::Add &&
+                       std::is_same_v<L, std::string> &&
+                       std::is_same_v<R, std::string>) {
+    return Fn<std::string>{[lhs, rhs](Environment env) {
+      auto result = lhs(env);
+      result += rhs(env);
+      return result;
+    }};
+  } else if constexpr (Op == BinaryOpKind::Add && Any_Operand) {
+    return Fn<Value>{[lhs = boxed(lhs), rhs = boxed(rhs)](Environment env) {
+      auto left = lhs(env);
+      auto right = rhs(env);
+      if (left.is_string() && right.is_string()) {
+        return Value{left.as_string() + right.as_string()};
+      }
+      if (!left.is_number() || !right.is_number()) {
+        throw "Operands must be two numbers or two strings";
+      }
+      return Value{left.as_number() + right.as_number()};
+    }};
+  } else if constexpr (Is_Number_Like<L> && Is_Number_Like<R>) {
+    if constexpr (Is_Comparison<Op>) {
+      return Fn<bool>{[lhs, rhs](Environment env) {
+        return compare<Op>(number(lhs(env)), number(rhs(env)));
+      }};
+    } else {
+      return Fn<double>{[lhs, rhs](Environment env) {
+        return arithmetic<Op>(number(lhs(env)), number(rhs(env)));
+      }};
+    }
+  } else if constexpr (Op == BinaryOpKind::Add) {
+    return type_error("Operands must be two numbers or two strings", lhs, rhs);
+  } else {
+    return type_error("Operands must be numbers", lhs, rhs);
+  }
+}
+
+template <BinaryOpKind Op>
+auto binary(AnyFn lhs, AnyFn rhs) -> AnyFn {
+  return std::visit(
+      [](auto left, auto right) -> AnyFn {
+        return specialise<Op>(std::move(left), std::move(right));
+      },
+      std::move(lhs), std::move(rhs));
+}
+
+auto binary(BinaryOpKind op, AnyFn lhs, AnyFn rhs) -> AnyFn {
+  switch (op) {
+    case BinaryOpKind::Or:
+      return binary<BinaryOpKind::Or>(std::move(lhs), std::move(rhs));
+    case BinaryOpKind::And:
+      return binary<BinaryOpKind::And>(std::move(lhs), std::move(rhs));
+    case BinaryOpKind::Eq:
+      return binary<BinaryOpKind::Eq>(std::move(lhs), std::move(rhs));
+    case BinaryOpKind::Neq:
+      return binary<BinaryOpKind::Neq>(std::move(lhs), std::move(rhs));
+    case BinaryOpKind::Gt:
+      return binary<BinaryOpKind::Gt>(std::move(lhs), std::move(rhs));
+    case BinaryOpKind::Ge:
+      return binary<BinaryOpKind::Ge>(std::move(lhs), std::move(rhs));
+    case BinaryOpKind::Lt:
+      return binary<BinaryOpKind::Lt>(std::move(lhs), std::move(rhs));
+    case BinaryOpKind::Le:
+      return binary<BinaryOpKind::Le>(std::move(lhs), std::move(rhs));
+    case BinaryOpKind::Minus:
+      return binary<BinaryOpKind::Minus>(std::move(lhs), std::move(rhs));
+    case BinaryOpKind::Add:
+      return binary<BinaryOpKind::Add>(std::move(lhs), std::move(rhs));
+    case BinaryOpKind::Div:
+      return binary<BinaryOpKind::Div>(std::move(lhs), std::move(rhs));
+    case BinaryOpKind::Mul:
+      return binary<BinaryOpKind::Mul>(std::move(lhs), std::move(rhs));
+  }
+  throw "Unknown binary operator";
+}
+
+auto unary(UnaryOpKind op, AnyFn operand) -> AnyFn {
+  return std::visit(
+      [op](auto fn) -> AnyFn {
+        using T = typename decltype(fn)::result_type;
+        if (op == UnaryOpKind::Not) {
+          return Fn<bool>{[fn](Environment env) { return !truthy(fn(env)); }};
+        }
+        if constexpr (std::is_same_v<T, double>) {
+          return Fn<double>{[fn](Environment env) { return -fn(env); }};
+        } else if constexpr (Is_Any<T>) {
+          return Fn<Value>{[fn](Environment env) {
+            auto value = fn(env);
+            if (!value.is_number()) {
+              throw "Operand must be a number";
+            }
+            return Value{-value.as_number()};
+          }};
+        } else {
+          return type_error("Operand must be a number", fn);
+        }
+      },
+      std::move(operand));
+}
+
+template <class T>
+auto declared(Slot slot, bool (Value::*is)() const,
+              T (Value::*get)() const) -> Fn<std::remove_cvref_t<T>> {
+  return [slot, is, get](Environment env) -> std::remove_cvref_t<T> {
+    const auto& value = env[slot];
+    if (!(value.*is)()) {
+      throw "Variable does not hold its declared type";
+    }
+    return (value.*get)();
+  };
+}
+
+auto variable(Slot slot, StaticType type) -> AnyFn {
+  switch (type) {
+    case StaticType::Nil:
+      return Fn<Nil>{[](Environment /*env*/) { return Nil{}; }};
+    case StaticType::Bool:
+      return declared(slot, &Value::is_bool, &Value::as_bool);
+    case StaticType::Number:
+      return declared(slot, &Value::is_number, &Value::as_number);
+    case StaticType::String:
+      return declared(slot, &Value::is_string, &Value::as_string);
+    case StaticType::Any:
+      return Fn<Value>{[slot](Environment env) { return env[slot]; }};
+  }
+  throw "Unknown static type";
+}
+
+class Builder {
+ public:
+  Builder(const TokenList& tokens,
+          const std::unordered_map<Identifier, StaticType>& types)
+      : tokens_{tokens}, types_{types} {}
+
+  auto build(ExprTree::const_iterator node) -> AnyFn {
+    const auto& data = *node;
+    switch (data.kind) {
+      case ExprKind::Root:
+      case ExprKind::Paren:
+        return build(node.child(0));
+      case ExprKind::Binary:
+        return binary(data.bOp, build(node.child(0)), build(node.child(1)));
+      case ExprKind::Unary:
+        return unary(data.uOp, build(node.child(0)));
+      case ExprKind::Nil:
+        return Fn<Nil>{[](Environment /*env*/) { return Nil{}; }};
+      case ExprKind::Variable: {
+        if (data.slot == Unresolved_Slot) {
+          throw "Unresolved variable";
+        }
+        auto type = types_.find(data.identifier);
+        return variable(data.slot,
+                        type == types_.end() ? StaticType::Any : type->second);
+      }
+      case ExprKind::Literal:
+        return literal(data);
+    }
+    throw "Unknown expression kind";
+  }
+
+ private:
+  auto literal(const ExprData& data) const -> AnyFn {
+    switch (data.literalKind) {
+      case LiteralKind::Number: {
+        auto value =
+            static_cast<double>(tokens_.number_literal(data.literalVal));
+        return Fn<double>{[value](Environment /*env*/) { return value; }};
+      }
+      case LiteralKind::String:
+        return Fn<std::string>{
+            [value = tokens_.string_literal(data.literalVal)](
+                Environment /*env*/) { return value; }};
+      case LiteralKind::Bool:
+        return Fn<bool>{
+            [value = data.boolVal](Environment /*env*/) { return value; }};
+    }
+    throw "Unknown literal kind";
+  }
+
+  const TokenList& tokens_;
+  const std::unordered_map<Identifier, StaticType>& types_;
+};
+
+}  // namespace
+
+void ClosureCompiler::declare(std::string_view name, StaticType type) {
+  if (auto ident = tokens_.find_identifier(name)) {
+    types_[*ident] = type;
+  }
+}
+
+auto ClosureCompiler::compile(const ExprTree& tree) -> CompiledExpr {
+  auto root = Builder{tokens_, types_}.build(tree.begin());
+  auto type = static_cast<StaticType>(root.index());
+  auto test = std::visit(
+      [](auto fn) -> Fn<bool> {
+        return [fn](Environment env) { return truthy(fn(env)); };
+      },
+      root);
+  auto value =
+      std::visit([](auto fn) { return boxed(std::move(fn)); }, std::move(root));
+  return CompiledExpr{type, std::move(value), std::move(test)};
+}
+
+}  // namespace loxt
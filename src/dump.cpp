@@ -0,0 +1,354 @@
+#include <loxt/dump.hpp>
+#include <utility>
+#include <vector>
+
+namespace loxt {
+
+namespace {
+
+auto node_name(const ExprData& data) -> std::string_view {
+  switch (data.kind) {
+    case ExprKind::Root:
+      return "RootExpr";
+    case ExprKind::Binary:
+      return "BinaryExpr";
+    case ExprKind::Paren:
+      return "ParenExpr";
+    case ExprKind::Literal:
+      switch (data.literalKind) {
+        case LiteralKind::Number:
+          return "NumberExpr";
+        case LiteralKind::String:
+          return "StringExpr";
+        case LiteralKind::Bool:
+          return "BoolExpr";
+      }
+      break;
+    case ExprKind::Unary:
+      return "UnaryExpr";
+    case ExprKind::Nil:
+      return "NilExpr";
+    case ExprKind::Variable:
+      return "VariableExpr";
+  }
+  return "UnknownExpr";
+}
+
+void write_string(DumpWriter& writer, std::string_view str) {
+  writer.write_u32(static_cast<std::uint32_t>(str.size()));
+  writer.write(str);
+}
+
+void dump_token_tables(DumpWriter& writer, const TokenList& tokens) {
+  writer.write_u32(static_cast<std::uint32_t>(tokens.identifier_count()));
+  for (Identifier ident = 0; ident < tokens.identifier_count(); ++ident) {
+    write_string(writer, tokens.identifier(ident));
+  }
+  writer.write_u32(static_cast<std::uint32_t>(tokens.string_literal_count()));
+  for (Literal literal = 0; literal < tokens.string_literal_count();
+       ++literal) {
+    write_string(writer, tokens.string_literal(literal));
+  }
+  writer.write_u32(static_cast<std::uint32_t>(tokens.number_literal_count()));
+  for (Literal literal = 0; literal < tokens.number_literal_count();
+       ++literal) {
+    writer.write_u64(tokens.number_literal(literal));
+  }
+}
+
+void dump_node_text(DumpWriter& writer, const ExprData& data,
+                    const TokenList& tokens, std::size_t depth) {
+  for (std::size_t col = 0; col < 4 * depth; ++col) {
+    writer.put(' ');
+  }
+  writer.write(node_name(data));
+  switch (data.kind) {
+    case ExprKind::Binary:
+      writer.format(" {}", to_string(data.bOp));
+      break;
+    case ExprKind::Unary:
+      writer.format(" {}", to_string(data.uOp));
+      break;
+    case ExprKind::Literal:
+      switch (data.literalKind) {
+        case LiteralKind::Number:
+          writer.format(" {}", tokens.number_literal(data.literalVal));
+          break;
+        case LiteralKind::String:
+          writer.format(" {}", tokens.string_literal(data.literalVal));
+          break;
+        case LiteralKind::Bool:
+          writer.format(" {}", data.boolVal);
+          break;
+      }
+      break;
+    case ExprKind::Variable:
+      writer.format(" {}", tokens.identifier(data.identifier));
+      break;
+    default:
+      break;
+  }
+  writer.put('\n');
+}
+
+void dump_node_jsonl(DumpWriter& writer, const ExprData& data,
+                     const TokenList& tokens, treeceratops::node_id id,
+                     std::optional<treeceratops::node_id> parent,
+                     std::size_t depth) {
+  writer.format(R"({{"id":{},"parent":)", id);
+  if (parent) {
+    writer.format("{}", *parent);
+  } else {
+    writer.write("null");
+  }
+  writer.format(R"(,"depth":{},"kind":"{}")", depth, node_name(data));
+  switch (data.kind) {
+    case ExprKind::Binary:
+      writer.format(R"(,"op":"{}")", to_string(data.bOp));
+      break;
+    case ExprKind::Unary:
+      writer.format(R"(,"op":"{}")", to_string(data.uOp));
+      break;
+    case ExprKind::Literal:
+      switch (data.literalKind) {
+        case LiteralKind::Number:
+          writer.format(R"(,"value":{})",
+                        tokens.number_literal(data.literalVal));
+          break;
+        case LiteralKind::String:
+          writer.write(R"(,"value":")");
+          writer.write_json_escaped(tokens.string_literal(data.literalVal));
+          writer.put('"');
+          break;
+        case LiteralKind::Bool:
+          writer.format(R"(,"value":{})", data.boolVal);
+          break;
+      }
+      break;
+    case ExprKind::Variable:
+      writer.write(R"(,"name":")");
+      writer.write_json_escaped(tokens.identifier(data.identifier));
+      writer.put('"');
+      break;
+    default:
+      break;
+  }
+  writer.write("}\n");
+}
+
+// Binary node record: u8 kind, u8 operator or literal kind, u32 child count
+// and, for literals, the value inline (u64 number, u32 length prefixed
+// string or u8 bool). Variables carry their u32 length prefixed name.
+// Records are in pre-order so the shape can be rebuilt from the child counts
+// alone.
+void dump_node_binary(DumpWriter& writer, const ExprData& data,
+                      const TokenList& tokens, std::size_t children) {
+  writer.write_u8(static_cast<std::uint8_t>(data.kind));
+  switch (data.kind) {
+    case ExprKind::Binary:
+      writer.write_u8(static_cast<std::uint8_t>(data.bOp));
+      break;
+    case ExprKind::Unary:
+      writer.write_u8(static_cast<std::uint8_t>(data.uOp));
+      break;
+    case ExprKind::Literal:
+      writer.write_u8(static_cast<std::uint8_t>(data.literalKind));
+      break;
+    default:
+      writer.write_u8(0);
+      break;
+  }
+  writer.write_u32(static_cast<std::uint32_t>(children));
+  if (data.kind == ExprKind::Variable) {
+    write_string(writer, tokens.identifier(data.identifier));
+    return;
+  }
+  if (data.kind != ExprKind::Literal) {
+    return;
+  }
+  switch (data.literalKind) {
+    case LiteralKind::Number:
+      writer.write_u64(tokens.number_literal(data.literalVal));
+      break;
+    case LiteralKind::String:
+      write_string(writer, tokens.string_literal(data.literalVal));
+      break;
+    case LiteralKind::Bool:
+      writer.write_u8(data.boolVal ? 1 : 0);
+      break;
+  }
+}
+
+// Pre-order walk over the children lists with an explicit stack, calling
+// fn(node, parent, depth) for every node.
+template <class Fn>
+void walk(const ExprTree& tree, Fn&& fn) {
+  struct Entry {
+    ExprTree::const_iterator node;
+    std::optional<treeceratops::node_id> parent;
+    std::size_t depth;
+  };
+  std::vector<Entry> stack{{tree.begin(), std::nullopt, 0}};
+  while (!stack.empty()) {
+    auto [node, parent, depth] = stack.back();
+    stack.pop_back();
+    fn(node, parent, depth);
+    for (std::size_t idx = node.child_count(); idx > 0; --idx) {
+      stack.push_back({node[idx - 1], node.id(), depth + 1});
+    }
+  }
+}
+
+// Pre-order walk of a frozen tree, which is a single pass over its nodes.
+// The stack holds the end of each open subtree to track depth and parent.
+template <class Fn>
+void walk(const FrozenExprTree& tree, Fn&& fn) {
+  struct Open {
+    treeceratops::node_id node;
+    std::size_t end;
+  };
+  std::vector<Open> open;
+  for (treeceratops::node_id node = 0; node < tree.size(); ++node) {
+    while (!open.empty() && open.back().end <= node) {
+      open.pop_back();
+    }
+    std::optional<treeceratops::node_id> parent;
+    if (!open.empty()) {
+      parent = open.back().node;
+    }
+    auto cursor = tree.at(node);
+    fn(cursor, parent, open.size());
+    open.push_back({node, node + cursor.subtree_size()});
+  }
+}
+
+template <class Tree>
+void dump_ast_with(DumpWriter& writer, Tree& tree, const TokenList& tokens,
+                   DumpFormat format) {
+  switch (format) {
+    case DumpFormat::Text:
+      walk(tree, [&](auto node, auto /*parent*/, std::size_t depth) {
+        dump_node_text(writer, *node, tokens, depth);
+      });
+      break;
+    case DumpFormat::Jsonl:
+      walk(tree, [&](auto node, auto parent, std::size_t depth) {
+        dump_node_jsonl(writer, *node, tokens, node.id(), parent, depth);
+      });
+      break;
+    case DumpFormat::Binary: {
+      std::uint32_t count = 0;
+      walk(tree, [&](auto /*node*/, auto /*parent*/, std::size_t /*depth*/) {
+        ++count;
+      });
+      writer.write(Ast_Dump_Magic);
+      writer.write_u32(Dump_Version);
+      writer.write_u32(count);
+      walk(tree, [&](auto node, auto /*parent*/, std::size_t /*depth*/) {
+        dump_node_binary(writer, *node, tokens, node.child_count());
+      });
+      break;
+    }
+  }
+}
+
+}  // namespace
+
+void DumpWriter::write_json_escaped(std::string_view str) {
+  for (char chr : str) {
+    switch (chr) {
+      case '"':
+        write("\\\"");
+        break;
+      case '\\':
+        write("\\\\");
+        break;
+      case '\n':
+        write("\\n");
+        break;
+      case '\r':
+        write("\\r");
+        break;
+      case '\t':
+        write("\\t");
+        break;
+      default:
+        if (static_cast<unsigned char>(chr) < 0x20) {
+          format("\\u{:04x}", static_cast<unsigned>(chr));
+        } else {
+          put(chr);
+        }
+    }
+  }
+}
+
+void DumpWriter::write_u32(std::uint32_t value) {
+  for (int byte = 0; byte < 4; ++byte) {
+    buffer_.push_back(static_cast<char>((value >> (8 * byte)) & 0xff));
+  }
+  maybe_flush();
+}
+
+void DumpWriter::write_u64(std::uint64_t value) {
+  for (int byte = 0; byte < 8; ++byte) {
+    buffer_.push_back(static_cast<char>((value >> (8 * byte)) & 0xff));
+  }
+  maybe_flush();
+}
+
+// Binary token dump: header, u32 token count, one record per token
+// (u8 kind, u32 line, u32 column, u32 identifier or literal index), then
+// the identifier, string literal and number literal tables.
+void dump_tokens(DumpWriter& writer, const TokenList& tokens,
+                 DumpFormat format) {
+  switch (format) {
+    case DumpFormat::Text:
+      for (const auto& tok : tokens) {
+        writer.append([&](auto out) { tokens.format_to(out, tok); });
+        writer.put('\n');
+      }
+      break;
+    case DumpFormat::Jsonl:
+      for (const auto& tok : tokens) {
+        writer.format(R"({{"kind":"{}","line":{},"column":{})",
+                      tok.kind.name(), tok.loc.line, tok.loc.column);
+        if (tok.kind == TokenKind::Identifier()) {
+          writer.write(R"(,"identifier":")");
+          writer.write_json_escaped(tokens.identifier(tok.identifier));
+          writer.put('"');
+        } else if (tok.kind == TokenKind::String()) {
+          writer.write(R"(,"literal":")");
+          writer.write_json_escaped(tokens.string_literal(tok.literal));
+          writer.put('"');
+        } else if (tok.kind == TokenKind::Number()) {
+          writer.format(R"(,"literal":{})", tokens.number_literal(tok.literal));
+        }
+        writer.write("}\n");
+      }
+      break;
+    case DumpFormat::Binary:
+      writer.write(Token_Dump_Magic);
+      writer.write_u32(Dump_Version);
+      writer.write_u32(static_cast<std::uint32_t>(tokens.size()));
+      for (const auto& tok : tokens) {
+        writer.write_u8(static_cast<std::uint8_t>(tok.kind.kind()));
+        writer.write_u32(static_cast<std::uint32_t>(tok.loc.line));
+        writer.write_u32(static_cast<std::uint32_t>(tok.loc.column));
+        writer.write_u32(tok.identifier);
+      }
+      dump_token_tables(writer, tokens);
+      break;
+  }
+}
+
+void dump_ast(DumpWriter& writer, const ExprTree& tree, const TokenList& tokens,
+              DumpFormat format) {
+  dump_ast_with(writer, tree, tokens, format);
+}
+
+void dump_ast(DumpWriter& writer, const FrozenExprTree& tree,
+              const TokenList& tokens, DumpFormat format) {
+  dump_ast_with(writer, tree, tokens, format);
+}
+
+}  // namespace loxt
@@ -0,0 +1,359 @@
+#include <format>
+#include <loxt/eval.hpp>
+#include <loxt/eval_cache.hpp>
+
+namespace loxt {
+
+namespace {
+
+// Marks a concatenation in progress, resetting the arena once the outermost
+// one is done with it.
+class ConcatScope {
+ public:
+  ConcatScope(StringArena& arena, bool& active)
+      : arena_{arena}, active_{active}, outermost_{!active} {
+    active_ = true;
+  }
+  ConcatScope(const ConcatScope&) = delete;
+  auto operator=(const ConcatScope&) -> ConcatScope& = delete;
+  ~ConcatScope() {
+    if (outermost_) {
+      active_ = false;
+      arena_.reset();
+    }
+  }
+
+ private:
+  StringArena& arena_;
+  bool& active_;
+  bool outermost_;
+};
+
+}  // namespace
+
+auto to_string(const Value& value) -> std::string {
+  if (value.is_nil()) {
+    return "nil";
+  }
+  if (value.is_bool()) {
+    return value.as_bool() ? "true" : "false";
+  }
+  if (value.is_number()) {
+    return std::format("{}", value.as_number());
+  }
+  return value.as_string();
+}
+
+auto apply(BinaryOpKind op, const Value& lhs, const Value& rhs) -> Value {
+  switch (op) {
+    case BinaryOpKind::Eq:
+      return Value{lhs == rhs};
+    case BinaryOpKind::Neq:
+      return Value{lhs != rhs};
+    case BinaryOpKind::Add:
+      if (lhs.is_string() && rhs.is_string()) {
+        return Value{lhs.as_string() + rhs.as_string()};
+      }
+      if (!lhs.is_number() || !rhs.is_number()) {
+        throw "Operands must be two numbers or two strings";
+      }
+      return Value{lhs.as_number() + rhs.as_number()};
+    default:
+      break;
+  }
+
+  if (!lhs.is_number() || !rhs.is_number()) {
+    throw "Operands must be numbers";
+  }
+  return numeric(op, lhs.as_number(), rhs.as_number());
+}
+
+auto numeric(BinaryOpKind op, double left, double right) -> Value {
+  switch (op) {
+    case BinaryOpKind::Add:
+      return Value{left + right};
+    case BinaryOpKind::Gt:
+      return Value{left > right};
+    case BinaryOpKind::Ge:
+      return Value{left >= right};
+    case BinaryOpKind::Lt:
+      return Value{left < right};
+    case BinaryOpKind::Le:
+      return Value{left <= right};
+    case BinaryOpKind::Minus:
+      return Value{left - right};
+    case BinaryOpKind::Div:
+      return Value{left / right};
+    case BinaryOpKind::Mul:
+      return Value{left * right};
+    default:
+      throw "Unknown binary operator";
+  }
+}
+
+auto apply(UnaryOpKind op, const Value& operand) -> Value {
+  switch (op) {
+    case UnaryOpKind::Not:
+      return Value{!operand.truthy()};
+    case UnaryOpKind::Neg:
+      if (!operand.is_number()) {
+        throw "Operand must be a number";
+      }
+      return Value{-operand.as_number()};
+  }
+  throw "Unknown unary operator";
+}
+
+void Evaluator::bind(std::string_view name, Value value) {
+  if (auto ident = tokens_.find_identifier(name)) {
+    bind(*ident, std::move(value));
+  }
+}
+
+auto Evaluator::evaluate(const ExprTree& tree) -> Value {
+  if (cache_ != nullptr) {
+    index_pure_subtrees(tree);
+  }
+  return evaluate(tree.begin());
+}
+
+auto Evaluator::evaluate_all(const ExprTree& tree) -> std::vector<Value> {
+  if (cache_ != nullptr) {
+    index_pure_subtrees(tree);
+  }
+  auto root = tree.begin();
+  std::vector<Value> values;
+  values.reserve(root.child_count());
+  for (std::size_t idx = 0; idx < root.child_count(); ++idx) {
+    values.push_back(evaluate(root.child(idx)));
+  }
+  return values;
+}
+
+auto Evaluator::evaluate(ExprTree::const_iterator node) -> Value {
+  return evaluate_node(node);
+}
+
+auto Evaluator::evaluate(const FrozenExprTree& tree) -> Value {
+  return evaluate_node(tree.root());
+}
+
+void Evaluator::index_pure_subtrees(const ExprTree& tree) {
+  if (indexed_ == &tree && indexed_generation_ == tree.generation()) {
+    return;
+  }
+  indexed_ = &tree;
+  indexed_generation_ = tree.generation();
+  keys_.clear();
+
+  std::vector<ExprTree::const_iterator> order;
+  std::vector<ExprTree::const_iterator> stack{tree.begin()};
+  while (!stack.empty()) {
+    auto node = stack.back();
+    stack.pop_back();
+    order.push_back(node);
+    for (std::size_t idx = 0; idx < node.child_count(); ++idx) {
+      stack.push_back(node.child(idx));
+    }
+  }
+
+  // Children come after their parent in `order`, so walking it backwards
+  // settles every child before its parent.
+  std::vector<bool> pure(tree.size());
+  for (auto node = order.rbegin(); node != order.rend(); ++node) {
+    bool is_pure = (*node)->kind != ExprKind::Variable;
+    for (std::size_t idx = 0; is_pure && idx < node->child_count(); ++idx) {
+      is_pure = pure[node->child(idx).id()];
+    }
+    pure[node->id()] = is_pure;
+  }
+
+  // Only the outermost pure operators are worth a lookup; anything below
+  // them is covered by their entry.
+  stack.assign(1, tree.begin());
+  while (!stack.empty()) {
+    auto node = stack.back();
+    stack.pop_back();
+    auto kind = node->kind;
+    if (pure[node.id()] &&
+        (kind == ExprKind::Binary || kind == ExprKind::Unary)) {
+      keys_.emplace(node.id(), *structural_key(node, tokens_));
+      continue;
+    }
+    for (std::size_t idx = 0; idx < node.child_count(); ++idx) {
+      stack.push_back(node.child(idx));
+    }
+  }
+}
+
+auto Evaluator::cache_key(ExprTree::const_iterator node) const
+    -> const std::string* {
+  // Node ids are only meaningful for the indexed tree.
+  if (cache_ != nullptr && !keys_.empty() && node.id() < indexed_->size() &&
+      &*node == &(*indexed_)[node.id()]) {
+    if (auto key = keys_.find(node.id()); key != keys_.end()) {
+      return &key->second;
+    }
+  }
+  return nullptr;
+}
+
+auto Evaluator::numeric_operands(ExprTree::const_iterator node) const
+    -> bool {
+  return types_ != nullptr &&
+         (*types_)[node.child(0).id()] == StaticType::Number &&
+         (*types_)[node.child(1).id()] == StaticType::Number;
+}
+
+template <class Cursor>
+auto Evaluator::evaluate_node(Cursor node) -> Value {
+  if (const auto* key = cache_key(node)) {
+    if (auto cached = cache_->find(*key)) {
+      return *std::move(cached);
+    }
+    auto value = evaluate_uncached(node);
+    cache_->insert(*key, value);
+    return value;
+  }
+  return evaluate_uncached(node);
+}
+
+template <class Cursor>
+auto Evaluator::evaluate_uncached(Cursor node) -> Value {
+  const auto& data = *node;
+  switch (data.kind) {
+    case ExprKind::Root:
+    case ExprKind::Paren:
+      return evaluate_node(node.child(0));
+    case ExprKind::Binary:
+      return binary(node);
+    case ExprKind::Unary:
+      return apply(data.uOp, evaluate_node(node.child(0)));
+    case ExprKind::Literal:
+      return literal(data);
+    case ExprKind::Nil:
+      return Value{};
+    case ExprKind::Variable: {
+      if (data.slot >= slots_.size() || !slots_[data.slot]) {
+        throw "Undefined variable";
+      }
+      return *slots_[data.slot];
+    }
+  }
+  throw "Unknown expression kind";
+}
+
+template <class Cursor>
+auto Evaluator::binary(Cursor node) -> Value {
+  auto op = node->bOp;
+  if (op != BinaryOpKind::And && op != BinaryOpKind::Or &&
+      op != BinaryOpKind::Eq && op != BinaryOpKind::Neq &&
+      numeric_operands(node)) {
+    // Proven numbers, so no operand tag checks.
+    return numeric(op, evaluate_node(node.child(0)).as_number(),
+                   evaluate_node(node.child(1)).as_number());
+  }
+  if (op == BinaryOpKind::Add) {
+    return add(node);
+  }
+  auto lhs = evaluate_node(node.child(0));
+  // and/or short circuit and yield an operand, not a bool.
+  if (op == BinaryOpKind::And) {
+    return lhs.truthy() ? evaluate_node(node.child(1)) : lhs;
+  }
+  if (op == BinaryOpKind::Or) {
+    return lhs.truthy() ? lhs : evaluate_node(node.child(1));
+  }
+
+  return apply(op, lhs, evaluate_node(node.child(1)));
+}
+
+template <class Cursor>
+auto Evaluator::add(Cursor node) -> Value {
+  ConcatScope scope{arena_, concatenating_};
+  auto sum = add_operands(node);
+  if (const auto* rope = std::get_if<Rope>(&sum)) {
+    return Value{rope->flatten()};
+  }
+  return std::get<Value>(std::move(sum));
+}
+
+template <class Cursor>
+auto Evaluator::add_operands(Cursor node) -> Operand {
+  // `+` is left associative, so generated chains nest down the left. Walk
+  // that spine with a loop and fold back up it, left operand first.
+  std::vector<Cursor> spine{node};
+  for (auto lhs = node.child(0);
+       lhs->kind == ExprKind::Binary && lhs->bOp == BinaryOpKind::Add &&
+       cache_key(lhs) == nullptr;
+       lhs = lhs.child(0)) {
+    spine.push_back(lhs);
+  }
+
+  auto sum = concat_operand(spine.back().child(0));
+  for (auto add = spine.rbegin(); add != spine.rend(); ++add) {
+    auto rhs = concat_operand(add->child(1));
+    const auto* left = std::get_if<Rope>(&sum);
+    const auto* right = std::get_if<Rope>(&rhs);
+    if (left != nullptr && right != nullptr) {
+      sum = Rope::concat(*left, *right, arena_);
+    } else if (left != nullptr || right != nullptr) {
+      throw "Operands must be two numbers or two strings";
+    } else {
+      sum = apply(BinaryOpKind::Add, std::get<Value>(sum),
+                  std::get<Value>(rhs));
+    }
+  }
+  return sum;
+}
+
+template <class Cursor>
+auto Evaluator::concat_operand(Cursor node) -> Operand {
+  const auto& data = *node;
+  switch (data.kind) {
+    case ExprKind::Paren:
+      return concat_operand(node.child(0));
+    case ExprKind::Binary:
+      // Nested additions join this rope rather than being flattened, unless
+      // their value comes from the cache.
+      if (data.bOp == BinaryOpKind::Add && cache_key(node) == nullptr) {
+        return add_operands(node);
+      }
+      break;
+    case ExprKind::Literal:
+      if (data.literalKind == LiteralKind::String) {
+        return Rope::view(tokens_.string_literal(data.literalVal), arena_);
+      }
+      break;
+    case ExprKind::Variable:
+      // Bindings cannot change while evaluating, so their strings are
+      // shared too.
+      if (data.slot < slots_.size() && slots_[data.slot] &&
+          slots_[data.slot]->is_string()) {
+        return Rope::view(slots_[data.slot]->as_string(), arena_);
+      }
+      break;
+    default:
+      break;
+  }
+  auto value = evaluate_node(node);
+  if (value.is_string()) {
+    return Rope::copy(value.as_string(), arena_);
+  }
+  return value;
+}
+
+auto Evaluator::literal(const ExprData& data) const -> Value {
+  switch (data.literalKind) {
+    case LiteralKind::Number:
+      return Value{
+          static_cast<double>(tokens_.number_literal(data.literalVal))};
+    case LiteralKind::String:
+      return Value{tokens_.string_literal(data.literalVal)};
+    case LiteralKind::Bool:
+      return Value{data.boolVal};
+  }
+  throw "Unknown literal kind";
+}
+
+}  // namespace loxt
@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <functional>
+#include <loxt/eval_cache.hpp>
+
+namespace loxt {
+
+namespace {
+
+constexpr std::size_t Shared_Capacity = 4096;
+
+template <class T>
+void append(std::string& key, const T& value) {
+  key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+}  // namespace
+
+auto structural_key(ExprTree::const_iterator node, const TokenList& tokens)
+    -> std::optional<std::string> {
+  std::string key;
+  std::vector<ExprTree::const_iterator> stack{node};
+  while (!stack.empty()) {
+    auto current = stack.back();
+    stack.pop_back();
+    const auto& data = *current;
+    key.push_back(static_cast<char>(data.kind));
+    switch (data.kind) {
+      case ExprKind::Variable:
+        return std::nullopt;
+      case ExprKind::Binary:
+        key.push_back(static_cast<char>(data.bOp));
+        break;
+      case ExprKind::Unary:
+        key.push_back(static_cast<char>(data.uOp));
+        break;
+      case ExprKind::Literal:
+        key.push_back(static_cast<char>(data.literalKind));
+        if (data.literalKind == LiteralKind::Bool) {
+          key.push_back(data.boolVal ? 1 : 0);
+        } else if (data.literalKind == LiteralKind::Number) {
+          append(key, tokens.number_literal(data.literalVal));
+        } else {
+          const auto& str = tokens.string_literal(data.literalVal);
+          append(key, str.size());
+          key += str;
+        }
+        break;
+      default:
+        break;
+    }
+    for (auto idx = current.child_count(); idx > 0; --idx) {
+      stack.push_back(current.child(idx - 1));
+    }
+  }
+  return key;
+}
+
+EvalCache::EvalCache(std::size_t capacity) {
+  // Never more shards than entries, so the total stays within capacity.
+  std::size_t shards = std::clamp<std::size_t>(capacity, 1, Max_Shards);
+  shards_.reserve(shards);
+  for (std::size_t idx = 0; idx < shards; ++idx) {
+    auto& shard = shards_.emplace_back(std::make_unique<Shard>());
+    shard->capacity = capacity / shards;
+  }
+}
+
+auto EvalCache::shared() -> EvalCache& {
+  static EvalCache cache{Shared_Capacity};
+  return cache;
+}
+
+auto EvalCache::shard_for(const std::string& key) -> Shard& {
+  return *shards_[std::hash<std::string>{}(key) % shards_.size()];
+}
+
+auto EvalCache::find(const std::string& key) -> std::optional<Value> {
+  auto& shard = shard_for(key);
+  std::scoped_lock lock{shard.mutex};
+  auto found = shard.index.find(key);
+  if (found == shard.index.end()) {
+    ++misses_;
+    return std::nullopt;
+  }
+  ++hits_;
+  shard.entries.splice(shard.entries.begin(), shard.entries, found->second);
+  return found->second->second;
+}
+
+void EvalCache::insert(const std::string& key, const Value& value) {
+  auto& shard = shard_for(key);
+  std::scoped_lock lock{shard.mutex};
+  if (shard.capacity == 0 || shard.index.contains(key)) {
+    return;
+  }
+  if (shard.entries.size() == shard.capacity) {
+    shard.index.erase(shard.entries.back().first);
+    shard.entries.pop_back();
+  }
+  shard.entries.emplace_front(key, value);
+  shard.index.emplace(shard.entries.front().first, shard.entries.begin());
+}
+
+auto EvalCache::capacity() const -> std::size_t {
+  std::size_t total = 0;
+  for (const auto& shard : shards_) {
+    total += shard->capacity;
+  }
+  return total;
+}
+
+auto EvalCache::size() const -> std::size_t {
+  std::size_t total = 0;
+  for (const auto& shard : shards_) {
+    std::scoped_lock lock{shard->mutex};
+    total += shard->entries.size();
+  }
+  return total;
+}
+
+}  // namespace loxt
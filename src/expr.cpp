@@ -1,4 +1,6 @@
 #include <loxt/ast/expr.hpp>
+#include <utility>
+#include <vector>
 
 namespace loxt {
 
@@ -33,6 +35,17 @@ auto to_string(BinaryOpKind kind) -> std::string {
   throw "Unknown Binary Op Kind";
 }
 
+auto to_string(UnaryOpKind kind) -> std::string {
+  switch (kind) {
+    case UnaryOpKind::Not:
+      return "Not";
+    case UnaryOpKind::Neg:
+      return "Neg";
+  }
+
+  throw "Unknown Unary Op Kind";
+}
+
 void Expr::accept(Visitor& visitor) {
   switch (node_->kind) {
     case ExprKind::Root:
@@ -63,8 +76,30 @@ void Expr::accept(Visitor& visitor) {
     case ExprKind::Nil:
       visitor.visit(*static_cast<NilExpr*>(this));
       break;
+    case ExprKind::Variable:
+      visitor.visit(*static_cast<VariableExpr*>(this));
+      break;
     default:
       break;
   }
 }
+
+void Expr::walk(Visitor& visitor) {
+  // A node is pushed once to be visited and again, marked, to be left.
+  std::vector<std::pair<ExprTree::const_iterator, bool>> stack{{node_, false}};
+  while (!stack.empty()) {
+    auto [node, leaving] = stack.back();
+    stack.pop_back();
+    Expr expr{tree_, node};
+    if (leaving) {
+      visitor.leave(expr);
+      continue;
+    }
+    expr.accept(visitor);
+    stack.emplace_back(node, true);
+    for (auto idx = node.child_count(); idx > 0; --idx) {
+      stack.emplace_back(node.child(idx - 1), false);
+    }
+  }
+}
 }  // namespace loxt
\ No newline at end of file
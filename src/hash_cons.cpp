@@ -0,0 +1,140 @@
+#include <loxt/ast/hash_cons.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace loxt {
+
+namespace {
+
+using treeceratops::node_id;
+
+struct NodeKey {
+  ExprKind kind;
+  // Operator or literal kind, depending on `kind`.
+  std::uint8_t tag = 0;
+  // Bool or number literal value.
+  std::uint64_t scalar = 0;
+  // String literal contents.
+  std::string_view text;
+  std::vector<node_id> children;
+
+  auto operator==(const NodeKey&) const -> bool = default;
+};
+
+struct NodeKeyHash {
+  auto operator()(const NodeKey& key) const -> std::size_t {
+    std::size_t hash = static_cast<std::size_t>(key.kind) << 8 | key.tag;
+    auto mix = [&hash](std::size_t value) {
+      hash ^= value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    };
+    mix(key.scalar);
+    mix(std::hash<std::string_view>{}(key.text));
+    for (auto child : key.children) {
+      mix(child);
+    }
+    return hash;
+  }
+};
+
+auto make_key(const ExprData& data, const TokenList& tokens) -> NodeKey {
+  NodeKey key{data.kind, 0, 0, {}, {}};
+  switch (data.kind) {
+    case ExprKind::Binary:
+      key.tag = static_cast<std::uint8_t>(data.bOp);
+      break;
+    case ExprKind::Unary:
+      key.tag = static_cast<std::uint8_t>(data.uOp);
+      break;
+    case ExprKind::Literal:
+      key.tag = static_cast<std::uint8_t>(data.literalKind);
+      switch (data.literalKind) {
+        case LiteralKind::String:
+          key.text = tokens.string_literal(data.literalVal);
+          break;
+        case LiteralKind::Number:
+          key.scalar = tokens.number_literal(data.literalVal);
+          break;
+        case LiteralKind::Bool:
+          key.scalar = data.boolVal ? 1 : 0;
+          break;
+      }
+      break;
+    case ExprKind::Variable:
+      key.scalar = data.identifier;
+      break;
+    case ExprKind::Root:
+    case ExprKind::Paren:
+    case ExprKind::Nil:
+      break;
+  }
+  return key;
+}
+
+}  // namespace
+
+auto hash_cons(const ExprTree& tree, const TokenList& tokens) -> ExprTree {
+  ExprTree result;
+  auto root = tree.root();
+  if (!root) {
+    return result;
+  }
+  const auto& nodes = tree.nodes();
+
+  // Reverse pre-order visits every child before its parent.
+  std::vector<node_id> order;
+  order.reserve(nodes.size());
+  std::vector<node_id> stack{*root};
+  while (!stack.empty()) {
+    node_id node = stack.back();
+    stack.pop_back();
+    order.push_back(node);
+    for (auto child : nodes[node].children) {
+      stack.push_back(child);
+    }
+  }
+
+  std::vector<ExprTree::node_type> merged;
+  std::vector<node_id> remap(nodes.size());
+  std::unordered_map<NodeKey, node_id, NodeKeyHash> unique;
+  unique.reserve(order.size());
+  for (auto node = order.rbegin(); node != order.rend(); ++node) {
+    auto key = make_key(nodes[*node].data, tokens);
+    key.children.reserve(nodes[*node].children.size());
+    for (auto child : nodes[*node].children) {
+      key.children.push_back(remap[child]);
+    }
+    auto [slot, inserted] = unique.try_emplace(std::move(key), merged.size());
+    if (inserted) {
+      merged.push_back(
+          {{}, {}, {}, nodes[*node].data, slot->first.children});
+    }
+    remap[*node] = slot->second;
+  }
+
+  // Link every node to the first parent that claims it, so a tree without
+  // duplicates comes out fully linked.
+  for (node_id parent = 0; parent < merged.size(); ++parent) {
+    std::optional<node_id> prev;
+    for (auto child : merged[parent].children) {
+      if (merged[child].parent) {
+        continue;
+      }
+      merged[child].parent = parent;
+      merged[child].prev = prev;
+      if (prev) {
+        merged[*prev].next = child;
+      }
+      prev = child;
+    }
+  }
+
+  result.assign(std::move(merged), remap[*root]);
+  return result;
+}
+
+}  // namespace loxt
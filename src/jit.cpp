@@ -0,0 +1,373 @@
+#include <loxt/jit.hpp>
+
+#if !defined(LOXT_NO_JIT) && defined(__x86_64__) && defined(__unix__)
+#define LOXT_HAS_JIT 1
+#include <sys/mman.h>
+#endif
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+namespace loxt {
+
+namespace {
+
+// xmm0 to xmm14 hold intermediate values as a stack; xmm15 is scratch.
+constexpr unsigned Value_Registers = 15;
+constexpr unsigned Scratch = 15;
+constexpr unsigned Rdi = 7;
+
+// Operand order of cmpsd's predicate immediate.
+enum class Predicate : std::uint8_t { Eq = 0, Lt = 1, Le = 2, Neq = 4 };
+
+// Emits the few x86-64 instructions the JIT needs. Registers are numbered
+// as in the encoding, so xmm8 and above set a REX bit.
+class Assembler {
+ public:
+  [[nodiscard]] auto code() const -> const std::vector<std::uint8_t>& {
+    return code_;
+  }
+
+  // addsd, subsd, mulsd, divsd, maxsd and cmpsd: F2 0F op /r.
+  void scalar(std::uint8_t opcode, unsigned dst, unsigned src) {
+    sse(0xF2, opcode, dst, src);
+  }
+  // andpd, xorpd and movapd: 66 0F op /r.
+  void packed(std::uint8_t opcode, unsigned dst, unsigned src) {
+    sse(0x66, opcode, dst, src);
+  }
+  void compare(Predicate predicate, unsigned dst, unsigned src) {
+    scalar(0xC2, dst, src);
+    emit(static_cast<std::uint8_t>(predicate));
+  }
+
+  // mov rax, imm64; movq xmm, rax.
+  void constant(unsigned dst, double value) {
+    emit(0x48);
+    emit(0xB8);
+    auto bits = std::bit_cast<std::uint64_t>(value);
+    for (int byte = 0; byte < 8; ++byte) {
+      emit(static_cast<std::uint8_t>(bits >> (8 * byte)));
+    }
+    emit(0x66);
+    rex(true, dst, 0);
+    emit(0x0F);
+    emit(0x6E);
+    modrm(3, dst, 0);
+  }
+
+  // movsd xmm, [rdi + disp32].
+  void load(unsigned dst, std::uint32_t offset) {
+    emit(0xF2);
+    rex(false, dst, Rdi);
+    emit(0x0F);
+    emit(0x10);
+    modrm(2, dst, Rdi);
+    for (int byte = 0; byte < 4; ++byte) {
+      emit(static_cast<std::uint8_t>(offset >> (8 * byte)));
+    }
+  }
+
+  void ret() { emit(0xC3); }
+
+ private:
+  void emit(std::uint8_t byte) { code_.push_back(byte); }
+
+  void rex(bool wide, unsigned reg, unsigned rm) {
+    auto byte = static_cast<std::uint8_t>(0x40 | (wide ? 8 : 0) |
+                                          ((reg >> 3) << 2) | (rm >> 3));
+    if (byte != 0x40) {
+      emit(byte);
+    }
+  }
+
+  void modrm(unsigned mod, unsigned reg, unsigned rm) {
+    emit(static_cast<std::uint8_t>((mod << 6) | ((reg & 7) << 3) | (rm & 7)));
+  }
+
+  // The mandatory prefix goes before REX.
+  void sse(std::uint8_t prefix, std::uint8_t opcode, unsigned dst,
+           unsigned src) {
+    emit(prefix);
+    rex(false, dst, src);
+    emit(0x0F);
+    emit(opcode);
+    modrm(3, dst, src);
+  }
+
+  std::vector<std::uint8_t> code_;
+};
+
+constexpr std::uint8_t Addsd = 0x58;
+constexpr std::uint8_t Mulsd = 0x59;
+constexpr std::uint8_t Subsd = 0x5C;
+constexpr std::uint8_t Divsd = 0x5E;
+constexpr std::uint8_t Maxsd = 0x5F;
+constexpr std::uint8_t Andpd = 0x54;
+constexpr std::uint8_t Xorpd = 0x57;
+constexpr std::uint8_t Movapd = 0x28;
+
+// Turns the all-ones or zero mask of a cmpsd into 1.0 or 0.0.
+void mask_to_bool(Assembler& as, unsigned reg) {
+  as.constant(Scratch, 1.0);
+  as.packed(Andpd, reg, Scratch);
+}
+
+// Code for a Binary node whose operands are in reg and reg + 1. Returns
+// false for operand types the generated code cannot handle.
+auto binary(Assembler& as, BinaryOpKind op, StaticType lhs, StaticType rhs,
+            unsigned reg) -> bool {
+  bool numbers = lhs == StaticType::Number && rhs == StaticType::Number;
+  bool bools = lhs == StaticType::Bool && rhs == StaticType::Bool;
+  unsigned next = reg + 1;
+  switch (op) {
+    case BinaryOpKind::Add:
+    case BinaryOpKind::Minus:
+    case BinaryOpKind::Mul:
+    case BinaryOpKind::Div: {
+      if (!numbers) {
+        return false;
+      }
+      auto opcode = op == BinaryOpKind::Add     ? Addsd
+                    : op == BinaryOpKind::Minus ? Subsd
+                    : op == BinaryOpKind::Mul   ? Mulsd
+                                                : Divsd;
+      as.scalar(opcode, reg, next);
+      return true;
+    }
+    case BinaryOpKind::Lt:
+    case BinaryOpKind::Le:
+      if (!numbers) {
+        return false;
+      }
+      as.compare(op == BinaryOpKind::Lt ? Predicate::Lt : Predicate::Le, reg,
+                 next);
+      mask_to_bool(as, reg);
+      return true;
+    case BinaryOpKind::Gt:
+    case BinaryOpKind::Ge:
+      // a > b as b < a, which is false for NaN like the interpreter.
+      if (!numbers) {
+        return false;
+      }
+      as.compare(op == BinaryOpKind::Gt ? Predicate::Lt : Predicate::Le, next,
+                 reg);
+      as.packed(Movapd, reg, next);
+      mask_to_bool(as, reg);
+      return true;
+    case BinaryOpKind::Eq:
+    case BinaryOpKind::Neq:
+      if (!numbers && !bools) {
+        return false;
+      }
+      as.compare(op == BinaryOpKind::Eq ? Predicate::Eq : Predicate::Neq, reg,
+                 next);
+      mask_to_bool(as, reg);
+      return true;
+    case BinaryOpKind::And:
+    case BinaryOpKind::Or:
+      // Operands cannot fail, so both always run; on 0 and 1 `and` is the
+      // product and `or` the maximum.
+      if (!bools) {
+        return false;
+      }
+      as.scalar(op == BinaryOpKind::And ? Mulsd : Maxsd, reg, next);
+      return true;
+  }
+  return false;
+}
+
+auto unary(Assembler& as, UnaryOpKind op, StaticType operand, unsigned reg)
+    -> bool {
+  if (op == UnaryOpKind::Neg) {
+    if (operand != StaticType::Number) {
+      return false;
+    }
+    as.constant(Scratch, -0.0);
+    as.packed(Xorpd, reg, Scratch);
+    return true;
+  }
+  if (operand == StaticType::Number) {
+    // Numbers are always truthy.
+    as.packed(Xorpd, reg, reg);
+    return true;
+  }
+  if (operand != StaticType::Bool) {
+    return false;
+  }
+  as.constant(Scratch, 1.0);
+  as.scalar(Subsd, Scratch, reg);
+  as.packed(Movapd, reg, Scratch);
+  return true;
+}
+
+// Copies code into a fresh executable mapping.
+auto install(const std::vector<std::uint8_t>& code) -> std::shared_ptr<void> {
+#ifdef LOXT_HAS_JIT
+  auto size = code.size();
+  void* memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) {
+    return nullptr;
+  }
+  std::memcpy(memory, code.data(), size);
+  if (::mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+    ::munmap(memory, size);
+    return nullptr;
+  }
+  return {memory, [size](void* mapped) { ::munmap(mapped, size); }};
+#else
+  (void)code;
+  return nullptr;
+#endif
+}
+
+}  // namespace
+
+auto jit_supported() -> bool {
+#ifdef LOXT_HAS_JIT
+  return true;
+#else
+  return false;
+#endif
+}
+
+void JitCompiler::declare(std::string_view name, StaticType type) {
+  if (auto ident = tokens_.find_identifier(name)) {
+    types_[*ident] = type;
+  }
+}
+
+auto JitCompiler::compile(const ExprTree& tree) -> std::optional<JitExpr> {
+  if (!jit_supported() || !tree.root() || tree.begin().child_count() != 1) {
+    return std::nullopt;
+  }
+  auto types = infer_types(tree, types_);
+  auto result = types[tree.begin().id()];
+  if (result != StaticType::Number && result != StaticType::Bool) {
+    return std::nullopt;
+  }
+
+  // Post-order, each node computed into the register above its left
+  // sibling's. `ready` marks a node whose operands are done.
+  struct Entry {
+    ExprTree::const_iterator node;
+    unsigned reg;
+    bool ready;
+  };
+  Assembler as;
+  std::vector<StaticType> slot_types;
+  std::vector<Entry> stack{{tree.begin(), 0, false}};
+  while (!stack.empty()) {
+    auto [node, reg, ready] = stack.back();
+    stack.pop_back();
+    const auto& data = *node;
+    auto type = [&](std::size_t idx) { return types[node.child(idx).id()]; };
+
+    switch (data.kind) {
+      case ExprKind::Root:
+      case ExprKind::Paren:
+        stack.push_back({node.child(0), reg, false});
+        break;
+      case ExprKind::Binary:
+        if (ready) {
+          if (!binary(as, data.bOp, type(0), type(1), reg)) {
+            return std::nullopt;
+          }
+          break;
+        }
+        if (reg + 1 >= Value_Registers) {
+          return std::nullopt;
+        }
+        stack.push_back({node, reg, true});
+        stack.push_back({node.child(1), reg + 1, false});
+        stack.push_back({node.child(0), reg, false});
+        break;
+      case ExprKind::Unary:
+        if (ready) {
+          if (!unary(as, data.uOp, type(0), reg)) {
+            return std::nullopt;
+          }
+          break;
+        }
+        stack.push_back({node, reg, true});
+        stack.push_back({node.child(0), reg, false});
+        break;
+      case ExprKind::Literal:
+        if (data.literalKind == LiteralKind::String) {
+          return std::nullopt;
+        }
+        as.constant(reg, data.literalKind == LiteralKind::Bool
+                             ? (data.boolVal ? 1.0 : 0.0)
+                             : static_cast<double>(
+                                   tokens_.number_literal(data.literalVal)));
+        break;
+      case ExprKind::Variable: {
+        auto var = types[node.id()];
+        if (data.slot == Unresolved_Slot ||
+            (var != StaticType::Number && var != StaticType::Bool) ||
+            data.slot >= (std::uint32_t{1} << 28)) {
+          return std::nullopt;
+        }
+        if (slot_types.size() <= data.slot) {
+          slot_types.resize(data.slot + 1, StaticType::Any);
+        }
+        slot_types[data.slot] = var;
+        as.load(reg, data.slot * sizeof(double));
+        break;
+      }
+      case ExprKind::Nil:
+        return std::nullopt;
+    }
+  }
+  as.ret();
+
+  auto code = install(as.code());
+  if (!code) {
+    return std::nullopt;
+  }
+  auto fn = reinterpret_cast<JitExpr::Fn>(code.get());
+  return JitExpr{std::move(code), fn, result, std::move(slot_types)};
+}
+
+auto TieredExpr::evaluate(std::span<const Value> env) -> Value {
+  if (env.size() < layout_.size()) {
+    throw "Environment has fewer values than the expression has slots";
+  }
+  if (!jit_) {
+    if (++count_ == threshold_) {
+      try {
+        jit_ = compiler_.compile(tree_);
+      } catch (const char*) {
+        // Left for the interpreter to report, if evaluation reaches it.
+      }
+    }
+    return interpret(env);
+  }
+
+  const auto& slot_types = jit_->slot_types();
+  for (std::size_t slot = 0; slot < slot_types.size(); ++slot) {
+    const auto& value = env[slot];
+    if (slot_types[slot] == StaticType::Number && value.is_number()) {
+      numbers_[slot] = value.as_number();
+    } else if (slot_types[slot] == StaticType::Bool && value.is_bool()) {
+      numbers_[slot] = value.as_bool() ? 1.0 : 0.0;
+    } else if (slot_types[slot] != StaticType::Any) {
+      return interpret(env);
+    }
+  }
+  double result = (*jit_)(numbers_.data());
+  return jit_->type() == StaticType::Bool ? Value{result != 0.0}
+                                          : Value{result};
+}
+
+auto TieredExpr::interpret(std::span<const Value> env) -> Value {
+  for (std::size_t slot = 0; slot < layout_.size(); ++slot) {
+    evaluator_.bind(layout_.identifier(static_cast<Slot>(slot)), env[slot]);
+  }
+  return evaluator_.evaluate(frozen_);
+}
+
+}  // namespace loxt
@@ -1,31 +1,27 @@
-#include <cctype>
 #include <format>
 #include <loxt/lexer.hpp>
-#include <print>
+#include <loxt/scanner.hpp>
+#include <loxt/unicode.hpp>
 
 namespace loxt {
 
 namespace {
-auto report(SourceLocation loc, const std::string& error_text) -> void {
-  std::println("{}:{}: Error: {}\n", loc.line, loc.column, error_text);
-}
-
 const std::string TokenNames[] = {
 #define LOXT_TOKEN(name) #name,
 #include <loxt/token_kinds.def>
 };
 
-const std::unordered_map<std::string_view, const TokenKind> Keywords = {
-#define LOXT_KEYWORD_TOKEN(name, spelling) {spelling, TokenKind::name()},
-#include <loxt/token_kinds.def>
-};
+const std::string Empty_Source;
+
 }  // namespace
 
 auto SourceLocation::operator++() -> SourceLocation& {
-  if (*pos++ == '\n') {
+  char chr = *pos++;
+  if (chr == '\n') {
     column = 1;
     ++line;
-  } else {
+  } else if ((static_cast<unsigned char>(chr) & 0xc0U) != 0x80U) {
+    // Columns count code points, so UTF-8 continuation bytes are skipped.
     ++column;
   }
   return *this;
@@ -42,170 +38,145 @@ auto TokenKind::name() const -> const std::string& {
 }
 
 auto TokenList::to_string(const Token& token) const -> std::string {
-  std::string str = "{kind: " + token.kind.name() +
-                    ", line: " + std::to_string(token.loc.line) +
-                    ", column: " + std::to_string(token.loc.column);
+  std::string str;
+  format_to(std::back_inserter(str), token);
+  return str;
+}
 
-  if (token.kind == TokenKind::Identifier()) {
-    str += ", identifier: " + std::string(identifier(token.identifier));
+inline void advance(SourceLocation& loc, std::size_t count) {
+  for (; count > 0; --count) {
+    ++loc;
   }
+}
+
+// Heap bytes behind a string, which is none while it fits the small
+// string buffer inside the object.
+inline auto heap_bytes(const std::string& str) -> std::size_t {
+  const auto* object = reinterpret_cast<const char*>(&str);
+  bool inline_buffer =
+      str.data() >= object && str.data() < object + sizeof(str);
+  return inline_buffer ? 0 : str.capacity() + 1;
+}
+
+auto TokenList::memory_usage() const -> TokenListMemory {
+  TokenListMemory usage;
+  usage.tokens = m_Tokens.memory_usage();
+
+  using MapNode = std::pair<void*, decltype(m_IdentifierMap)::value_type>;
+  usage.interner =
+      m_IdentifierMap.bucket_count() * sizeof(void*) +
+      m_IdentifierMap.size() * (sizeof(MapNode) + sizeof(std::size_t)) +
+      m_Identifiers.capacity() * sizeof(std::string_view);
 
-  if (token.kind == TokenKind::String()) {
-    str += ", literal: \"" + string_literal(token.literal) + "\"";
+  usage.literals = m_StringLiteral.capacity() * sizeof(std::string) +
+                   m_NumberLiteral.capacity() * sizeof(uint64_t);
+  for (const auto& literal : m_StringLiteral) {
+    usage.literals += heap_bytes(literal);
   }
 
-  if (token.kind == TokenKind::Number()) {
-    str += ", literal: " + std::to_string(number_literal(token.literal));
+  usage.diagnostics = m_Diagnostics.capacity() * sizeof(Diagnostic);
+  for (const auto& diag : m_Diagnostics) {
+    usage.diagnostics += heap_bytes(diag.message);
   }
+  return usage;
+}
 
-  str += "}";
-  return str;
+TokenList::TokenList(std::size_t expected_tokens)
+    : m_Tokens(expected_tokens), m_Source(&Empty_Source) {}
+
+auto lex(const std::string& source) -> std::shared_ptr<TokenList> {
+  auto list =
+      std::shared_ptr<TokenList>(new TokenList(estimate_tokens(source)));
+  list->lex_source(source);
+  return list;
 }
 
-inline auto match(char expected, const std::string& source, SourceLocation& loc)
-    -> bool {
-  if (loc.pos == source.end()) {
-    return false;
+auto lex_batch(std::span<const std::string> sources) -> TokenBatch {
+  std::size_t expected = 0;
+  for (const auto& source : sources) {
+    expected += estimate_tokens(source);
   }
-  if (*loc.pos != expected) {
-    return false;
+  TokenBatch batch{std::shared_ptr<TokenList>(new TokenList(expected)), {}, {}};
+  batch.ranges.reserve(sources.size());
+  batch.diagnostics.reserve(sources.size());
+  for (const auto& source : sources) {
+    std::size_t begin = batch.tokens->size();
+    batch.diagnostics.push_back(batch.tokens->m_Diagnostics.size());
+    batch.tokens->lex_source(source);
+    batch.ranges.push_back({begin, batch.tokens->size()});
   }
-  ++loc;
-  return true;
+  return batch;
 }
 
-auto lex(const std::string& source) -> std::shared_ptr<TokenList> {
-  auto list = std::shared_ptr<TokenList>(new TokenList(source));
+void TokenList::lex_source(const std::string& source) {
+  m_Source = &source;
 
   SourceLocation loc{.line = 1, .column = 1, .pos = source.begin()};
 
-  while (loc.pos != source.end()) {
+  // Everything past the first malformed byte is dropped, so the loop below
+  // only ever sees well formed UTF-8.
+  auto end = source.end();
+  if (auto bad = validate_utf8(source); bad != std::string_view::npos) {
+    end = source.begin() + static_cast<std::ptrdiff_t>(bad);
+    SourceLocation bad_loc = loc;
+    while (bad_loc.pos != end) {
+      ++bad_loc;
+    }
+    report(bad_loc, "Invalid UTF-8 sequence");
+  }
+
+  auto ident_char = [](std::string_view rest, bool start) -> std::size_t {
+    auto decoded = decode_utf8(rest);
+    bool matches = start ? is_xid_start(decoded.code_point)
+                         : is_xid_continue(decoded.code_point);
+    return decoded.length != 0 && matches ? decoded.length : 0;
+  };
+  std::string_view text{source.data(),
+                        static_cast<std::size_t>(end - source.begin())};
+  while (loc.pos != end) {
+    auto offset = static_cast<std::size_t>(loc.pos - source.begin());
+    auto token = scan_token(text.substr(offset), ident_char);
     SourceLocation start_loc = loc;
-    char chr = *(loc++).pos;
-    switch (chr) {
-      case '(':
-        list->m_Tokens.emplace_back(TokenKind::LeftParen(), start_loc, 0);
-        break;
-      case ')':
-        list->m_Tokens.emplace_back(TokenKind::RightParen(), start_loc, 0);
-        break;
-      case '{':
-        list->m_Tokens.emplace_back(TokenKind::LeftBrace(), start_loc, 0);
-        break;
-      case '}':
-        list->m_Tokens.emplace_back(TokenKind::RightBrace(), start_loc, 0);
-        break;
-      case ',':
-        list->m_Tokens.emplace_back(TokenKind::Comma(), start_loc, 0);
-        break;
-      case '.':
-        list->m_Tokens.emplace_back(TokenKind::Period(), start_loc, 0);
-        break;
-      case '-':
-        list->m_Tokens.emplace_back(TokenKind::Minus(), start_loc, 0);
-        break;
-      case '+':
-        list->m_Tokens.emplace_back(TokenKind::Plus(), start_loc, 0);
-        break;
-      case ';':
-        list->m_Tokens.emplace_back(TokenKind::SemiColon(), start_loc, 0);
-        break;
-      case '*':
-        list->m_Tokens.emplace_back(TokenKind::Asterisk(), start_loc, 0);
-        break;
-      case '!':
-        list->m_Tokens.emplace_back(match('=', source, loc)
-                                        ? TokenKind::BangEqual()
-                                        : TokenKind::Bang(),
-                                    start_loc, 0);
-        break;
-      case '=':
-        list->m_Tokens.emplace_back(match('=', source, loc)
-                                        ? TokenKind::EqualEqual()
-                                        : TokenKind::Equal(),
-                                    start_loc, 0);
-        break;
-      case '<':
-        list->m_Tokens.emplace_back(match('=', source, loc)
-                                        ? TokenKind::LessEqual()
-                                        : TokenKind::Less(),
-                                    start_loc, 0);
-        break;
-      case '>':
-        list->m_Tokens.emplace_back(match('=', source, loc)
-                                        ? TokenKind::GreaterEqual()
-                                        : TokenKind::Greater(),
-                                    start_loc, 0);
-        break;
-      case '/':
-        if (match('/', source, loc)) {
-          while (loc.pos != source.end() && *loc.pos != '\n') {
-            ++loc;
-          }
+    advance(loc, token.length);
+    if (!token.kind) {
+      continue;
+    }
+
+    unsigned int extra = 0;
+    std::string_view spelling{text.substr(offset, token.length)};
+    switch (token.kind->kind()) {
+      case TokenKind::Kind::Error:
+        if (token.error == ScanError::Unrecognized_Character) {
+          report(start_loc,
+                 std::format("{} '{}'", scan_error_message(token.error),
+                             spelling));
         } else {
-          list->m_Tokens.emplace_back(TokenKind::BackSlash(), start_loc, 0);
+          report(start_loc, scan_error_message(token.error));
         }
         break;
-      case '"':
-        while (loc.pos != source.end() && *loc.pos != '"') {
-          ++loc;
-        }
-
-        if (loc.pos == source.end()) {
-          list->m_Tokens.emplace_back(TokenKind::Error(), start_loc, 0);
-          report(start_loc, "String is unterminated");
-          list->m_HasError = true;
-        } else {
-          ++loc;
-          list->m_Tokens.emplace_back(
-              TokenKind::String(), start_loc,
-              static_cast<Literal>(list->m_StringLiteral.size()));
-          list->m_StringLiteral.emplace_back(start_loc.pos + 1, loc.pos - 1);
+      case TokenKind::Kind::Number:
+        extra = static_cast<Literal>(m_NumberLiteral.size());
+        m_NumberLiteral.push_back(token.number);
+        break;
+      case TokenKind::Kind::String:
+        extra = static_cast<Literal>(m_StringLiteral.size());
+        m_StringLiteral.emplace_back(spelling.substr(1, spelling.size() - 2));
+        break;
+      case TokenKind::Kind::Identifier: {
+        auto [iter, inserted] = m_IdentifierMap.try_emplace(
+            spelling, static_cast<Identifier>(m_Identifiers.size()));
+        if (inserted) {
+          m_Identifiers.emplace_back(spelling);
         }
+        extra = iter->second;
         break;
+      }
       default:
-        if (static_cast<bool>(std::isdigit(chr))) {
-          while (loc.pos != source.end() &&
-                 static_cast<bool>(std::isdigit(*loc.pos))) {
-            ++loc;
-          }
-
-          list->m_Tokens.emplace_back(
-              TokenKind::Number(), start_loc,
-              static_cast<Literal>(list->m_NumberLiteral.size()));
-          list->m_NumberLiteral.emplace_back(
-              std::stoull(std::string(start_loc.pos, loc.pos)));
-        } else if (static_cast<bool>(std::isalpha(chr))) {
-          while (loc.pos != source.end() &&
-                 static_cast<bool>(std::isalnum(*loc.pos))) {
-            ++loc;
-          }
-
-          std::string_view identifier_str{start_loc.pos, loc.pos};
-          auto keyword_iter = Keywords.find(identifier_str);
-          if (keyword_iter == Keywords.end()) {
-            auto identifier_iter = list->m_IdentifierMap.find(identifier_str);
-            Identifier identifier = list->m_Identifiers.size();
-            if (identifier_iter == list->m_IdentifierMap.end()) {
-              list->m_IdentifierMap.emplace(identifier_str, identifier);
-              list->m_Identifiers.emplace_back(identifier_str);
-            } else {
-              identifier = identifier_iter->second;
-            }
-            list->m_Tokens.emplace_back(TokenKind::Identifier(), start_loc,
-                                        identifier);
-          } else {
-            list->m_Tokens.emplace_back(keyword_iter->second, start_loc, 0);
-          }
-        } else if (std::isspace(chr) == 0) {
-          list->m_Tokens.emplace_back(TokenKind::Error(), start_loc, 0);
-          report(start_loc, std::format("Unrecognized character '{}'", chr));
-          list->m_HasError = true;
-        }
+        break;
     }
+    m_Tokens.emplace_back(*token.kind, start_loc, extra);
   }
-  list->m_Tokens.emplace_back(TokenKind::Eof(), loc, 0);
-  return list;
+  m_Tokens.emplace_back(TokenKind::Eof(), loc, 0);
 }
 
 }  // namespace loxt
@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <loxt/parallel_parse.hpp>
+#include <loxt/parser.hpp>
+#include <optional>
+
+namespace loxt {
+
+namespace {
+
+using treeceratops::node_id;
+
+// Chunks per worker, so uneven statements still balance across the pool.
+constexpr std::size_t Chunks_Per_Worker = 4;
+
+// Cuts [0, size) into at most `count` ranges that each end one past a ';'
+// token, except the last which ends at Eof.
+auto chunk_bounds(const TokenList& tokens, std::size_t count)
+    -> std::vector<std::size_t> {
+  std::size_t eof = tokens.size() - 1;
+  std::size_t stride = std::max<std::size_t>(1, eof / count);
+  std::vector<std::size_t> bounds{0};
+  for (std::size_t chunk = 1; chunk < count; ++chunk) {
+    std::size_t pos = std::max(chunk * stride, bounds.back());
+    while (pos < eof && tokens[pos].kind != TokenKind::SemiColon()) {
+      ++pos;
+    }
+    if (pos >= eof) {
+      break;
+    }
+    if (pos + 1 > bounds.back()) {
+      bounds.push_back(pos + 1);
+    }
+  }
+  bounds.push_back(eof);
+  return bounds;
+}
+
+}  // namespace
+
+auto parse_statements(const std::shared_ptr<TokenList>& tokens,
+                      ThreadPool& pool) -> std::vector<ExprTree> {
+  auto bounds = chunk_bounds(*tokens, pool.size() * Chunks_Per_Worker);
+  std::size_t chunks = bounds.size() - 1;
+  std::vector<ExprTree> trees(chunks);
+  std::vector<const char*> errors(chunks, nullptr);
+  parallel_for(pool, chunks, [&](std::size_t chunk) {
+    Parser parser{*tokens};
+    try {
+      parser.parse_range(bounds[chunk], bounds[chunk + 1]);
+    } catch (const char* err) {
+      errors[chunk] = err;
+      return;
+    }
+    trees[chunk] = std::move(parser.tree());
+  });
+  for (const auto* error : errors) {
+    if (error != nullptr) {
+      throw error;
+    }
+  }
+  return trees;
+}
+
+auto merge_trees(std::vector<ExprTree>&& trees, ThreadPool& pool)
+    -> ExprTree {
+  // Node 0 is the new root. Each input keeps its layout shifted by an
+  // offset, minus its own root.
+  std::vector<node_id> offsets(trees.size() + 1, 1);
+  for (std::size_t idx = 0; idx < trees.size(); ++idx) {
+    std::size_t size = trees[idx].empty() ? 0 : trees[idx].size() - 1;
+    offsets[idx + 1] = offsets[idx] + size;
+  }
+
+  std::vector<ExprTree::node_type> nodes(offsets.back(),
+                                         {{}, {}, {}, ExprData{ExprKind::Nil},
+                                          {}});
+  nodes[0].data = ExprData{ExprKind::Root};
+
+  parallel_for(pool, trees.size(), [&](std::size_t idx) {
+    if (trees[idx].empty()) {
+      return;
+    }
+    node_id root = *trees[idx].root();
+    auto relocate = [&](node_id node) -> node_id {
+      return offsets[idx] + (node < root ? node : node - 1);
+    };
+    auto relocate_link =
+        [&](std::optional<node_id> link) -> std::optional<node_id> {
+      if (!link) {
+        return std::nullopt;
+      }
+      return *link == root ? 0 : relocate(*link);
+    };
+    const auto& source = trees[idx].nodes();
+    for (node_id node = 0; node < source.size(); ++node) {
+      if (node == root) {
+        continue;
+      }
+      auto& target = nodes[relocate(node)];
+      target.parent = relocate_link(source[node].parent);
+      target.prev = relocate_link(source[node].prev);
+      target.next = relocate_link(source[node].next);
+      target.data = source[node].data;
+      target.children.reserve(source[node].children.size());
+      for (auto child : source[node].children) {
+        target.children.push_back(relocate(child));
+      }
+    }
+  });
+
+  // Stitch the top level expressions together under the new root.
+  auto& top = nodes[0].children;
+  for (std::size_t idx = 0; idx < trees.size(); ++idx) {
+    if (trees[idx].empty()) {
+      continue;
+    }
+    node_id root = *trees[idx].root();
+    for (auto child : trees[idx].nodes()[root].children) {
+      node_id moved = offsets[idx] + (child < root ? child : child - 1);
+      nodes[moved].prev = std::nullopt;
+      nodes[moved].next = std::nullopt;
+      if (!top.empty()) {
+        nodes[moved].prev = top.back();
+        nodes[top.back()].next = moved;
+      }
+      top.push_back(moved);
+    }
+  }
+  trees.clear();
+
+  ExprTree merged;
+  merged.assign(std::move(nodes), 0);
+  return merged;
+}
+
+}  // namespace loxt
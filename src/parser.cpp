@@ -1,189 +1,238 @@
+#include <algorithm>
 #include <loxt/parser.hpp>
+#include <utility>
 
 namespace loxt {
 
-auto token_kind_bop_kind(TokenKind kind) -> BinaryOpKind {
-  switch (kind.kind()) {
-    case TokenKind::Kind::Or:
-      return BinaryOpKind::Or;
-    case TokenKind::Kind::And:
-      return BinaryOpKind::And;
-    case TokenKind::Kind::EqualEqual:
-      return BinaryOpKind::Eq;
-    case TokenKind::Kind::BangEqual:
-      return BinaryOpKind::Neq;
-    case TokenKind::Kind::Greater:
-      return BinaryOpKind::Gt;
-    case TokenKind::Kind::GreaterEqual:
-      return BinaryOpKind::Ge;
-    case TokenKind::Kind::Less:
-      return BinaryOpKind::Lt;
-    case TokenKind::Kind::LessEqual:
-      return BinaryOpKind::Le;
-    case TokenKind::Kind::Minus:
-      return BinaryOpKind::Minus;
-    case TokenKind::Kind::Plus:
-      return BinaryOpKind::Add;
-    case TokenKind::Kind::BackSlash:
-      return BinaryOpKind::Div;
-    case TokenKind::Kind::Asterisk:
-      return BinaryOpKind::Mul;
-    default:
-      throw "Invalid binary operator";
+namespace {
+
+constexpr std::size_t Dead_Anchor = ~std::size_t{0};
+
+auto same_token(const TokenList& lhs_list, const Token& lhs,
+                const TokenList& rhs_list, const Token& rhs) -> bool {
+  if (!(lhs.kind == rhs.kind)) {
+    return false;
+  }
+  if (lhs.kind == TokenKind::Identifier()) {
+    return lhs_list.identifier(lhs.identifier) ==
+           rhs_list.identifier(rhs.identifier);
+  }
+  if (lhs.kind == TokenKind::String()) {
+    return lhs_list.string_literal(lhs.literal) ==
+           rhs_list.string_literal(rhs.literal);
+  }
+  if (lhs.kind == TokenKind::Number()) {
+    return lhs_list.number_literal(lhs.literal) ==
+           rhs_list.number_literal(rhs.literal);
   }
+  return true;
 }
 
-auto token_kind_uop_kind(TokenKind kind) -> UnaryOpKind {
-  switch (kind.kind()) {
-    case TokenKind::Kind::Bang:
-      return UnaryOpKind::Not;
-    case TokenKind::Kind::Minus:
-      return UnaryOpKind::Neg;
-    default:
-      throw "Invalid binary operator";
+}  // namespace
+
+auto token_edit(const TokenList& before, const TokenList& after)
+    -> TokenEdit {
+  std::size_t shorter = std::min(before.size(), after.size());
+  std::size_t prefix = 0;
+  while (prefix < shorter &&
+         same_token(before, before[prefix], after, after[prefix])) {
+    ++prefix;
+  }
+  std::size_t suffix = 0;
+  while (suffix < shorter - prefix &&
+         same_token(before, before[before.size() - 1 - suffix], after,
+                    after[after.size() - 1 - suffix])) {
+    ++suffix;
   }
+  return {prefix, before.size() - prefix - suffix,
+          after.size() - prefix - suffix};
 }
 
 template <class T>
-auto check(TokenList::Iterator& token, T kind) -> bool {
+auto check(TokenList::ConstIterator& token, T kind) -> bool {
   return token->kind == kind;
 }
 
 template <class T, class... TArgs>
-auto check(TokenList::Iterator& token, T kind, TArgs... args) -> bool {
+auto check(TokenList::ConstIterator& token, T kind, TArgs... args) -> bool {
   if (token->kind == kind) {
     return true;
   }
   return check(token, args...);
 }
 
-Parser::Parser(const std::shared_ptr<TokenList>& tokens)
-    : tokens_{tokens}, current_{tokens_->begin()}, tree_{} {}
-
-auto Parser::expression(ExprTree::iterator parent) -> ExprTree::iterator {
-  return equality(parent);
+Parser::Parser(std::shared_ptr<const TokenList> tokens, BuildMode mode)
+    : tokens_{std::move(tokens)},
+      current_{tokens_->begin()},
+      tree_{},
+      mode_{mode} {}
+
+void Parser::parse_range(std::size_t first, std::size_t last) {
+  tree_.push_root(ExprData{ExprKind::Root});
+  anchors_.push_back(first);
+  auto root = tree_.begin();
+  current_ = tokens_->begin() + static_cast<std::ptrdiff_t>(first);
+  auto end = tokens_->begin() + static_cast<std::ptrdiff_t>(last);
+  while (current_ != end && !check(current_, TokenKind::Eof())) {
+    expression(root);
+    if (check(current_, TokenKind::SemiColon())) {
+      ++current_;
+    } else if (!check(current_, TokenKind::Eof())) {
+      throw "Expected ';' after expression";
+    }
+  }
+  if (mode_ == BuildMode::HashConsed) {
+    tree_ = hash_cons(tree_, *tokens_);
+  }
 }
 
-auto Parser::equality(ExprTree::iterator parent) -> ExprTree::iterator {
-  auto lhs = comparison(parent);
-  while (check(current_, TokenKind::BangEqual(), TokenKind::EqualEqual())) {
-    auto bop = token_kind_bop_kind(current_->kind);
-    ++current_;
-    tree_.push_child(parent, ExprData{ExprKind::Binary, bop});
-    auto current = tree_.last_child(parent);
-    tree_.make_parent(current, lhs);
-    comparison(current);
-    lhs = current;
+void Parser::reparse(const std::shared_ptr<const TokenList>& tokens,
+                     TokenEdit edit) {
+  auto previous = std::exchange(tokens_, tokens);
+  std::optional<ParenSpan> paren;
+  if (mode_ == BuildMode::Tree && 2 * dead_ <= tree_.size()) {
+    paren = enclosing_paren(*previous, edit);
+  }
+  if (!paren) {
+    parse_again();
+    return;
   }
 
-  return lhs;
+  // Parse the new inside as a second child of the Paren, keeping the old
+  // one until the new one is known to end right at the ')'.
+  auto delta = static_cast<std::ptrdiff_t>(edit.inserted) -
+               static_cast<std::ptrdiff_t>(edit.removed);
+  std::size_t first_new = tree_.size();
+  current_ = tokens_->begin() + static_cast<std::ptrdiff_t>(paren->open + 1);
+  // The new inside nests as deep as the old one, so it counts the Paren
+  // and the parentheses and unary operators around it towards the limit.
+  std::size_t depth = 0;
+  for (auto node = paren->node; node != tree_.end(); node = node.parent()) {
+    auto kind = node->kind;
+    depth += kind == ExprKind::Paren || kind == ExprKind::Unary ? 1 : 0;
+  }
+  try {
+    expression(paren->node, depth);
+  } catch (const char*) {
+    parse_again();
+    return;
+  }
+  if (current_ - tokens_->begin() !=
+      static_cast<std::ptrdiff_t>(paren->close) + delta) {
+    parse_again();
+    return;
+  }
+  detach(paren->node.child(0));
+
+  // Surviving nodes point into the previous list. Move their anchors past
+  // the edit and re-read their indices, as the new list may number
+  // identifiers and literals differently.
+  std::size_t edit_end = edit.first + edit.removed;
+  for (treeceratops::node_id node = 0; node < first_new; ++node) {
+    auto& anchor = anchors_[node];
+    if (anchor == Dead_Anchor) {
+      continue;
+    }
+    if (anchor >= edit_end) {
+      anchor = static_cast<std::size_t>(
+          static_cast<std::ptrdiff_t>(anchor) + delta);
+    }
+    auto& data = tree_[node];
+    const auto& token = (*tokens_)[anchor];
+    if (data.kind == ExprKind::Variable) {
+      data.identifier = token.identifier;
+    } else if (data.kind == ExprKind::Literal &&
+               data.literalKind != LiteralKind::Bool) {
+      data.literalVal = token.literal;
+    }
+  }
+  analyse();
 }
 
-auto Parser::comparison(ExprTree::iterator parent) -> ExprTree::iterator {
-  auto lhs = term(parent);
-
-  while (check(current_, TokenKind::Greater(), TokenKind::GreaterEqual(),
-               TokenKind::Less(), TokenKind::LessEqual())) {
-    auto bop = token_kind_bop_kind(current_->kind);
-    ++current_;
-    tree_.push_child(parent, ExprData{ExprKind::Binary, bop});
-    auto current = tree_.last_child(parent);
-    tree_.make_parent(current, lhs);
-    term(current);
-    lhs = current;
+auto Parser::enclosing_paren(const TokenList& tokens, TokenEdit edit)
+    -> std::optional<ParenSpan> {
+  // Step left from the edit over each '(' still open there, innermost
+  // first, until one is closed after the edit.
+  std::size_t edit_end = edit.first + edit.removed;
+  std::size_t nested = 0;
+  for (std::size_t open = edit.first; open-- > 0;) {
+    if (tokens[open].kind == TokenKind::RightParen()) {
+      ++nested;
+      continue;
+    }
+    if (!(tokens[open].kind == TokenKind::LeftParen())) {
+      continue;
+    }
+    if (nested > 0) {
+      --nested;
+      continue;
+    }
+    std::size_t close = open + 1;
+    for (std::size_t inner = 0; close < tokens.size(); ++close) {
+      if (tokens[close].kind == TokenKind::LeftParen()) {
+        ++inner;
+      } else if (tokens[close].kind == TokenKind::RightParen()) {
+        if (inner == 0) {
+          break;
+        }
+        --inner;
+      }
+    }
+    if (close == tokens.size()) {
+      return std::nullopt;
+    }
+    if (close < edit_end) {
+      continue;
+    }
+    for (treeceratops::node_id node = 0; node < anchors_.size(); ++node) {
+      if (anchors_[node] == open && tree_[node].kind == ExprKind::Paren) {
+        return ParenSpan{ExprTree::iterator{&tree_, node}, open, close};
+      }
+    }
+    return std::nullopt;
   }
-
-  return lhs;
+  return std::nullopt;
 }
 
-auto Parser::term(ExprTree::iterator parent) -> ExprTree::iterator {
-  auto lhs = factor(parent);
-
-  while (check(current_, TokenKind::Minus(), TokenKind::Plus())) {
-    auto bop = token_kind_bop_kind(current_->kind);
-    ++current_;
-    tree_.push_child(parent, ExprData{ExprKind::Binary, bop});
-    auto current = tree_.last_child(parent);
-    tree_.make_parent(current, lhs);
-    factor(current);
-    lhs = current;
+void Parser::detach(ExprTree::iterator node) {
+  std::vector<ExprTree::iterator> stack{node};
+  while (!stack.empty()) {
+    auto current = stack.back();
+    stack.pop_back();
+    anchors_[current.id()] = Dead_Anchor;
+    ++dead_;
+    for (std::size_t idx = 0; idx < current.child_count(); ++idx) {
+      stack.push_back(current.child(idx));
+    }
   }
-
-  return lhs;
+  tree_.detach(node);
 }
 
-auto Parser::factor(ExprTree::iterator parent) -> ExprTree::iterator {
-  auto lhs = unary(parent);
-
-  while (check(current_, TokenKind::BackSlash(), TokenKind::Asterisk())) {
-    auto bop = token_kind_bop_kind(current_->kind);
-    ++current_;
-    tree_.push_child(parent, ExprData{ExprKind::Binary, bop});
-    auto current = tree_.last_child(parent);
-    tree_.make_parent(current, lhs);
-    unary(current);
-    lhs = current;
+void Parser::analyse() {
+  slots_ = resolve(tree_, *tokens_);
+  if (type_check_) {
+    types_ = infer_types(tree_);
   }
-
-  return lhs;
 }
 
-auto Parser::unary(ExprTree::iterator parent) -> ExprTree::iterator {
-  if (check(current_, TokenKind::Bang(), TokenKind::Minus())) {
-    auto uop = token_kind_uop_kind(current_->kind);
-    ++current_;
-    tree_.push_child(parent, ExprData{ExprKind::Unary, uop});
-    parent = tree_.last_child(parent);
-    unary(parent);
-    return parent;
-  }
-  return primary(parent);
+void Parser::parse_again() {
+  tree_.clear();
+  anchors_.clear();
+  dead_ = 0;
+  current_ = tokens_->begin();
+  parse();
 }
 
-auto Parser::primary(ExprTree::iterator parent) -> ExprTree::iterator {
-  if (check(current_, TokenKind::Nil())) {
-    tree_.push_child(parent, ExprData{ExprKind::Nil});
-    ++current_;
-    return tree_.last_child(parent);
-  }
-  if (check(current_, TokenKind::False())) {
-    tree_.push_child(parent,
-                     ExprData{ExprKind::Literal, LiteralKind::Bool, false});
-    ++current_;
-    return tree_.last_child(parent);
-  }
-  if (check(current_, TokenKind::True())) {
-    tree_.push_child(parent,
-                     ExprData{ExprKind::Literal, LiteralKind::Bool, true});
-    ++current_;
-    return tree_.last_child(parent);
-  }
-  if (check(current_, TokenKind::Number())) {
-    tree_.push_child(parent, ExprData{ExprKind::Literal, LiteralKind::Number,
-                                      current_->literal});
-    ++current_;
-    return tree_.last_child(parent);
-  }
-  if (check(current_, TokenKind::String())) {
-    tree_.push_child(parent, ExprData{ExprKind::Literal, LiteralKind::String,
-                                      current_->literal});
-    ++current_;
-    return tree_.last_child(parent);
-  }
-
-  if (check(current_, TokenKind::LeftParen())) {
-    ++current_;
-    tree_.push_child(parent, ExprData{ExprKind::Paren});
-    parent = tree_.last_child(parent);
-    expression(parent);
-    if (check(current_, TokenKind::RightParen())) {
-      ++current_;
-      return parent;
-    }
-    throw "hanging paren";
-  }
+auto Parser::push(ExprTree::iterator parent, const ExprData& data)
+    -> ExprTree::iterator {
+  tree_.push_child(parent, data);
+  anchors_.push_back(token_index());
+  return tree_.last_child(parent);
+}
 
-  throw "Failed to parse expr";
+auto Parser::expression(ExprTree::iterator parent, std::size_t depth)
+    -> ExprTree::iterator {
+  return detail::Grammar<Parser>{*this, max_depth_}.expression(parent, depth);
 }
 
 }  // namespace loxt
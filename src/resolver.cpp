@@ -0,0 +1,38 @@
+#include <loxt/ast/resolver.hpp>
+
+namespace loxt {
+
+auto resolve(ExprTree& tree, const TokenList& tokens) -> SlotLayout {
+  SlotLayout layout;
+  layout.slots_.assign(tokens.identifier_count(), Unresolved_Slot);
+  if (!tree.root()) {
+    return layout;
+  }
+  // Pre-order from the root, so detached nodes are skipped and a node
+  // shared by several parents is visited once.
+  const auto& nodes = tree.nodes();
+  std::vector<bool> visited(nodes.size());
+  std::vector<treeceratops::node_id> stack{*tree.root()};
+  while (!stack.empty()) {
+    auto node = stack.back();
+    stack.pop_back();
+    if (visited[node]) {
+      continue;
+    }
+    visited[node] = true;
+    auto& data = tree[node];
+    if (data.kind == ExprKind::Variable) {
+      auto& slot = layout.slots_[data.identifier];
+      if (slot == Unresolved_Slot) {
+        slot = static_cast<Slot>(layout.identifiers_.size());
+        layout.identifiers_.push_back(data.identifier);
+      }
+      data.slot = slot;
+    }
+    const auto& children = nodes[node].children;
+    stack.insert(stack.end(), children.rbegin(), children.rend());
+  }
+  return layout;
+}
+
+}  // namespace loxt
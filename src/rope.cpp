@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <cstring>
+#include <loxt/rope.hpp>
+#include <new>
+
+namespace loxt {
+
+auto StringArena::allocate(std::size_t size, std::size_t align) -> void* {
+  auto start = (offset_ + align - 1) & ~(align - 1);
+  if (blocks_.empty() || start + size > blocks_.back().size) {
+    // Blocks after the first are dropped by reset(), so oversized requests
+    // get a block of their own rather than growing the default.
+    auto block_size = std::max(block_size_, size);
+    blocks_.push_back(
+        Block{std::make_unique<std::byte[]>(block_size), block_size});
+    start = 0;
+  }
+  offset_ = start + size;
+  used_ += size;
+  return blocks_.back().data.get() + start;
+}
+
+auto StringArena::copy(std::string_view text) -> std::string_view {
+  if (text.empty()) {
+    return {};
+  }
+  auto* data = static_cast<char*>(allocate(text.size(), 1));
+  std::memcpy(data, text.data(), text.size());
+  return {data, text.size()};
+}
+
+void StringArena::reset() {
+  if (blocks_.size() > 1) {
+    blocks_.resize(1);
+  }
+  offset_ = 0;
+  used_ = 0;
+}
+
+auto Rope::view(std::string_view text, StringArena& arena) -> Rope {
+  Rope rope;
+  if (text.size() <= Inline_Capacity) {
+    std::ranges::copy(text, rope.inline_.begin());
+    rope.inline_size_ = static_cast<std::uint8_t>(text.size());
+    return rope;
+  }
+  auto* node = static_cast<Node*>(arena.allocate(sizeof(Node), alignof(Node)));
+  rope.node_ = new (node) Node{text.size(), text.data(), nullptr, nullptr};
+  return rope;
+}
+
+auto Rope::copy(std::string_view text, StringArena& arena) -> Rope {
+  if (text.size() <= Inline_Capacity) {
+    return view(text, arena);
+  }
+  return view(arena.copy(text), arena);
+}
+
+auto Rope::concat(const Rope& lhs, const Rope& rhs, StringArena& arena)
+    -> Rope {
+  if (rhs.size() == 0) {
+    return lhs;
+  }
+  if (lhs.size() == 0) {
+    return rhs;
+  }
+  auto size = lhs.size() + rhs.size();
+  if (size <= Inline_Capacity) {
+    Rope rope = lhs;
+    std::ranges::copy_n(rhs.inline_.begin(), rhs.inline_size_,
+                        rope.inline_.begin() + lhs.inline_size_);
+    rope.inline_size_ = static_cast<std::uint8_t>(size);
+    return rope;
+  }
+  Rope rope;
+  auto* node = static_cast<Node*>(arena.allocate(sizeof(Node), alignof(Node)));
+  rope.node_ =
+      new (node) Node{size, nullptr, lhs.as_node(arena), rhs.as_node(arena)};
+  return rope;
+}
+
+auto Rope::as_node(StringArena& arena) const -> const Node* {
+  if (node_ != nullptr) {
+    return node_;
+  }
+  auto text = arena.copy({inline_.data(), inline_size_});
+  auto* node = static_cast<Node*>(arena.allocate(sizeof(Node), alignof(Node)));
+  return new (node) Node{text.size(), text.data(), nullptr, nullptr};
+}
+
+auto Rope::flatten() const -> std::string {
+  if (node_ == nullptr) {
+    return {inline_.data(), inline_size_};
+  }
+  std::string result(node_->size, '\0');
+  auto* out = result.data();
+  // Concatenation chains are as deep as they are long, so no recursion.
+  std::vector<const Node*> stack{node_};
+  while (!stack.empty()) {
+    const auto* node = stack.back();
+    stack.pop_back();
+    if (node->text != nullptr) {
+      out = std::ranges::copy_n(node->text, node->size, out).out;
+      continue;
+    }
+    stack.push_back(node->right);
+    stack.push_back(node->left);
+  }
+  return result;
+}
+
+}  // namespace loxt
@@ -0,0 +1,335 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <limits>
+#include <loxt/dump.hpp>
+#include <loxt/eval.hpp>
+#include <loxt/eval_cache.hpp>
+#include <loxt/parser.hpp>
+#include <loxt/server.hpp>
+#include <loxt/session.hpp>
+#include <sstream>
+#include <system_error>
+
+namespace loxt {
+
+namespace {
+
+constexpr std::size_t Header_Size = 5;
+
+auto errno_error(const char* what) -> std::system_error {
+  return {errno, std::generic_category(), what};
+}
+
+auto read_exact(int fd, char* data, std::size_t size) -> bool {
+  while (size > 0) {
+    auto got = ::read(fd, data, size);
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      return false;
+    }
+    data += got;
+    size -= static_cast<std::size_t>(got);
+  }
+  return true;
+}
+
+auto write_all(int fd, const char* data, std::size_t size) -> bool {
+  while (size > 0) {
+    // MSG_NOSIGNAL turns a closed peer into EPIPE instead of SIGPIPE.
+    auto sent = ::send(fd, data, size, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      return false;
+    }
+    data += sent;
+    size -= static_cast<std::size_t>(sent);
+  }
+  return true;
+}
+
+// Writes one frame, header and payload.
+auto write_frame(int fd, std::uint8_t tag, std::string_view payload) -> bool {
+  auto size = static_cast<std::uint32_t>(payload.size());
+  std::array<char, Header_Size> header{
+      static_cast<char>(size & 0xff), static_cast<char>((size >> 8) & 0xff),
+      static_cast<char>((size >> 16) & 0xff),
+      static_cast<char>((size >> 24) & 0xff), static_cast<char>(tag)};
+  return write_all(fd, header.data(), header.size()) &&
+         write_all(fd, payload.data(), payload.size());
+}
+
+// Reads one frame into tag and payload. Fails on a closed connection or a
+// payload over `limit` bytes.
+auto read_frame(int fd, std::uint8_t& tag, std::string& payload,
+                std::size_t limit) -> bool {
+  std::array<unsigned char, Header_Size> header{};
+  if (!read_exact(fd, reinterpret_cast<char*>(header.data()), header.size())) {
+    return false;
+  }
+  std::size_t size = std::size_t{header[0]} | (std::size_t{header[1]} << 8) |
+                     (std::size_t{header[2]} << 16) |
+                     (std::size_t{header[3]} << 24);
+  if (size > limit) {
+    return false;
+  }
+  tag = header[4];
+  payload.resize(size);
+  return read_exact(fd, payload.data(), size);
+}
+
+auto socket_address(const std::string& path) -> sockaddr_un {
+  sockaddr_un addr{};
+  if (path.size() >= sizeof(addr.sun_path)) {
+    throw std::system_error{std::make_error_code(std::errc::filename_too_long),
+                            "socket path"};
+  }
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  return addr;
+}
+
+}  // namespace
+
+Server::Server(std::size_t threads) : Server{threads, Default_Max_Depth} {}
+
+Server::~Server() {
+  stop();
+  if (auto listener = listener_.exchange(-1); listener >= 0) {
+    ::close(listener);
+    ::unlink(path_.c_str());
+    ::close(wake_read_);
+    ::close(wake_write_);
+  }
+}
+
+void Server::listen(const std::string& path) {
+  auto addr = socket_address(path);
+  std::array<int, 2> wake{};
+  if (::pipe(wake.data()) < 0) {
+    throw errno_error("pipe");
+  }
+  // A full pipe already wakes poll(), so wake() must not block on it.
+  ::fcntl(wake[0], F_SETFL, O_NONBLOCK);
+  ::fcntl(wake[1], F_SETFL, O_NONBLOCK);
+  int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0) {
+    auto err = errno_error("socket");
+    ::close(wake[0]);
+    ::close(wake[1]);
+    throw err;
+  }
+  ::unlink(path.c_str());
+  if (::bind(listener, reinterpret_cast<const sockaddr*>(&addr),
+             sizeof(addr)) < 0 ||
+      ::listen(listener, SOMAXCONN) < 0) {
+    auto err = errno_error("bind");
+    ::close(listener);
+    ::close(wake[0]);
+    ::close(wake[1]);
+    throw err;
+  }
+  path_ = path;
+  wake_read_ = wake[0];
+  wake_write_ = wake[1];
+  // Published last: stop() only wakes a server whose listener it can see.
+  listener_ = listener;
+  if (stopping_) {
+    ::shutdown(listener, SHUT_RDWR);
+  }
+}
+
+void Server::run() {
+  int listener = listener_;
+  // Connections waiting for their next request. One with a request in
+  // flight belongs to its pool task until the task hands it back.
+  std::vector<int> idle;
+  std::vector<pollfd> fds;
+  while (!stopping_) {
+    fds.clear();
+    fds.push_back({.fd = listener, .events = POLLIN, .revents = 0});
+    fds.push_back({.fd = wake_read_, .events = POLLIN, .revents = 0});
+    for (int client : idle) {
+      fds.push_back({.fd = client, .events = POLLIN, .revents = 0});
+    }
+    if (::poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+
+    idle.clear();
+    for (auto pos = fds.begin() + 2; pos != fds.end(); ++pos) {
+      if (pos->revents == 0) {
+        idle.push_back(pos->fd);
+      } else {
+        // Readable or hung up; either way the task's read tells which.
+        pool_.submit([this, client = pos->fd] { serve_request(client); });
+      }
+    }
+    if (fds[1].revents != 0) {
+      std::array<char, 64> drain{};
+      while (::read(wake_read_, drain.data(), drain.size()) > 0) {
+      }
+      std::lock_guard lock(mutex_);
+      idle.insert(idle.end(), returned_.begin(), returned_.end());
+      returned_.clear();
+    }
+    if (fds[0].revents != 0) {
+      int client = ::accept(listener, nullptr, nullptr);
+      if (client >= 0) {
+        idle.push_back(client);
+      } else if (errno != EINTR && errno != ECONNABORTED) {
+        break;
+      }
+    }
+  }
+  pool_.wait();
+
+  std::lock_guard lock(mutex_);
+  idle.insert(idle.end(), returned_.begin(), returned_.end());
+  returned_.clear();
+  for (int client : idle) {
+    ::close(client);
+  }
+}
+
+void Server::stop() {
+  stopping_ = true;
+  // Shutting the listener down fails any later accept(), and the pipe wakes
+  // a blocked poll().
+  if (int listener = listener_; listener >= 0) {
+    ::shutdown(listener, SHUT_RDWR);
+    wake();
+  }
+}
+
+void Server::wake() {
+  char byte = 0;
+  [[maybe_unused]] auto written = ::write(wake_write_, &byte, 1);
+}
+
+void Server::serve_request(int client) {
+  std::uint8_t tag = 0;
+  std::string payload;
+  if (!read_frame(client, tag, payload, Max_Request_Size)) {
+    ::close(client);
+    return;
+  }
+  auto response = tag <= static_cast<std::uint8_t>(RequestKind::Evaluate)
+                      ? handle(static_cast<RequestKind>(tag), payload)
+                      : Response{false, "Unknown request kind"};
+  if (!write_frame(client, response.ok ? 0 : 1, response.body)) {
+    ::close(client);
+    return;
+  }
+  {
+    std::lock_guard lock(mutex_);
+    returned_.push_back(client);
+  }
+  wake();
+}
+
+auto Server::handle(RequestKind kind, std::string source) -> Response {
+  ++requests_;
+  try {
+    return respond(kind, std::move(source));
+  } catch (const char* err) {
+    return Response{false, err};
+  } catch (const std::exception& err) {
+    return Response{false, err.what()};
+  }
+}
+
+auto Server::respond(RequestKind kind, std::string source) -> Response {
+  thread_local Session session;
+  session.clear();
+  auto range = session.lex(std::move(source));
+  auto& tokens = session.tokens();
+
+  Response response;
+  if (tokens.has_error()) {
+    for (const auto& diag : tokens.diagnostics()) {
+      response.body += std::format("{}:{}: Error: {}\n", diag.loc.line,
+                                   diag.loc.column, diag.message);
+    }
+    return response;
+  }
+  if (kind == RequestKind::Lex) {
+    for (auto idx = range.begin; idx < range.end; ++idx) {
+      response.body += tokens.to_string(tokens[idx]);
+      response.body += '\n';
+    }
+    response.ok = true;
+    return response;
+  }
+
+  Parser parser{session.shared_tokens()};
+  parser.set_max_depth(max_depth_);
+  // The range ends with its Eof token.
+  parser.parse_range(range.begin, range.end - 1);
+  auto& tree = parser.tree();
+  if (kind == RequestKind::Parse) {
+    std::ostringstream out;
+    {
+      DumpWriter writer{out};
+      dump_ast(writer, tree, tokens, DumpFormat::Text);
+    }
+    response.body = out.str();
+  } else {
+    auto layout = resolve(tree, tokens);
+    Evaluator evaluator{tokens, layout};
+    evaluator.use_cache(EvalCache::shared());
+    for (const auto& value : evaluator.evaluate_all(tree)) {
+      response.body += to_string(value);
+      response.body += '\n';
+    }
+  }
+  response.ok = true;
+  return response;
+}
+
+Client::Client(const std::string& path) {
+  auto addr = socket_address(path);
+  socket_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (socket_ < 0) {
+    throw errno_error("socket");
+  }
+  if (::connect(socket_, reinterpret_cast<const sockaddr*>(&addr),
+                sizeof(addr)) < 0) {
+    auto err = errno_error("connect");
+    ::close(socket_);
+    throw err;
+  }
+}
+
+Client::~Client() { ::close(socket_); }
+
+auto Client::send(RequestKind kind, std::string_view source) -> Response {
+  if (!write_frame(socket_, static_cast<std::uint8_t>(kind), source)) {
+    throw errno_error("send");
+  }
+  std::uint8_t status = 0;
+  Response response;
+  if (!read_frame(socket_, status, response.body,
+                  std::numeric_limits<std::uint32_t>::max())) {
+    throw std::system_error{std::make_error_code(std::errc::connection_reset),
+                            "receive"};
+  }
+  response.ok = status == 0;
+  return response;
+}
+
+}  // namespace loxt
@@ -0,0 +1,25 @@
+#include <loxt/session.hpp>
+
+namespace loxt {
+
+Session::Session()
+    : m_Tokens(std::shared_ptr<TokenList>(new TokenList(Min_Block_Size))) {}
+
+auto Session::lex(std::string line) -> TokenRange {
+  std::size_t begin = m_Tokens->size();
+  m_Tokens->lex_source(m_Lines.emplace_back(std::move(line)));
+  return {begin, m_Tokens->size()};
+}
+
+void Session::clear() {
+  m_Tokens->m_Tokens.clear();
+  m_Tokens->m_IdentifierMap.clear();
+  m_Tokens->m_Identifiers.clear();
+  m_Tokens->m_StringLiteral.clear();
+  m_Tokens->m_NumberLiteral.clear();
+  m_Tokens->m_Diagnostics.clear();
+  m_Tokens->m_HasError = false;
+  m_Lines.clear();
+}
+
+}  // namespace loxt
@@ -0,0 +1,117 @@
+#include <loxt/thread_pool.hpp>
+#include <utility>
+
+namespace loxt {
+
+namespace {
+// Index of the pool queue owned by the current thread, if it is a worker.
+thread_local const ThreadPool* CurrentPool = nullptr;
+thread_local std::size_t CurrentWorker = 0;
+}  // namespace
+
+ThreadPool::ThreadPool(std::size_t threads) {
+  if (threads == 0) {
+    threads = 1;
+  }
+  queues_.reserve(threads);
+  for (std::size_t idx = 0; idx < threads; ++idx) {
+    queues_.push_back(std::make_unique<Queue>());
+  }
+  workers_.reserve(threads);
+  for (std::size_t idx = 0; idx < threads; ++idx) {
+    workers_.emplace_back([this, idx] { run(idx); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  std::size_t target = CurrentPool == this
+                           ? CurrentWorker
+                           : next_queue_.fetch_add(1) % queues_.size();
+  {
+    // Count the task before any worker can see it, so one that runs it at
+    // once cannot take the counters below zero, and push it under the same
+    // lock so a waiting worker never finds the count without the task.
+    std::lock_guard lock(mutex_);
+    ++pending_;
+    ++queued_;
+    std::lock_guard queue_lock(queues_[target]->mutex);
+    queues_[target]->tasks.push_back(std::move(task));
+  }
+  wake_.notify_one();
+}
+
+void ThreadPool::wait() {
+  std::unique_lock lock(mutex_);
+  done_.wait(lock, [this] { return pending_ == 0; });
+  if (error_) {
+    std::rethrow_exception(std::exchange(error_, nullptr));
+  }
+}
+
+auto ThreadPool::pop(std::size_t self, std::function<void()>& task) -> bool {
+  auto& queue = *queues_[self];
+  std::lock_guard lock(queue.mutex);
+  if (queue.tasks.empty()) {
+    return false;
+  }
+  task = std::move(queue.tasks.back());
+  queue.tasks.pop_back();
+  return true;
+}
+
+auto ThreadPool::steal(std::size_t self, std::function<void()>& task) -> bool {
+  for (std::size_t offset = 1; offset < queues_.size(); ++offset) {
+    auto& queue = *queues_[(self + offset) % queues_.size()];
+    std::lock_guard lock(queue.mutex);
+    if (!queue.tasks.empty()) {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::run(std::size_t self) {
+  CurrentPool = this;
+  CurrentWorker = self;
+  for (;;) {
+    std::function<void()> task;
+    if (pop(self, task) || steal(self, task)) {
+      --queued_;
+      std::exception_ptr error;
+      try {
+        task();
+      } catch (...) {
+        error = std::current_exception();
+      }
+      std::lock_guard lock(mutex_);
+      if (error && !error_) {
+        error_ = std::move(error);
+      }
+      if (--pending_ == 0) {
+        done_.notify_all();
+      }
+      continue;
+    }
+
+    std::unique_lock lock(mutex_);
+    wake_.wait(lock, [this] { return stop_ || queued_ > 0; });
+    if (stop_ && queued_ == 0) {
+      return;
+    }
+  }
+}
+
+}  // namespace loxt
@@ -0,0 +1,134 @@
+#include <loxt/ast/types.hpp>
+#include <utility>
+
+namespace loxt {
+
+namespace {
+
+constexpr auto number_like(StaticType type) -> bool {
+  return type == StaticType::Number || type == StaticType::Any;
+}
+
+auto binary(BinaryOpKind op, StaticType lhs, StaticType rhs) -> StaticType {
+  switch (op) {
+    case BinaryOpKind::And:
+    case BinaryOpKind::Or:
+      // Yields whichever operand decided.
+      return lhs == rhs ? lhs : StaticType::Any;
+    case BinaryOpKind::Eq:
+    case BinaryOpKind::Neq:
+      return StaticType::Bool;
+    case BinaryOpKind::Add: {
+      // Both operands end up with the type of whichever one is known.
+      auto known = lhs == StaticType::Any ? rhs : lhs;
+      auto other = lhs == StaticType::Any ? lhs : rhs;
+      if ((known == StaticType::Number || known == StaticType::String ||
+           known == StaticType::Any) &&
+          (other == known || other == StaticType::Any)) {
+        return known;
+      }
+      throw "Operands must be two numbers or two strings";
+    }
+    case BinaryOpKind::Gt:
+    case BinaryOpKind::Ge:
+    case BinaryOpKind::Lt:
+    case BinaryOpKind::Le:
+      if (!number_like(lhs) || !number_like(rhs)) {
+        throw "Operands must be numbers";
+      }
+      return StaticType::Bool;
+    case BinaryOpKind::Minus:
+    case BinaryOpKind::Div:
+    case BinaryOpKind::Mul:
+      if (!number_like(lhs) || !number_like(rhs)) {
+        throw "Operands must be numbers";
+      }
+      return StaticType::Number;
+  }
+  throw "Unknown binary operator";
+}
+
+auto unary(UnaryOpKind op, StaticType operand) -> StaticType {
+  if (op == UnaryOpKind::Not) {
+    return StaticType::Bool;
+  }
+  if (!number_like(operand)) {
+    throw "Operand must be a number";
+  }
+  return StaticType::Number;
+}
+
+auto literal(LiteralKind kind) -> StaticType {
+  switch (kind) {
+    case LiteralKind::Number:
+      return StaticType::Number;
+    case LiteralKind::String:
+      return StaticType::String;
+    case LiteralKind::Bool:
+      return StaticType::Bool;
+  }
+  throw "Unknown literal kind";
+}
+
+}  // namespace
+
+auto infer_types(const ExprTree& tree,
+                 const std::unordered_map<Identifier, StaticType>& declared)
+    -> NodeTypes {
+  NodeTypes types(tree.size(), StaticType::Any);
+  if (!tree.root()) {
+    return types;
+  }
+  // Post-order, so children are typed before their parent. A node shared
+  // by several parents in a hash-consed tree is typed once.
+  std::vector<bool> seen(tree.size());
+  std::vector<std::pair<ExprTree::const_iterator, bool>> stack{
+      {tree.begin(), false}};
+  while (!stack.empty()) {
+    auto [node, children_done] = stack.back();
+    stack.pop_back();
+    if (!children_done) {
+      if (seen[node.id()]) {
+        continue;
+      }
+      seen[node.id()] = true;
+      stack.emplace_back(node, true);
+      for (std::size_t idx = 0; idx < node.child_count(); ++idx) {
+        stack.emplace_back(node.child(idx), false);
+      }
+      continue;
+    }
+
+    const auto& data = *node;
+    auto child = [&](std::size_t idx) { return types[node.child(idx).id()]; };
+    auto& type = types[node.id()];
+    switch (data.kind) {
+      case ExprKind::Root:
+        type = node.child_count() == 1 ? child(0) : StaticType::Any;
+        break;
+      case ExprKind::Paren:
+        type = child(0);
+        break;
+      case ExprKind::Binary:
+        type = binary(data.bOp, child(0), child(1));
+        break;
+      case ExprKind::Unary:
+        type = unary(data.uOp, child(0));
+        break;
+      case ExprKind::Literal:
+        type = literal(data.literalKind);
+        break;
+      case ExprKind::Nil:
+        type = StaticType::Nil;
+        break;
+      case ExprKind::Variable: {
+        auto found = declared.find(data.identifier);
+        type = found == declared.end() ? StaticType::Any : found->second;
+        break;
+      }
+    }
+  }
+  return types;
+}
+
+}  // namespace loxt
@@ -0,0 +1,145 @@
+#include "loxt/cache.hpp"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <sstream>
+
+#include "loxt/dump.hpp"
+#include "loxt/parser.hpp"
+
+namespace {
+auto dump(loxt::TokenList& tokens, loxt::ExprTree* tree) -> std::string {
+  std::ostringstream out;
+  loxt::DumpWriter writer{out};
+  loxt::dump_tokens(writer, tokens, loxt::DumpFormat::Jsonl);
+  if (tree != nullptr) {
+    loxt::dump_ast(writer, *tree, tokens, loxt::DumpFormat::Jsonl);
+  }
+  writer.flush();
+  return out.str();
+}
+}  // namespace
+
+TEST(CacheTest, RoundTrip) {
+  std::string str = "1 + (\"ab\" == \"cd\") * -3 != nil or -3 == \"ab\"";
+  auto toks = loxt::lex(str);
+  loxt::Parser parser{toks};
+  parser.parse();
+
+  auto image = loxt::serialize(*toks, &parser.tree());
+  auto artifact = loxt::deserialize(image, str);
+  ASSERT_TRUE(artifact.has_value());
+  ASSERT_TRUE(artifact->tree.has_value());
+  EXPECT_EQ(dump(*artifact->tokens, &*artifact->tree),
+            dump(*toks, &parser.tree()));
+
+  // Shared subtrees only link to one of their parents.
+  loxt::Parser consed{toks, loxt::BuildMode::HashConsed};
+  consed.parse();
+  ASSERT_LT(consed.tree().size(), parser.tree().size());
+  image = loxt::serialize(*toks, &consed.tree());
+  EXPECT_TRUE(loxt::deserialize(image, str).has_value());
+}
+
+TEST(CacheTest, RejectsOtherSource) {
+  std::string str = "1 + 2";
+  auto toks = loxt::lex(str);
+  auto image = loxt::serialize(*toks, nullptr);
+  std::string other = "1 + 3";
+  EXPECT_FALSE(loxt::deserialize(image, other).has_value());
+  EXPECT_FALSE(loxt::deserialize(image.substr(0, 20), str).has_value());
+}
+
+// An image whose hash and size match another source, as on a collision, is
+// still turned away because the stored source differs.
+TEST(CacheTest, RejectsHashCollisions) {
+  std::string str = "1 + 2";
+  auto toks = loxt::lex(str);
+  auto image = loxt::serialize(*toks, nullptr);
+  std::string other = "1 + 3";
+  auto forged = loxt::content_hash(other);
+  // The hash follows the 4 byte magic and the 4 byte version.
+  image.replace(8, sizeof(forged), reinterpret_cast<const char*>(&forged),
+                sizeof(forged));
+  EXPECT_FALSE(loxt::deserialize(image, other).has_value());
+}
+
+// Every tree deserialize() accepts from a damaged image indexes only the
+// pools it has, and both children and the pre-order iterator end.
+TEST(CacheTest, RejectsCorruptTrees) {
+  std::string str = "a + (\"ab\" == \"cd\") * -3 != b and a";
+  auto toks = loxt::lex(str);
+  loxt::Parser parser{toks};
+  parser.parse();
+  auto image = loxt::serialize(*toks, &parser.tree());
+
+  for (std::size_t offset = 0; offset < image.size(); ++offset) {
+    for (char byte : {'\x00', '\x01', '\x02', '\xff'}) {
+      auto damaged = image;
+      damaged[offset] = byte;
+      auto artifact = loxt::deserialize(damaged, str);
+      if (!artifact || !artifact->tree) {
+        continue;
+      }
+      const auto& tokens = *artifact->tokens;
+      const auto& nodes = artifact->tree->nodes();
+      for (const auto& node : nodes) {
+        const auto& data = node.data;
+        if (data.kind == loxt::ExprKind::Variable) {
+          ASSERT_LT(data.identifier, tokens.identifier_count()) << offset;
+        } else if (data.kind == loxt::ExprKind::Literal &&
+                   data.literalKind == loxt::LiteralKind::Number) {
+          ASSERT_LT(data.literalVal, tokens.number_literal_count()) << offset;
+        } else if (data.kind == loxt::ExprKind::Literal &&
+                   data.literalKind == loxt::LiteralKind::String) {
+          ASSERT_LT(data.literalVal, tokens.string_literal_count()) << offset;
+        }
+      }
+
+      std::size_t steps = 0;
+      const auto& tree = *artifact->tree;
+      for (auto node = tree.begin(); node != tree.end(); ++node) {
+        ASSERT_LE(++steps, nodes.size()) << offset;
+      }
+      std::vector<treeceratops::node_id> stack;
+      if (auto root = tree.root()) {
+        stack.push_back(*root);
+      }
+      for (steps = 0; !stack.empty(); ++steps) {
+        ASSERT_LE(steps, 64 * nodes.size()) << offset;
+        auto node = stack.back();
+        stack.pop_back();
+        stack.insert(stack.end(), nodes[node].children.begin(),
+                     nodes[node].children.end());
+      }
+    }
+  }
+}
+
+TEST(CacheTest, ScriptCacheHits) {
+  auto dir = std::filesystem::temp_directory_path() / "loxt-cache-test";
+  std::filesystem::remove_all(dir);
+  loxt::ScriptCache cache{dir};
+  std::string str = "true == !false";
+
+  auto first = cache.parse(str);
+  auto second = cache.parse(str);
+  EXPECT_EQ(cache.misses(), 1U);
+  EXPECT_EQ(cache.hits(), 1U);
+  ASSERT_TRUE(second.tree.has_value());
+  EXPECT_EQ(dump(*second.tokens, &*second.tree),
+            dump(*first.tokens, &*first.tree));
+  std::filesystem::remove_all(dir);
+}
+
+TEST(CacheTest, KeepsDepthLimitsApart) {
+  auto dir = std::filesystem::temp_directory_path() / "loxt-depth-test";
+  std::filesystem::remove_all(dir);
+  std::string str = "-(1)";
+  loxt::ScriptCache deep{dir};
+  EXPECT_TRUE(deep.parse(str).tree.has_value());
+  loxt::ScriptCache shallow{dir, 1};
+  EXPECT_THROW(shallow.parse(str), const char*);
+  std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,76 @@
+#include "loxt/dump.hpp"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+#include "loxt/lexer.hpp"
+#include "loxt/parser.hpp"
+
+TEST(DumpTest, TokensJsonl) {
+  std::string str = "1 + \"a\\b\"";
+  auto toks = loxt::lex(str);
+  std::ostringstream out;
+  {
+    loxt::DumpWriter writer{out};
+    loxt::dump_tokens(writer, *toks, loxt::DumpFormat::Jsonl);
+  }
+  EXPECT_EQ(out.str(),
+            "{\"kind\":\"Number\",\"line\":1,\"column\":1,\"literal\":1}\n"
+            "{\"kind\":\"Plus\",\"line\":1,\"column\":3}\n"
+            "{\"kind\":\"String\",\"line\":1,\"column\":5,"
+            "\"literal\":\"a\\\\b\"}\n"
+            "{\"kind\":\"Eof\",\"line\":1,\"column\":10}\n");
+}
+
+TEST(DumpTest, TokensTextMatchesToString) {
+  std::string str = "foo == 12";
+  auto toks = loxt::lex(str);
+  std::ostringstream out;
+  std::string expected;
+  {
+    loxt::DumpWriter writer{out, 8};
+    loxt::dump_tokens(writer, *toks, loxt::DumpFormat::Text);
+  }
+  for (const auto& tok : *toks) {
+    expected += toks->to_string(tok) + '\n';
+  }
+  EXPECT_EQ(out.str(), expected);
+}
+
+TEST(DumpTest, AstBinaryHeader) {
+  std::string str = "1 + 2";
+  auto toks = loxt::lex(str);
+  loxt::Parser parser{toks};
+  parser.parse();
+  std::ostringstream out;
+  {
+    loxt::DumpWriter writer{out};
+    loxt::dump_ast(writer, parser.tree(), *toks, loxt::DumpFormat::Binary);
+  }
+  auto bytes = out.str();
+  ASSERT_GE(bytes.size(), 12U);
+  EXPECT_EQ(bytes.substr(0, 4), loxt::Ast_Dump_Magic);
+  EXPECT_EQ(bytes[4], static_cast<char>(loxt::Dump_Version));
+  EXPECT_EQ(bytes[8], 4);  // Root, Binary and two literals.
+}
+
+TEST(DumpTest, FrozenAstMatchesTree) {
+  std::string str = "1 + (2 == \"x\") / 7 == nil";
+  auto toks = loxt::lex(str);
+  loxt::Parser parser{toks};
+  parser.parse();
+  auto frozen = treeceratops::freeze(parser.tree());
+
+  for (auto format : {loxt::DumpFormat::Text, loxt::DumpFormat::Binary}) {
+    std::ostringstream tree_out;
+    std::ostringstream frozen_out;
+    {
+      loxt::DumpWriter tree_writer{tree_out};
+      loxt::DumpWriter frozen_writer{frozen_out};
+      loxt::dump_ast(tree_writer, parser.tree(), *toks, format);
+      loxt::dump_ast(frozen_writer, frozen, *toks, format);
+    }
+    EXPECT_EQ(frozen_out.str(), tree_out.str());
+  }
+}
@@ -0,0 +1,639 @@
+#include "loxt/eval.hpp"
+
+#include <gtest/gtest.h>
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "loxt/batch_eval.hpp"
+#include "loxt/closure.hpp"
+#include "loxt/eval_cache.hpp"
+#include "loxt/jit.hpp"
+#include "loxt/lexer.hpp"
+#include "loxt/parser.hpp"
+#include "loxt/rope.hpp"
+#include "loxt/static_expr.hpp"
+
+namespace {
+
+auto evaluate(const std::string& source) -> loxt::Value {
+  auto toks = loxt::lex(source);
+  loxt::Parser parser{toks};
+  parser.parse();
+  loxt::Evaluator evaluator{*toks, parser.slots()};
+  evaluator.bind("x", loxt::Value{4.0});
+  evaluator.bind("name", loxt::Value{"lox"});
+  return evaluator.evaluate(parser.tree());
+}
+
+}  // namespace
+
+TEST(EvalTest, Scalar) {
+  EXPECT_EQ(evaluate("1 + 2 * 3"), loxt::Value{7.0});
+  EXPECT_EQ(evaluate("(1 + 2) * -x"), loxt::Value{-12.0});
+  EXPECT_EQ(evaluate("name + \"!\""), loxt::Value{"lox!"});
+  EXPECT_EQ(evaluate("x > 3 and x < 5"), loxt::Value{true});
+  EXPECT_EQ(evaluate("nil or \"default\""), loxt::Value{"default"});
+  EXPECT_EQ(evaluate("false and undefined"), loxt::Value{false});
+  EXPECT_EQ(evaluate("1 == \"1\""), loxt::Value{false});
+  EXPECT_EQ(evaluate("!nil == true"), loxt::Value{true});
+  EXPECT_THROW(evaluate("1 + \"a\""), const char*);
+  EXPECT_THROW(evaluate("undefined"), const char*);
+}
+
+TEST(EvalTest, BatchMatchesScalar) {
+  std::string source =
+      "(price * qty > 100 or vip) and name != \"blocked\" and -qty < 0";
+  auto toks = loxt::lex(source);
+  loxt::Parser parser{toks};
+  parser.parse();
+
+  std::size_t rows = 3 * loxt::Batch_Size + 17;
+  std::vector<double> price(rows);
+  std::vector<double> qty(rows);
+  std::unique_ptr<bool[]> vip = std::make_unique<bool[]>(rows);
+  std::vector<std::string> name(rows);
+  for (std::size_t row = 0; row < rows; ++row) {
+    price[row] = static_cast<double>(row % 37);
+    qty[row] = static_cast<double>(row % 5);
+    vip[row] = row % 11 == 0;
+    name[row] = row % 7 == 0 ? "blocked" : "user" + std::to_string(row);
+  }
+
+  loxt::BatchEvaluator batch{parser.tree(), *toks};
+  batch.bind("price", std::span<const double>{price});
+  batch.bind("qty", std::span<const double>{qty});
+  batch.bind("vip", std::span<const bool>{vip.get(), rows});
+  batch.bind("name", std::span<const std::string>{name});
+  auto selected = batch.filter(rows);
+  auto values = batch.evaluate(rows);
+
+  std::vector<std::size_t> expected;
+  loxt::Evaluator scalar{*toks, parser.slots()};
+  for (std::size_t row = 0; row < rows; ++row) {
+    scalar.bind("price", loxt::Value{price[row]});
+    scalar.bind("qty", loxt::Value{qty[row]});
+    scalar.bind("vip", loxt::Value{vip[row]});
+    scalar.bind("name", loxt::Value{name[row]});
+    auto value = scalar.evaluate(parser.tree());
+    EXPECT_EQ(values[row], value) << "row " << row;
+    if (value.truthy()) {
+      expected.push_back(row);
+    }
+  }
+  EXPECT_FALSE(expected.empty());
+  EXPECT_EQ(selected, expected);
+}
+
+TEST(EvalTest, BatchTypeErrors) {
+  std::string source = "price + name";
+  auto toks = loxt::lex(source);
+  loxt::Parser parser{toks};
+  parser.parse();
+  std::vector<double> price(4);
+  std::vector<std::string> name(4);
+
+  loxt::BatchEvaluator batch{parser.tree(), *toks};
+  batch.bind("price", std::span<const double>{price});
+  EXPECT_THROW(batch.filter(4), const char*);
+  batch.bind("name", std::span<const std::string>{name});
+  EXPECT_THROW(batch.filter(4), const char*);
+}
+
+TEST(EvalTest, BatchDefersTypeErrors) {
+  std::size_t rows = 6;
+  std::vector<double> n = {0, 1, 2, 3, 4, 5};
+  std::vector<std::string> s(rows, "s");
+  auto run = [&](const std::string& source) {
+    auto toks = loxt::lex(source);
+    loxt::Parser parser{toks};
+    parser.parse();
+    loxt::BatchEvaluator batch{parser.tree(), *toks};
+    batch.bind("n", std::span<const double>{n});
+    batch.bind("s", std::span<const std::string>{s});
+    auto values = batch.evaluate(rows);
+
+    loxt::Evaluator scalar{*toks, parser.slots()};
+    for (std::size_t row = 0; row < rows; ++row) {
+      scalar.bind("n", loxt::Value{n[row]});
+      scalar.bind("s", loxt::Value{s[row]});
+      EXPECT_EQ(values[row], scalar.evaluate(parser.tree()))
+          << source << ", row " << row;
+    }
+    return values;
+  };
+  EXPECT_EQ(run("true or (1 + \"a\")")[0], loxt::Value{true});
+  EXPECT_EQ(run("false and -\"a\"")[0], loxt::Value{false});
+  EXPECT_EQ(run("true or undefined")[0], loxt::Value{true});
+  run("n > 0 and s or n");
+  run("(n > 2 and s or \"t\") + s == \"ss\"");
+  run("n >= 0 or n + s");
+  run("-(n < 3 and n or 1) * 2");
+  EXPECT_THROW(run("false or (1 + \"a\")"), const char*);
+  EXPECT_THROW(run("n > 2 and -s"), const char*);
+  EXPECT_THROW(run("(n > 2 and s or n) - 1"), const char*);
+}
+
+TEST(EvalTest, ClosureMatchesEvaluator) {
+  std::vector<std::string> sources = {
+      "(price * qty > 100 or vip) and name != \"blocked\" and -qty < 0",
+      "name + \"!\"",
+      "vip or name",
+      "!vip == (qty >= 3)",
+      "price / (qty + 1) - -price",
+  };
+  for (const auto& source : sources) {
+    auto toks = loxt::lex(source);
+    loxt::Parser parser{toks};
+    parser.parse();
+
+    // Typing price lets its arithmetic specialise; the rest stay Any.
+    loxt::ClosureCompiler compiler{*toks};
+    compiler.declare("price", loxt::StaticType::Number);
+    auto compiled = compiler.compile(parser.tree());
+
+    const auto& layout = parser.slots();
+    std::vector<loxt::Value> env(layout.size());
+    auto bind = [&](std::string_view name, loxt::Value value) {
+      if (auto ident = toks->find_identifier(name)) {
+        env[*layout.find(*ident)] = std::move(value);
+      }
+    };
+    loxt::Evaluator scalar{*toks, parser.slots()};
+    for (int row = 0; row < 40; ++row) {
+      std::pair<std::string_view, loxt::Value> inputs[] = {
+          {"price", loxt::Value{static_cast<double>(row % 37)}},
+          {"qty", loxt::Value{static_cast<double>(row % 5)}},
+          {"vip", loxt::Value{row % 11 == 0}},
+          {"name", loxt::Value{row % 7 == 0 ? "blocked" : "user"}},
+      };
+      for (auto& [name, value] : inputs) {
+        bind(name, value);
+        scalar.bind(name, value);
+      }
+      auto expected = scalar.evaluate(parser.tree());
+      EXPECT_EQ(compiled(env), expected) << source << " row " << row;
+      EXPECT_EQ(compiled.test(env), expected.truthy()) << source;
+    }
+  }
+}
+
+TEST(EvalTest, ClosureTypes) {
+  auto compile = [](const std::string& source) {
+    auto toks = loxt::lex(source);
+    loxt::Parser parser{toks};
+    parser.parse();
+    loxt::ClosureCompiler compiler{*toks};
+    compiler.declare("n", loxt::StaticType::Number);
+    compiler.declare("s", loxt::StaticType::String);
+    return compiler.compile(parser.tree()).type();
+  };
+  EXPECT_EQ(compile("n * 2 + 1"), loxt::StaticType::Number);
+  EXPECT_EQ(compile("s + \"x\""), loxt::StaticType::String);
+  EXPECT_EQ(compile("n < 1 or n > 9"), loxt::StaticType::Bool);
+  EXPECT_EQ(compile("n or s"), loxt::StaticType::Any);
+  EXPECT_EQ(compile("other * 2"), loxt::StaticType::Number);
+  // Proven type errors only throw when evaluated.
+  EXPECT_EQ(compile("n + s"), loxt::StaticType::Any);
+  EXPECT_EQ(compile("-s"), loxt::StaticType::Any);
+}
+
+TEST(EvalTest, ClosureDefersTypeErrors) {
+  auto run = [](const std::string& source) {
+    auto toks = loxt::lex(source);
+    loxt::Parser parser{toks};
+    parser.parse();
+    loxt::ClosureCompiler compiler{*toks};
+    compiler.declare("n", loxt::StaticType::Number);
+    compiler.declare("s", loxt::StaticType::String);
+    auto compiled = compiler.compile(parser.tree());
+    std::vector<loxt::Value> env(parser.slots().size());
+    for (loxt::Slot slot = 0; slot < env.size(); ++slot) {
+      auto name = toks->identifier(parser.slots().identifier(slot));
+      env[slot] = name == "n" ? loxt::Value{1.0} : loxt::Value{"s"};
+    }
+    return compiled(env);
+  };
+  EXPECT_EQ(run("true or (1 + \"a\")"), loxt::Value{true});
+  EXPECT_EQ(run("false and -\"a\""), loxt::Value{false});
+  EXPECT_EQ(run("n > 0 or n + s"), loxt::Value{true});
+  EXPECT_THROW(run("false or (1 + \"a\")"), const char*);
+  EXPECT_THROW(run("n + s"), const char*);
+  EXPECT_THROW(run("-s"), const char*);
+}
+
+TEST(EvalTest, ResolverAssignsDenseSlots) {
+  std::string source = "a + b * a - (c or b)";
+  auto toks = loxt::lex(source);
+  loxt::Parser parser{toks};
+  parser.parse();
+  const auto& layout = parser.slots();
+  ASSERT_EQ(layout.size(), 3);
+
+  std::vector<bool> seen(layout.size());
+  for (treeceratops::node_id node = 0; node < parser.tree().size(); ++node) {
+    const auto& data = parser.tree()[node];
+    if (data.kind == loxt::ExprKind::Variable) {
+      ASSERT_LT(data.slot, layout.size());
+      EXPECT_EQ(layout.identifier(data.slot), data.identifier);
+      seen[data.slot] = true;
+    }
+  }
+  EXPECT_EQ(seen, std::vector<bool>(layout.size(), true));
+
+  // Resolving again, as after a cache load, keeps the layout.
+  auto again = loxt::resolve(parser.tree(), *toks);
+  for (loxt::Slot slot = 0; slot < layout.size(); ++slot) {
+    EXPECT_EQ(again.identifier(slot), layout.identifier(slot));
+  }
+}
+
+TEST(EvalTest, StaticExprMatchesParser) {
+  static constexpr auto Expr = loxt::static_expr<
+      R"((price * qty > 100 or vip) // a comment
+         and name != "blocked" and -qty < 0)">();
+  static_assert(Expr.slot_count() == 4);
+  static_assert(Expr.find_slot("vip") == 2);
+  static_assert(Expr.nodes()[0].subtree_size == Expr.nodes().size());
+  static_assert(Expr.string_literal(0) == "blocked");
+
+  std::string source = R"((price * qty > 100 or vip) // a comment
+         and name != "blocked" and -qty < 0)";
+  auto toks = loxt::lex(source);
+  loxt::Parser parser{toks};
+  parser.parse();
+  EXPECT_EQ(Expr.nodes().size(), parser.tree().size());
+
+  loxt::Evaluator scalar{*toks, parser.slots()};
+  std::vector<loxt::Value> slots(Expr.slot_count());
+  for (int row = 0; row < 40; ++row) {
+    std::pair<std::string_view, loxt::Value> inputs[] = {
+        {"price", loxt::Value{static_cast<double>(row % 37)}},
+        {"qty", loxt::Value{static_cast<double>(row % 5)}},
+        {"vip", loxt::Value{row % 11 == 0}},
+        {"name", loxt::Value{row % 7 == 0 ? "blocked" : "user"}},
+    };
+    for (auto& [name, value] : inputs) {
+      slots[*Expr.find_slot(name)] = value;
+      scalar.bind(name, value);
+    }
+    EXPECT_EQ(Expr.evaluate(slots), scalar.evaluate(parser.tree()))
+        << "row " << row;
+  }
+}
+
+// lex() and Parser against the StaticParser behind static_expr(), run at
+// run time: both must reject the same sources and build the same trees.
+TEST(EvalTest, StaticParserAgreesWithParser) {
+  const std::vector<std::string> corpus = {
+      "1 + 2 * 3 - 4 / 5",
+      "!(a == b) or c and -d <= 18446744073709551615",
+      "\"x\" + name != \"y\" // trailing comment",
+      "((nil)) == true and !false",
+      "a > b >= c < d <= e",
+      "-(-(x)) * (y + (z))",
+      "1 2",
+      "(1 + 2",
+      "1 +",
+      ")",
+      "18446744073709551616",
+      "\"unterminated",
+      "1 # 2",
+      "",
+  };
+  for (const auto& source : corpus) {
+    std::vector<loxt::StaticNode> expected;
+    bool static_ok = true;
+    try {
+      expected = loxt::detail::StaticParser{source}.flatten();
+    } catch (const char*) {
+      static_ok = false;
+    }
+
+    auto toks = loxt::lex(source);
+    loxt::Parser parser{toks};
+    bool runtime_ok = !toks->has_error();
+    try {
+      if (runtime_ok) {
+        parser.parse();
+      }
+    } catch (const char*) {
+      runtime_ok = false;
+    }
+    ASSERT_EQ(static_ok, runtime_ok) << source;
+    if (!runtime_ok) {
+      continue;
+    }
+
+    // The parser's ids are not in pre-order, so walk it.
+    std::vector<loxt::ExprData> actual;
+    std::vector<loxt::ExprTree::const_iterator> stack{parser.tree().begin()};
+    while (!stack.empty()) {
+      auto node = stack.back();
+      stack.pop_back();
+      actual.push_back(*node);
+      for (auto idx = node.child_count(); idx-- > 0;) {
+        stack.push_back(node.child(idx));
+      }
+    }
+    ASSERT_EQ(actual.size(), expected.size()) << source;
+    for (std::size_t idx = 0; idx < actual.size(); ++idx) {
+      const auto& lhs = actual[idx];
+      const auto& rhs = expected[idx].data;
+      ASSERT_EQ(lhs.kind, rhs.kind) << source << " node " << idx;
+      if (lhs.kind == loxt::ExprKind::Binary) {
+        EXPECT_EQ(lhs.bOp, rhs.bOp) << source << " node " << idx;
+      } else if (lhs.kind == loxt::ExprKind::Unary) {
+        EXPECT_EQ(lhs.uOp, rhs.uOp) << source << " node " << idx;
+      } else if (lhs.kind == loxt::ExprKind::Literal) {
+        EXPECT_EQ(lhs.literalKind, rhs.literalKind) << source;
+      }
+    }
+  }
+}
+
+TEST(EvalTest, CacheReusesPureSubtrees) {
+  loxt::EvalCache cache{64};
+  auto run = [&](const std::string& source, double x) {
+    auto toks = loxt::lex(source);
+    loxt::Parser parser{toks};
+    parser.parse();
+    loxt::Evaluator evaluator{*toks, parser.slots()};
+    evaluator.use_cache(cache);
+    evaluator.bind("x", loxt::Value{x});
+    return evaluator.evaluate(parser.tree());
+  };
+
+  // Two pure subtrees: 1 + 2 and the negation.
+  const std::string source = "x * (1 + 2) - -(\"a\" + \"b\" == \"ab\" and 3)";
+  EXPECT_EQ(run(source, 1.0), loxt::Value{6.0});
+  EXPECT_EQ(cache.hits(), 0U);
+  EXPECT_EQ(cache.misses(), 2U);
+  EXPECT_EQ(cache.size(), 2U);
+
+  EXPECT_EQ(run(source, 2.0), loxt::Value{9.0});
+  EXPECT_EQ(cache.hits(), 2U);
+
+  // Keys hold literal values, not token indices, so another source sharing
+  // a subexpression hits too.
+  EXPECT_EQ(run("(1 + 2) / x", 3.0), loxt::Value{1.0});
+  EXPECT_EQ(cache.hits(), 3U);
+  EXPECT_EQ(cache.misses(), 2U);
+  EXPECT_DOUBLE_EQ(cache.hit_rate(), 0.6);
+
+  // Type errors are thrown every time, never cached.
+  EXPECT_THROW(run("x + (1 + \"a\")", 0.0), const char*);
+  EXPECT_EQ(cache.size(), 2U);
+}
+
+// Editing a tree in place re-indexes it, even when its node count stays.
+TEST(EvalTest, CacheSeesTreeEdits) {
+  loxt::EvalCache cache{64};
+  auto toks = loxt::lex("1 - 2");
+  loxt::Parser parser{toks};
+  parser.parse();
+  loxt::Evaluator evaluator{*toks, parser.slots()};
+  evaluator.use_cache(cache);
+  auto& tree = parser.tree();
+  EXPECT_EQ(evaluator.evaluate(tree), loxt::Value{-1.0});
+
+  // Swap the operands, leaving 2 - 1 in the same nodes.
+  auto size = tree.size();
+  auto minus = tree.begin().child(0);
+  auto lhs = minus.child(0);
+  tree.detach(lhs);
+  tree.make_parent(minus, lhs);
+  ASSERT_EQ(tree.size(), size);
+  EXPECT_EQ(evaluator.evaluate(tree), loxt::Value{1.0});
+}
+
+TEST(EvalTest, CacheStaysWithinCapacity) {
+  loxt::EvalCache cache{4};
+  ASSERT_LE(cache.capacity(), 4U);
+  for (int idx = 0; idx < 32; ++idx) {
+    auto toks = loxt::lex(std::to_string(idx) + " * 2");
+    loxt::Parser parser{toks};
+    parser.parse();
+    loxt::Evaluator evaluator{*toks, parser.slots()};
+    evaluator.use_cache(cache);
+    EXPECT_EQ(evaluator.evaluate(parser.tree()), loxt::Value{idx * 2.0});
+    EXPECT_LE(cache.size(), cache.capacity());
+  }
+}
+
+TEST(EvalTest, InferTypes) {
+  auto infer = [](const std::string& source) {
+    auto toks = loxt::lex(source);
+    loxt::Parser parser{toks};
+    parser.set_type_check(true);
+    parser.parse();
+    auto& tree = parser.tree();
+    return parser.types()[tree.begin().id()];
+  };
+  using loxt::StaticType;
+  EXPECT_EQ(infer("1 + 2 * 3"), StaticType::Number);
+  EXPECT_EQ(infer("\"a\" + \"b\""), StaticType::String);
+  EXPECT_EQ(infer("x - 1"), StaticType::Number);
+  EXPECT_EQ(infer("x + \"!\""), StaticType::String);
+  EXPECT_EQ(infer("x + x"), StaticType::Any);
+  EXPECT_EQ(infer("1 < 2 and !x"), StaticType::Bool);
+  EXPECT_EQ(infer("1 or \"a\""), StaticType::Any);
+  EXPECT_EQ(infer("(nil)"), StaticType::Nil);
+
+  // Proven type errors are parse errors, even where never evaluated.
+  EXPECT_THROW(infer("\"a\" - 1"), const char*);
+  EXPECT_THROW(infer("1 + \"a\""), const char*);
+  EXPECT_THROW(infer("-true"), const char*);
+  EXPECT_THROW(infer("false and nil > x"), const char*);
+  EXPECT_NO_THROW(infer("x > 1 == (\"a\" == 1)"));
+}
+
+TEST(EvalTest, TypedEvaluatorMatches) {
+  for (const std::string source :
+       {"1 + 2 * 3 - x / 4", "(x + 1) * (x - 1) > 8 == true",
+        "-(x * 2) <= x", "\"a\" + \"b\" == \"ab\" or x"}) {
+    auto toks = loxt::lex(source);
+    loxt::Parser parser{toks};
+    parser.set_type_check(true);
+    parser.parse();
+    loxt::Evaluator plain{*toks, parser.slots()};
+    plain.bind("x", loxt::Value{4.0});
+    loxt::Evaluator typed{*toks, parser.slots()};
+    typed.use_types(parser.types());
+    typed.bind("x", loxt::Value{4.0});
+    EXPECT_EQ(typed.evaluate(parser.tree()), plain.evaluate(parser.tree()))
+        << source;
+  }
+}
+
+TEST(EvalTest, JitMatchesEvaluator) {
+  if (!loxt::jit_supported()) {
+    GTEST_SKIP() << "no JIT on this target";
+  }
+  std::vector<std::string> sources = {
+      "price * qty - price / (qty + 1)",
+      "(price * qty > 100 or vip) and -qty < 0",
+      "!vip == (qty >= 3)",
+      "price / qty != price / qty",
+      "-(price - 3) <= qty and !(price == 2) or !price",
+      "(((price + 1) * (qty + 2)) - ((price - 3) / (qty - 4))) >= 2",
+  };
+  for (const auto& source : sources) {
+    auto toks = loxt::lex(source);
+    loxt::Parser parser{toks};
+    parser.parse();
+    loxt::JitCompiler compiler{*toks};
+    compiler.declare("price", loxt::StaticType::Number);
+    compiler.declare("qty", loxt::StaticType::Number);
+    compiler.declare("vip", loxt::StaticType::Bool);
+    auto jit = compiler.compile(parser.tree());
+    ASSERT_TRUE(jit) << source;
+
+    const auto& layout = parser.slots();
+    std::vector<double> slots(layout.size());
+    loxt::Evaluator scalar{*toks, layout};
+    for (int row = 0; row < 40; ++row) {
+      std::pair<std::string_view, loxt::Value> inputs[] = {
+          {"price", loxt::Value{static_cast<double>(row % 37)}},
+          {"qty", loxt::Value{static_cast<double>(row % 5)}},
+          {"vip", loxt::Value{row % 11 == 0}},
+      };
+      for (auto& [name, value] : inputs) {
+        scalar.bind(name, value);
+        if (auto ident = toks->find_identifier(name)) {
+          slots[*layout.find(*ident)] =
+              value.is_bool() ? value.as_bool() : value.as_number();
+        }
+      }
+      auto expected = scalar.evaluate(parser.tree());
+      auto result = (*jit)(slots.data());
+      auto actual = jit->type() == loxt::StaticType::Bool
+                        ? loxt::Value{result != 0.0}
+                        : loxt::Value{result};
+      EXPECT_EQ(actual, expected) << source << " row " << row;
+    }
+  }
+
+  // Strings, nil, undeclared variables and trees needing more registers
+  // than there are stay on the interpreter.
+  std::string nested = "1";
+  for (int level = 0; level < 20; ++level) {
+    nested = "1 + (" + nested + ")";
+  }
+  for (const auto& source : std::vector<std::string>{
+           "\"a\" == \"a\"", "nil == nil", "price + other", nested}) {
+    auto toks = loxt::lex(source);
+    loxt::Parser parser{toks};
+    parser.parse();
+    loxt::JitCompiler compiler{*toks};
+    compiler.declare("price", loxt::StaticType::Number);
+    EXPECT_FALSE(compiler.compile(parser.tree())) << source;
+  }
+}
+
+TEST(EvalTest, TieredExprCompilesWhenHot) {
+  std::string source = "x * 2 > 5 and flag";
+  auto toks = loxt::lex(source);
+  loxt::Parser parser{toks};
+  parser.parse();
+  const auto& layout = parser.slots();
+  loxt::TieredExpr expr{*toks, parser.tree(), layout, 3};
+  expr.declare("x", loxt::StaticType::Number);
+  expr.declare("flag", loxt::StaticType::Bool);
+
+  std::vector<loxt::Value> env(layout.size());
+  auto x = *layout.find(*toks->find_identifier("x"));
+  auto flag = *layout.find(*toks->find_identifier("flag"));
+  for (int call = 1; call <= 6; ++call) {
+    env[x] = loxt::Value{static_cast<double>(call)};
+    env[flag] = loxt::Value{call % 2 == 0};
+    EXPECT_EQ(expr.evaluate(env), loxt::Value{call >= 3 && call % 2 == 0});
+    EXPECT_EQ(expr.jitted(), loxt::jit_supported() && call >= 3);
+  }
+
+  // A value of another type than declared takes the interpreter's path.
+  env[flag] = loxt::Value{"yes"};
+  EXPECT_EQ(expr.evaluate(env), loxt::Value{"yes"});
+
+  // Values past the layout are ignored by both tiers.
+  env[flag] = loxt::Value{true};
+  env.emplace_back("extra");
+  EXPECT_EQ(expr.evaluate(env), loxt::Value{true});
+  loxt::TieredExpr cold{*toks, parser.tree(), layout, 100};
+  EXPECT_EQ(cold.evaluate(env), loxt::Value{true});
+
+  env.resize(layout.size() - 1);
+  EXPECT_THROW(expr.evaluate(env), const char*);
+}
+
+TEST(EvalTest, FrozenTreeMatchesTree) {
+  for (std::string source :
+       {"(1 + 2) * -x", "name + \" \" + (name + \"!\") + name",
+        "x > 3 and x < 5 or nil", "false and undefined", "!(x == 4) or 7",
+        "1 + \"a\"", "undefined"}) {
+    auto toks = loxt::lex(source);
+    loxt::Parser parser{toks};
+    parser.parse();
+    auto frozen = treeceratops::freeze(parser.tree());
+    loxt::Evaluator evaluator{*toks, parser.slots()};
+    evaluator.bind("x", loxt::Value{4.0});
+    evaluator.bind("name", loxt::Value{"lox"});
+
+    std::optional<loxt::Value> expected;
+    try {
+      expected = evaluator.evaluate(parser.tree());
+    } catch (const char*) {
+      EXPECT_THROW(evaluator.evaluate(frozen), const char*) << source;
+      continue;
+    }
+    EXPECT_EQ(evaluator.evaluate(frozen), *expected) << source;
+  }
+}
+
+TEST(EvalTest, RopeConcatenation) {
+  loxt::StringArena arena{64};
+  std::string long_text(40, 'a');
+  auto shared = loxt::Rope::view(long_text, arena);
+  EXPECT_FALSE(shared.is_inline());
+  // Viewing a long string copies nothing.
+  EXPECT_LT(arena.bytes_used(), long_text.size());
+
+  auto small = loxt::Rope::copy("bc", arena);
+  EXPECT_TRUE(small.is_inline());
+  auto joined = loxt::Rope::concat(small, loxt::Rope::copy("def", arena),
+                                   arena);
+  EXPECT_TRUE(joined.is_inline());
+  EXPECT_EQ(joined.flatten(), "bcdef");
+
+  auto rope = loxt::Rope::concat(joined, shared, arena);
+  rope = loxt::Rope::concat(rope, rope, arena);
+  EXPECT_EQ(rope.size(), 90U);
+  EXPECT_EQ(rope.flatten(), "bcdef" + long_text + "bcdef" + long_text);
+
+  arena.reset();
+  EXPECT_EQ(arena.bytes_used(), 0U);
+}
+
+TEST(EvalTest, LongStringConcatenation) {
+  constexpr int Pieces = 20000;
+  std::string source = "name";
+  std::string expected = "lox";
+  for (int idx = 0; idx < Pieces; ++idx) {
+    auto piece = "<p>" + std::to_string(idx % 10) + "</p>";
+    if (idx % 100 == 0) {
+      source += " + (name + \"" + piece + "\")";
+      expected += "lox" + piece;
+    } else {
+      source += " + \"" + piece + "\"";
+      expected += piece;
+    }
+  }
+  EXPECT_EQ(evaluate(source), loxt::Value{expected});
+
+  EXPECT_EQ(evaluate("\"a\" + \"b\" == \"ab\""), loxt::Value{true});
+  EXPECT_EQ(evaluate("(x + 1) + 2"), loxt::Value{7.0});
+  EXPECT_EQ(evaluate("name + (nil or \"!\")"), loxt::Value{"lox!"});
+  EXPECT_THROW(evaluate("\"a\" + \"b\" + 1"), const char*);
+  EXPECT_THROW(evaluate("1 + (\"a\" + \"b\")"), const char*);
+}
@@ -2,9 +2,17 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <limits>
 #include <print>
+#include <sstream>
+#include <thread>
+#include <vector>
 
+#include "loxt/dump.hpp"
+#include "loxt/eval.hpp"
 #include "loxt/lexer.hpp"
+#include "loxt/parallel_parse.hpp"
 #include "loxt/parser.hpp"
 
 namespace loxt {
@@ -14,24 +22,19 @@ class PrinterVisitor : public Visitor {
   explicit PrinterVisitor(const std::shared_ptr<TokenList>& tokens)
       : tokens_(tokens) {}
 
-  void print(Expr& expr) { expr.accept(*this); }
+  void print(Expr& expr) { expr.walk(*this); }
 
-  void visit(RootExpr& expr) override { expr.expr().accept(*this); }
+  void visit(RootExpr& /*expr*/) override {}
 
   void visit(BinaryExpr& expr) override {
     std::println("{}BinaryExpr {}", std::string(4 * depth_, ' '),
                  to_string(expr.op_kind()));
     depth_++;
-    expr.lhs().accept(*this);
-    expr.rhs().accept(*this);
-    depth_--;
   }
 
-  void visit(ParenExpr& expr) override {
+  void visit(ParenExpr& /*expr*/) override {
     std::println("{}ParenExpr", std::string(4 * depth_, ' '));
     depth_++;
-    expr.expr().accept(*this);
-    depth_--;
   }
 
   void visit(NumberExpr& expr) override {
@@ -52,18 +55,51 @@ class PrinterVisitor : public Visitor {
     std::println("{}UnaryExpr {}", std::string(4 * depth_, ' '),
                  static_cast<int>(expr.op_kind()));
     depth_++;
-    expr.expr().accept(*this);
-    depth_--;
   }
 
-  void visit(NilExpr& expr) override {
+  void visit(NilExpr& /*expr*/) override {
     std::println("{}NilExpr", std::string(4 * depth_, ' '));
   }
 
+  void visit(VariableExpr& expr) override {
+    std::println("{}VariableExpr {}", std::string(4 * depth_, ' '),
+                 tokens_->identifier(expr.identifier()));
+  }
+
+  void leave(Expr& expr) override {
+    auto kind = expr.e_kind();
+    if (kind == ExprKind::Binary || kind == ExprKind::Paren ||
+        kind == ExprKind::Unary) {
+      depth_--;
+    }
+  }
+
  private:
   std::shared_ptr<TokenList> tokens_;
   int depth_{0};
 };
+
+// Counts nodes without printing, for trees too large to print.
+class CountingVisitor : public Visitor {
+ public:
+  void visit(RootExpr& /*expr*/) override { ++count_; }
+  void visit(BinaryExpr& /*expr*/) override { ++count_; }
+  void visit(ParenExpr& /*expr*/) override { ++count_; }
+  void visit(NumberExpr& /*expr*/) override { ++count_; }
+  void visit(StringExpr& /*expr*/) override { ++count_; }
+  void visit(BoolExpr& /*expr*/) override { ++count_; }
+  void visit(UnaryExpr& /*expr*/) override { ++count_; }
+  void visit(NilExpr& /*expr*/) override { ++count_; }
+  void visit(VariableExpr& /*expr*/) override { ++count_; }
+  void leave(Expr& /*expr*/) override { ++left_; }
+
+  [[nodiscard]] auto count() const -> std::size_t { return count_; }
+  [[nodiscard]] auto left() const -> std::size_t { return left_; }
+
+ private:
+  std::size_t count_ = 0;
+  std::size_t left_ = 0;
+};
 }  // namespace loxt
 
 TEST(LexerTest, LexerTest1) {
@@ -91,7 +127,7 @@ TEST(LexerTest, LexerTest1) {
 
 TEST(ParserTest, parserTest) {
   std::string str =
-      R"("123" == "Hello" != "World" == "outer string" + !"fsdd"))";
+      R"("123" == "Hello" != "World" == "outer string" + !"fsdd")";
   auto toks = loxt::lex(str);
   loxt::Parser parser{toks};
   parser.parse();
@@ -114,3 +150,277 @@ TEST(ParserTest, parserTest1) {
     std::cout << err;
   }
 }
+
+TEST(ParserTest, HashConsSharesSubtrees) {
+  std::string str = R"((1 + "a") * (1 + "a") == (1 + "b"))";
+  auto toks = loxt::lex(str);
+  loxt::Parser plain{toks};
+  plain.parse();
+  loxt::Parser shared{toks, loxt::BuildMode::HashConsed};
+  shared.parse();
+
+  auto& tree = shared.tree();
+  // Root, ==, * and one shared (1 + "a"), then (1 + "b") reusing the 1.
+  EXPECT_EQ(plain.tree().size(), 15U);
+  EXPECT_EQ(tree.size(), 10U);
+
+  auto mul = tree.begin().child(0).child(0);
+  EXPECT_EQ(mul->bOp, loxt::BinaryOpKind::Mul);
+  EXPECT_EQ(mul.child(0).id(), mul.child(1).id());
+
+  auto rhs = tree.begin().child(0).child(1).child(0);
+  EXPECT_EQ(rhs.child(0).id(), mul.child(0).child(0).child(0).id());
+  EXPECT_NE(rhs.child(1).id(), mul.child(0).child(0).child(1).id());
+
+  loxt::PrinterVisitor printer(toks);
+  loxt::Expr expr{tree, tree.begin()};
+  printer.print(expr);
+}
+
+TEST(ParserTest, ParallelStatements) {
+  std::string str;
+  for (int i = 0; i < 500; ++i) {
+    str += std::to_string(i) + " * (2 + " + std::to_string(i) + ") == -7;\n";
+  }
+  str += "\"last\" != nil";
+  auto toks = loxt::lex(str);
+
+  loxt::Parser sequential{toks};
+  sequential.parse_range(0, toks->size() - 1);
+
+  loxt::ThreadPool pool{4};
+  auto trees = loxt::parse_statements(toks, pool);
+  EXPECT_GT(trees.size(), 1U);
+  auto merged = loxt::merge_trees(std::move(trees), pool);
+
+  EXPECT_EQ(merged.begin().child_count(), 501U);
+  EXPECT_EQ(merged.size(), sequential.tree().size());
+
+  auto dump = [&](loxt::ExprTree& tree) {
+    std::ostringstream out;
+    {
+      loxt::DumpWriter writer{out};
+      loxt::dump_ast(writer, tree, *toks, loxt::DumpFormat::Text);
+    }
+    return out.str();
+  };
+  EXPECT_EQ(dump(merged), dump(sequential.tree()));
+
+  int visited = 0;
+  for (auto node = merged.begin(); node != merged.end(); ++node) {
+    ++visited;
+  }
+  EXPECT_EQ(visited, static_cast<int>(merged.size()));
+}
+
+TEST(ParserTest, ParallelStatementsReportErrors) {
+  std::string str = "1 + 2; 3 4; (5";
+  auto toks = loxt::lex(str);
+  loxt::ThreadPool pool{2};
+  EXPECT_THROW(loxt::parse_statements(toks, pool), const char*);
+}
+
+TEST(ParserTest, IncrementalReparse) {
+  auto text = [](loxt::Parser& parser, const loxt::TokenList& tokens) {
+    std::ostringstream out;
+    {
+      loxt::DumpWriter writer{out};
+      loxt::dump_ast(writer, parser.tree(), tokens, loxt::DumpFormat::Text);
+    }
+    return out.str();
+  };
+  auto reparse = [](loxt::Parser& parser,
+                    const std::shared_ptr<loxt::TokenList>& before,
+                    const std::shared_ptr<loxt::TokenList>& after) {
+    parser.reparse(after, loxt::token_edit(*before, *after));
+  };
+
+  std::string first = R"("s" + a * (b + 1) - (c * "t"))";
+  std::string second = R"("s" + a * (b + "x" * d) - (c * "t"))";
+  std::string third = R"("s" + a * (b) + ("x" * d) - (c * "t"))";
+  auto first_toks = loxt::lex(first);
+  loxt::Parser parser{first_toks};
+  parser.parse();
+  auto untouched = parser.tree().begin().child(0).child(1);
+  ASSERT_EQ(untouched->kind, loxt::ExprKind::Paren);
+  auto untouched_id = untouched.id();
+  auto size = parser.tree().size();
+
+  // The new string literal and identifier renumber the ones after them.
+  auto second_toks = loxt::lex(second);
+  reparse(parser, first_toks, second_toks);
+  loxt::Parser fresh{second_toks};
+  fresh.parse();
+  EXPECT_EQ(text(parser, *second_toks), text(fresh, *second_toks));
+  EXPECT_EQ(parser.tree().begin().child(0).child(1).id(), untouched_id);
+  // Only b + "x" * d was built again.
+  EXPECT_EQ(parser.tree().size(), size + 5);
+  EXPECT_EQ(parser.slots().size(), 4U);
+
+  // Splitting the parenthesis changes the structure around it.
+  auto third_toks = loxt::lex(third);
+  reparse(parser, second_toks, third_toks);
+  loxt::Parser full{third_toks};
+  full.parse();
+  EXPECT_EQ(text(parser, *third_toks), text(full, *third_toks));
+}
+
+TEST(ParserTest, DeepNesting) {
+  constexpr std::size_t Depth = 100000;
+  std::string source;
+  for (std::size_t level = 0; level < Depth; ++level) {
+    source += level % 2 == 0 ? "-(" : "!(1 + ";
+  }
+  source += "x";
+  for (std::size_t level = 0; level < Depth; ++level) {
+    source += ')';
+  }
+
+  auto toks = loxt::lex(source);
+  loxt::Parser parser{toks};
+  parser.set_max_depth(std::numeric_limits<std::size_t>::max());
+  parser.parse();
+  auto& tree = parser.tree();
+  // Root, x, and per level a unary operator and a Paren, plus a Binary and
+  // a literal on odd levels.
+  EXPECT_EQ(tree.size(), 2 + 3 * Depth);
+  EXPECT_EQ(tree.height(tree.begin()), 2 * Depth + Depth / 2 + 1);
+
+  std::size_t visited = 0;
+  for (auto node = tree.begin(); node != tree.end(); ++node) {
+    ++visited;
+  }
+  EXPECT_EQ(visited, tree.size());
+
+  loxt::CountingVisitor counter;
+  loxt::Expr expr{tree, tree.begin()};
+  expr.walk(counter);
+  EXPECT_EQ(counter.count(), tree.size());
+  EXPECT_EQ(counter.left(), tree.size());
+
+  loxt::Parser limited{toks};
+  limited.set_max_depth(2 * Depth - 1);
+  try {
+    limited.parse();
+    FAIL() << "parsed past the depth limit";
+  } catch (const char* err) {
+    EXPECT_STREQ(err, "Expression nested too deeply");
+  }
+  loxt::Parser enough{toks};
+  enough.set_max_depth(2 * Depth);
+  EXPECT_NO_THROW(enough.parse());
+}
+
+TEST(ParserTest, DefaultDepthLimit) {
+  auto parse = [](const std::string& source) {
+    auto toks = loxt::lex(source);
+    loxt::Parser parser{toks};
+    parser.parse();
+  };
+  auto chain = [](std::size_t operators) {
+    std::string source = "x";
+    for (std::size_t idx = 0; idx < operators; ++idx) {
+      source += " - x";
+    }
+    return source;
+  };
+  auto nested = [](std::size_t levels) {
+    return std::string(levels, '(') + "x" + std::string(levels, ')');
+  };
+  // Flat chains never count, however deep they make the tree.
+  EXPECT_NO_THROW(parse(chain(2 * loxt::Default_Max_Depth)));
+  EXPECT_NO_THROW(parse("(" + chain(2 * loxt::Default_Max_Depth) + ")"));
+  EXPECT_NO_THROW(parse(nested(loxt::Default_Max_Depth)));
+  EXPECT_THROW(parse(nested(loxt::Default_Max_Depth + 1)), const char*);
+  EXPECT_THROW(parse("-" + nested(loxt::Default_Max_Depth)), const char*);
+
+  // Reparsing inside a parenthesis counts the nesting around it.
+  auto before = loxt::lex(nested(loxt::Default_Max_Depth - 1));
+  loxt::Parser parser{before};
+  parser.parse();
+  auto after = loxt::lex(nested(loxt::Default_Max_Depth + 1));
+  EXPECT_THROW(parser.reparse(after, loxt::token_edit(*before, *after)),
+               const char*);
+}
+
+// Parses once, then reads the tree and tokens from every core at once
+// through const iterators, const node handles, evaluators, metadata queries
+// and the analyses that take a const tree. Every read must agree with the
+// first. Meant to be run under ThreadSanitizer too, see LOXT_TSAN.
+TEST(ParserTest, ConcurrentReaders) {
+  std::string source;
+  for (int idx = 0; idx < 2000; ++idx) {
+    source += std::to_string(idx) + " * (x + " + std::to_string(idx % 7) +
+              ") - -x == x or !(x < " + std::to_string(idx) + ");\n";
+  }
+  auto toks = loxt::lex(source);
+  loxt::Parser parser{*toks};
+  parser.parse_range(0, toks->size() - 1);
+  auto layout = loxt::resolve(parser.tree(), *toks);
+  parser.tree().track_metadata(true);
+
+  const loxt::ExprTree& tree = parser.tree();
+  const loxt::TokenList& tokens = *toks;
+  struct Summary {
+    std::size_t nodes = 0;
+    std::uint64_t literals = 0;
+    std::size_t visited = 0;
+    std::size_t truthy = 0;
+    std::size_t height = 0;
+    std::size_t units = 0;
+    std::size_t numbers = 0;
+    std::size_t dumped = 0;
+
+    auto operator==(const Summary&) const -> bool = default;
+  };
+  auto read = [&] {
+    Summary summary;
+    for (auto node = tree.begin(); node != tree.end(); ++node) {
+      ++summary.nodes;
+      if (node->kind == loxt::ExprKind::Literal &&
+          node->literalKind == loxt::LiteralKind::Number) {
+        summary.literals += tokens.number_literal(node->literalVal);
+      }
+    }
+    loxt::CountingVisitor counter;
+    loxt::Expr root{tree, tree.begin()};
+    root.walk(counter);
+    summary.visited = counter.count();
+    loxt::Evaluator evaluator{tokens, layout};
+    evaluator.bind("x", loxt::Value{3.0});
+    for (const auto& value : evaluator.evaluate_all(tree)) {
+      summary.truthy += value.truthy() ? 1 : 0;
+    }
+    summary.height = tree.height(tree.begin());
+    summary.units = tree.partition(tree.begin(), 8).size();
+    summary.numbers =
+        std::ranges::count(loxt::infer_types(tree), loxt::StaticType::Number);
+    std::ostringstream out;
+    loxt::DumpWriter writer{out};
+    loxt::dump_ast(writer, tree, tokens, loxt::DumpFormat::Binary);
+    writer.flush();
+    summary.dumped = out.str().size();
+    return summary;
+  };
+  auto expected = read();
+  EXPECT_EQ(expected.nodes, tree.size());
+  EXPECT_EQ(expected.visited, tree.size());
+
+  constexpr int Rounds = 8;
+  std::size_t threads = std::max(4U, std::thread::hardware_concurrency());
+  std::vector<int> matches(threads);
+  std::vector<std::thread> readers;
+  for (std::size_t id = 0; id < threads; ++id) {
+    readers.emplace_back([&, id] {
+      for (int round = 0; round < Rounds; ++round) {
+        matches[id] += read() == expected ? 1 : 0;
+      }
+    });
+  }
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  for (auto count : matches) {
+    EXPECT_EQ(count, Rounds);
+  }
+}
@@ -0,0 +1,115 @@
+#include "loxt/server.hpp"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST(ServerTest, HandlesEachRequestKind) {
+  loxt::Server server{1};
+
+  auto lexed = server.handle(loxt::RequestKind::Lex, "1 + x");
+  EXPECT_TRUE(lexed.ok);
+  EXPECT_NE(lexed.body.find("Plus"), std::string::npos) << lexed.body;
+
+  auto parsed = server.handle(loxt::RequestKind::Parse, "(1 + 2) * 3");
+  EXPECT_TRUE(parsed.ok);
+  EXPECT_NE(parsed.body.find("Mul"), std::string::npos) << parsed.body;
+
+  auto evaluated = server.handle(loxt::RequestKind::Evaluate,
+                                 "(1 + 2) * 3; \"a\" + \"b\"; !nil");
+  EXPECT_TRUE(evaluated.ok);
+  EXPECT_EQ(evaluated.body, "9\nab\ntrue\n");
+
+  // The worker's session is reused, so nothing leaks between requests.
+  evaluated = server.handle(loxt::RequestKind::Evaluate, "4 / 2");
+  EXPECT_EQ(evaluated.body, "2\n");
+
+  auto undefined = server.handle(loxt::RequestKind::Evaluate, "x");
+  EXPECT_FALSE(undefined.ok);
+  EXPECT_EQ(undefined.body, "Undefined variable");
+  EXPECT_FALSE(server.handle(loxt::RequestKind::Parse, "(1 +").ok);
+  EXPECT_EQ(server.requests(), 6U);
+}
+
+TEST(ServerTest, RejectsOverlongNumbers) {
+  loxt::Server server{1};
+  auto response =
+      server.handle(loxt::RequestKind::Evaluate, "99999999999999999999999");
+  EXPECT_FALSE(response.ok);
+  EXPECT_NE(response.body.find("Number literal is too large"),
+            std::string::npos)
+      << response.body;
+  EXPECT_TRUE(server.handle(loxt::RequestKind::Evaluate, "1 + 1").ok);
+}
+
+TEST(ServerTest, ServesClientsConcurrently) {
+  constexpr std::size_t Clients = 4;
+  constexpr std::size_t Requests = 50;
+  auto path = (std::filesystem::temp_directory_path() /
+               ("loxt-test-" + std::to_string(::getpid()) + ".sock"))
+                  .string();
+
+  loxt::Server server{Clients};
+  server.listen(path);
+  std::thread runner{[&] { server.run(); }};
+
+  std::vector<std::thread> clients;
+  std::vector<std::size_t> correct(Clients);
+  for (std::size_t id = 0; id < Clients; ++id) {
+    clients.emplace_back([&, id] {
+      loxt::Client client{path};
+      for (std::size_t idx = 0; idx < Requests; ++idx) {
+        auto source = std::to_string(id) + " * 100 + " + std::to_string(idx);
+        auto response = client.send(loxt::RequestKind::Evaluate, source);
+        if (response.ok &&
+            response.body == std::to_string(id * 100 + idx) + "\n") {
+          ++correct[id];
+        }
+      }
+      // Errors are answered, not dropped.
+      if (!client.send(loxt::RequestKind::Evaluate, "-").ok) {
+        ++correct[id];
+      }
+    });
+  }
+  for (auto& client : clients) {
+    client.join();
+  }
+  server.stop();
+  runner.join();
+
+  for (auto count : correct) {
+    EXPECT_EQ(count, Requests + 1);
+  }
+  EXPECT_EQ(server.requests(), Clients * (Requests + 1));
+}
+
+// A connection waiting for its next request holds no worker, so with a
+// single one an idle client does not keep others from being answered, nor
+// stop() from returning.
+TEST(ServerTest, IdleClientsHoldNoWorker) {
+  auto path = (std::filesystem::temp_directory_path() /
+               ("loxt-idle-" + std::to_string(::getpid()) + ".sock"))
+                  .string();
+
+  loxt::Server server{1};
+  server.listen(path);
+  std::thread runner{[&] { server.run(); }};
+
+  loxt::Client idle{path};
+  EXPECT_EQ(idle.send(loxt::RequestKind::Evaluate, "1 + 1").body, "2\n");
+  for (int round = 0; round < 3; ++round) {
+    loxt::Client other{path};
+    EXPECT_EQ(other.send(loxt::RequestKind::Evaluate, "2 * 3").body, "6\n");
+  }
+  EXPECT_EQ(idle.send(loxt::RequestKind::Evaluate, "nil").body, "nil\n");
+
+  server.stop();
+  runner.join();
+  EXPECT_EQ(server.requests(), 5U);
+}
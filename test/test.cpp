@@ -1,6 +1,12 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <string>
+#include <vector>
+
 #include "loxt/lexer.hpp"
+#include "loxt/session.hpp"
+#include "loxt/unicode.hpp"
 
 TEST(LexerTest, LexerTest) {
   std::string str = "int main";
@@ -24,3 +30,165 @@ TEST(LexerTest, LexerTest) {
   EXPECT_EQ(tok->loc.column, 9);
   EXPECT_EQ(tok->loc.line, 1);
 }
+
+TEST(LexerTest, StaticVectorBlocks) {
+  loxt::StaticVector<int, 64> vec;
+  for (int i = 0; i < 1000; ++i) {
+    vec.push_back(i);
+  }
+  EXPECT_EQ(vec.size(), 1000);
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_EQ(vec[i], i);
+  }
+  int expected = 0;
+  for (auto& elem : vec) {
+    EXPECT_EQ(elem, expected++);
+  }
+  EXPECT_EQ(expected, 1000);
+
+  vec.clear();
+  EXPECT_EQ(vec.size(), 0);
+  EXPECT_FALSE(vec.begin() != vec.end());
+}
+
+TEST(LexerTest, StaticVectorIteratorsSurviveGrowth) {
+  // The first block holds 16 elements, so end() is past every block.
+  loxt::StaticVector<int, 64> vec;
+  for (int i = 0; i < 16; ++i) {
+    vec.push_back(i);
+  }
+  EXPECT_EQ(vec.block_count(), 1);
+  auto end = vec.end();
+  auto last = vec.end() - 1;
+  vec.push_back(16);
+  EXPECT_EQ(vec.block_count(), 2);
+  EXPECT_EQ(*end, 16);
+  EXPECT_EQ(*++last, 16);
+  vec.push_back(17);
+  EXPECT_EQ(*++end, 17);
+}
+
+TEST(LexerTest, SessionSharesInterner) {
+  loxt::Session session;
+  auto first = session.lex("foo + bar");
+  auto second = session.lex("bar");
+  auto& toks = session.tokens();
+  EXPECT_EQ(first.begin, 0);
+  EXPECT_EQ(first.end, 4);
+  EXPECT_EQ(second.end - second.begin, 2);
+  EXPECT_EQ(toks[second.begin].identifier, toks[2].identifier);
+  EXPECT_EQ(toks[second.end - 1].kind, loxt::TokenKind::Eof());
+  EXPECT_EQ(toks.identifier(toks[second.begin].identifier), "bar");
+}
+
+TEST(LexerTest, BatchSharesStorage) {
+  std::vector<std::string> sources;
+  for (int i = 0; i < 1000; ++i) {
+    sources.push_back("limit_" + std::to_string(i % 10) + " > " +
+                      std::to_string(i) + " and \"on\"");
+  }
+  sources.emplace_back("1 + #");
+  auto batch = loxt::lex_batch(sources);
+  const auto& toks = *batch.tokens;
+  ASSERT_EQ(batch.ranges.size(), sources.size());
+  EXPECT_EQ(toks.identifier_count(), 10);
+
+  for (std::size_t idx = 0; idx < sources.size(); ++idx) {
+    auto single = loxt::lex(sources[idx]);
+    auto [begin, end] = batch.ranges[idx];
+    ASSERT_EQ(end - begin, single->size());
+    for (std::size_t tok = 0; tok < single->size(); ++tok) {
+      EXPECT_EQ(toks.to_string(toks[begin + tok]),
+                single->to_string((*single)[tok]));
+    }
+  }
+  EXPECT_EQ(batch.diagnostics.back(), 0);
+  EXPECT_EQ(toks.diagnostics().size(), 1);
+}
+
+TEST(LexerTest, StaticVectorRandomAccess) {
+  static_assert(std::random_access_iterator<loxt::TokenList::Iterator>);
+  static_assert(std::random_access_iterator<loxt::TokenList::ConstIterator>);
+
+  loxt::StaticVector<int, 64> vec;
+  vec.reserve(300);
+  EXPECT_EQ(vec.block_count(), 6);
+  for (int i = 0; i < 300; ++i) {
+    vec.push_back(i);
+  }
+  EXPECT_EQ(vec.block_count(), 6);
+
+  const auto& cvec = vec;
+  auto iter = cvec.begin();
+  EXPECT_EQ(iter[250], 250);
+  EXPECT_EQ(*(iter + 17), 17);
+  EXPECT_EQ(*(cvec.end() - 1), 299);
+  EXPECT_EQ(cvec.end() - cvec.begin(), 300);
+  EXPECT_TRUE(std::is_sorted(cvec.begin(), cvec.end()));
+  EXPECT_EQ(*std::lower_bound(cvec.begin(), cvec.end(), 123), 123);
+
+  std::size_t total = 0;
+  for (std::size_t blk = 0; blk < cvec.block_count(); ++blk) {
+    total += cvec.block(blk).size();
+  }
+  EXPECT_EQ(total, 300);
+}
+
+TEST(LexerTest, Utf8Validation) {
+  EXPECT_EQ(loxt::validate_utf8("plain ascii, longer than one vector"),
+            std::string_view::npos);
+  EXPECT_EQ(
+      loxt::validate_utf8("caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80"),
+      std::string_view::npos);
+  std::string bad = std::string(40, 'a') + "\xc3\x28";
+  EXPECT_EQ(loxt::validate_utf8(bad), 40U);
+  EXPECT_EQ(loxt::validate_utf8("\xc0\xaf"), 0U);          // overlong
+  EXPECT_EQ(loxt::validate_utf8("x\xed\xa0\x80"), 1U);     // surrogate
+  EXPECT_EQ(loxt::validate_utf8("\xf0\x9f\x98"), 0U);      // truncated
+}
+
+TEST(LexerTest, UnicodeIdentifiers) {
+  std::string str =
+      "\xce\xb1\xce\xb2 + _x1\xcc\x81 \"\xe2\x82\xac\" \xe2\x82\xac";
+  auto toks = loxt::lex(str);
+  ASSERT_EQ(toks->size(), 6);
+  EXPECT_EQ((*toks)[0].kind, loxt::TokenKind::Identifier());
+  EXPECT_EQ(toks->identifier((*toks)[0].identifier), "\xce\xb1\xce\xb2");
+  EXPECT_EQ((*toks)[1].loc.column, 4);
+  EXPECT_EQ(toks->identifier((*toks)[2].identifier), "_x1\xcc\x81");
+  EXPECT_EQ((*toks)[3].kind, loxt::TokenKind::String());
+  // The euro sign is not an identifier character.
+  EXPECT_EQ((*toks)[4].kind, loxt::TokenKind::Error());
+  ASSERT_EQ(toks->diagnostics().size(), 1U);
+  EXPECT_EQ(toks->diagnostics()[0].message,
+            "Unrecognized character '\xe2\x82\xac'");
+}
+
+TEST(LexerTest, InvalidUtf8StopsLexing) {
+  std::string str = "a\nb \xff c";
+  auto toks = loxt::lex(str);
+  ASSERT_EQ(toks->diagnostics().size(), 1U);
+  EXPECT_EQ(toks->diagnostics()[0].message, "Invalid UTF-8 sequence");
+  EXPECT_EQ(toks->diagnostics()[0].loc.line, 2);
+  EXPECT_EQ(toks->diagnostics()[0].loc.column, 3);
+  // a, b, Eof.
+  EXPECT_EQ(toks->size(), 3);
+}
+
+TEST(LexerTest, MemoryUsage) {
+  std::string small = "a + 1";
+  std::string large;
+  for (int i = 0; i < 1000; ++i) {
+    large += "name" + std::to_string(i) + " + \"a literal that is not short\" ";
+  }
+  auto small_usage = loxt::lex(small)->memory_usage();
+  auto large_usage = loxt::lex(large)->memory_usage();
+
+  EXPECT_GE(small_usage.tokens, 3 * sizeof(loxt::Token));
+  EXPECT_GT(large_usage.tokens, small_usage.tokens);
+  EXPECT_GT(large_usage.interner, 1000 * sizeof(std::string_view));
+  EXPECT_GT(large_usage.literals, 1000 * sizeof(std::string));
+  EXPECT_EQ(large_usage.diagnostics, 0U);
+  EXPECT_EQ(large_usage.total(), large_usage.tokens + large_usage.interner +
+                                     large_usage.literals);
+}
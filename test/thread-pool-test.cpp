@@ -0,0 +1,51 @@
+#include "loxt/thread_pool.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+TEST(ThreadPoolTest, RunsEveryTask) {
+  loxt::ThreadPool pool{4};
+  std::vector<int> out(1000, 0);
+  loxt::parallel_for(pool, out.size(), [&](std::size_t idx) {
+    out[idx] = static_cast<int>(idx);
+  });
+  for (std::size_t idx = 0; idx < out.size(); ++idx) {
+    EXPECT_EQ(out[idx], static_cast<int>(idx));
+  }
+}
+
+TEST(ThreadPoolTest, NestedSubmit) {
+  loxt::ThreadPool pool{2};
+  std::atomic<int> count{0};
+  for (int i = 0; i < 10; ++i) {
+    pool.submit([&] {
+      for (int j = 0; j < 10; ++j) {
+        pool.submit([&] { ++count; });
+      }
+    });
+  }
+  pool.wait();
+  EXPECT_EQ(count, 100);
+}
+
+TEST(ThreadPoolTest, RethrowsTaskException) {
+  loxt::ThreadPool pool{2};
+  std::atomic<int> count{0};
+  auto run = [&] {
+    loxt::parallel_for(pool, 10, [&](std::size_t idx) {
+      ++count;
+      if (idx == 3) {
+        throw std::out_of_range("task failed");
+      }
+    });
+  };
+  EXPECT_THROW(run(), std::out_of_range);
+  EXPECT_EQ(count, 10);
+  // The exception is reported once; the pool stays usable.
+  pool.submit([&] { ++count; });
+  pool.wait();
+  EXPECT_EQ(count, 11);
+}
@@ -0,0 +1,183 @@
+#include "treeceratops/frozen_tree.hpp"
+#include "treeceratops/tree.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <optional>
+#include <random>
+#include <vector>
+
+namespace {
+
+using Tree = treeceratops::tree<int>;
+
+// Builds 0(1(3 4) 2(5)) with metadata tracking switched on or off.
+auto make_tree(bool tracked) -> Tree {
+  Tree tree;
+  tree.track_metadata(tracked);
+  tree.push_root(0);
+  tree.push_child(tree.begin(), 1);
+  tree.push_child(tree.begin(), 2);
+  tree.push_child(tree.begin().child(0), 3);
+  tree.push_child(tree.begin().child(0), 4);
+  tree.push_child(tree.begin().child(1), 5);
+  return tree;
+}
+
+}  // namespace
+
+TEST(TreeTest, MetadataMatchesWalk) {
+  for (bool tracked : {false, true}) {
+    auto tree = make_tree(tracked);
+    EXPECT_FALSE(tree.empty());
+    EXPECT_EQ(tree.size(), 6U);
+    EXPECT_EQ(tree.subtree_size(tree.begin()), 6U);
+    EXPECT_EQ(tree.height(tree.begin()), 2U);
+    EXPECT_EQ(tree.subtree_size(tree.begin().child(0)), 3U);
+    EXPECT_EQ(tree.height(tree.begin().child(1)), 1U);
+    EXPECT_EQ(tree.depth(tree.begin().child(0).child(1)), 2);
+  }
+}
+
+TEST(TreeTest, MetadataFollowsReparenting) {
+  auto tree = make_tree(true);
+  EXPECT_EQ(tree.height(tree.begin()), 2U);
+
+  // Move 2(5) under 4, as the parser does when it folds an operand into a
+  // new binary node.
+  auto four = tree.begin().child(0).child(1);
+  tree.make_parent(four, tree.begin().child(1));
+  EXPECT_EQ(tree.subtree_size(tree.begin().child(0)), 5U);
+  EXPECT_EQ(tree.height(tree.begin()), 4U);
+  EXPECT_EQ(tree.depth(tree.begin().child(0).child(1).child(0)), 3);
+
+  tree.push_root(-1);
+  EXPECT_EQ(tree.depth(four), 3);
+  EXPECT_EQ(tree.subtree_size(tree.begin()), 7U);
+
+  int visited = 0;
+  for (auto node = tree.begin(); node != tree.end(); ++node) {
+    ++visited;
+  }
+  EXPECT_EQ(visited, 7);
+}
+
+// Random edits keep the tracked metadata equal to what a walk computes.
+TEST(TreeTest, IncrementalMetadataMatchesWalk) {
+  Tree tracked;
+  Tree walked;
+  tracked.track_metadata(true);
+  std::vector<treeceratops::node_id> attached;
+  std::minstd_rand rng{7};
+  auto pick = [&] { return attached[rng() % attached.size()]; };
+  auto at = [](Tree& tree, treeceratops::node_id node) {
+    return Tree::iterator{&tree, node};
+  };
+
+  for (int step = 0; step < 2000; ++step) {
+    auto choice = step == 0 ? 0 : rng() % 8;
+    if (choice == 0) {
+      for (auto* tree : {&tracked, &walked}) {
+        tree->push_root(step);
+      }
+      attached.push_back(tracked.size() - 1);
+    } else if (choice < 5) {
+      auto parent = pick();
+      for (auto* tree : {&tracked, &walked}) {
+        tree->push_child(at(*tree, parent), step);
+      }
+      attached.push_back(tracked.size() - 1);
+    } else {
+      // Reparent or detach a node that is not an ancestor of the target.
+      auto node = pick();
+      auto parent = pick();
+      if (node == *tracked.root()) {
+        continue;
+      }
+      bool below = false;
+      for (auto up = std::optional{parent}; up && !below;
+           up = tracked.nodes()[*up].parent) {
+        below = *up == node;
+      }
+      if (choice == 7 || below) {
+        for (auto* tree : {&tracked, &walked}) {
+          tree->detach(at(*tree, node));
+        }
+      } else {
+        for (auto* tree : {&tracked, &walked}) {
+          tree->make_parent(at(*tree, parent), at(*tree, node));
+        }
+      }
+    }
+
+    attached = {*walked.root()};
+    for (std::size_t idx = 0; idx < attached.size(); ++idx) {
+      const auto& children = walked.nodes()[attached[idx]].children;
+      attached.insert(attached.end(), children.begin(), children.end());
+    }
+    for (auto node : attached) {
+      auto lhs = Tree::const_iterator{&tracked, node};
+      auto rhs = Tree::const_iterator{&walked, node};
+      ASSERT_EQ(tracked.depth(lhs), walked.depth(rhs)) << step;
+      ASSERT_EQ(tracked.subtree_size(lhs), walked.subtree_size(rhs)) << step;
+      ASSERT_EQ(tracked.height(lhs), walked.height(rhs)) << step;
+    }
+  }
+}
+
+TEST(TreeTest, PartitionCoversLeaves) {
+  Tree tree;
+  tree.track_metadata(true);
+  tree.push_root(0);
+  for (int i = 0; i < 8; ++i) {
+    tree.push_child(tree.begin(), i);
+    for (int j = 0; j < 4; ++j) {
+      tree.push_child(tree.last_child(tree.begin()), j);
+    }
+  }
+  auto units = tree.partition(tree.begin(), 4);
+  std::size_t covered = 0;
+  for (auto unit : units) {
+    EXPECT_LE(tree.subtree_size(unit), 41U / 4);
+    covered += tree.subtree_size(unit);
+  }
+  EXPECT_EQ(covered, 40U);
+}
+
+TEST(TreeTest, MemoryUsage) {
+  auto tree = make_tree(false);
+  auto usage = tree.memory_usage();
+  EXPECT_GE(usage.nodes, tree.size() * sizeof(Tree::node_type));
+  EXPECT_GE(usage.child_lists, 5 * sizeof(treeceratops::node_id));
+  EXPECT_EQ(usage.metadata, 0U);
+
+  tree.track_metadata(true);
+  EXPECT_EQ(tree.height(tree.begin()), 2U);
+  EXPECT_GE(tree.memory_usage().metadata,
+            tree.size() * sizeof(treeceratops::node_metadata));
+}
+
+TEST(TreeTest, FreezeIsPreOrder) {
+  auto tree = make_tree(false);
+  // Reparent so creation order no longer matches pre-order.
+  tree.make_parent(tree.begin().child(0).child(1), tree.begin().child(1));
+  auto frozen = treeceratops::freeze(tree);
+
+  ASSERT_EQ(frozen.size(), 6U);
+  std::vector<int> order;
+  for (const auto& node : frozen.nodes()) {
+    order.push_back(node.data);
+  }
+  EXPECT_EQ(order, (std::vector<int>{0, 1, 3, 4, 2, 5}));
+
+  auto root = frozen.root();
+  EXPECT_EQ(root.subtree_size(), 6U);
+  EXPECT_EQ(root.child_count(), 1U);
+  auto one = root.child(0);
+  EXPECT_EQ(*one, 1);
+  EXPECT_EQ(one.subtree_size(), 5U);
+  EXPECT_EQ(*one.child(1), 4);
+  EXPECT_EQ(*one.child(1).child(0), 2);
+  EXPECT_EQ(*one[1][0][0], 5);
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "tree.hpp"
+
+namespace treeceratops {
+
+template <class T>
+class frozen_tree;
+
+// Read-only handle to a node of a frozen_tree.
+template <class T>
+class frozen_cursor {
+ public:
+  frozen_cursor() = default;
+  frozen_cursor(const frozen_tree<T> *tree, node_id node)
+      : tree_{tree}, node_{node} {}
+
+  auto operator*() const -> const T & { return tree_->nodes_[node_].data; }
+  auto operator->() const -> const T * { return &tree_->nodes_[node_].data; }
+
+  auto operator==(const frozen_cursor &other) const -> bool = default;
+
+  [[nodiscard]] auto id() const -> node_id { return node_; }
+
+  [[nodiscard]] auto subtree_size() const -> std::size_t {
+    return tree_->nodes_[node_].subtree_size;
+  }
+
+  [[nodiscard]] auto child_count() const -> std::size_t {
+    return tree_->nodes_[node_].child_count;
+  }
+
+  // The first child sits right after its parent and every later sibling
+  // one subtree further on, so this is O(idx).
+  [[nodiscard]] auto child(std::size_t idx) const -> frozen_cursor {
+    assert(idx < child_count());
+    node_id node = node_ + 1;
+    for (; idx > 0; --idx) {
+      node += tree_->nodes_[node].subtree_size;
+    }
+    return {tree_, node};
+  }
+
+  auto operator[](std::size_t idx) const -> frozen_cursor { return child(idx); }
+
+ private:
+  const frozen_tree<T> *tree_ = nullptr;
+  node_id node_ = 0;
+};
+
+// Immutable copy of a tree laid out in pre-order. Each node stores the size
+// of its subtree, so a subtree is the contiguous range [id, id + size) and
+// the next sibling is size nodes along. Traversals stream through one
+// array instead of chasing children vectors and sibling links. Nothing is
+// mutable after construction, so a frozen tree can be read from any number
+// of threads without synchronisation.
+template <class T>
+class frozen_tree {
+ public:
+  struct node {
+    T data;
+    std::size_t subtree_size;
+    std::size_t child_count;
+  };
+
+  using cursor = frozen_cursor<T>;
+  friend cursor;
+
+  frozen_tree() = default;
+  explicit frozen_tree(std::vector<node> nodes) : nodes_{std::move(nodes)} {}
+
+  [[nodiscard]] auto empty() const -> bool { return nodes_.empty(); }
+  [[nodiscard]] auto size() const -> std::size_t { return nodes_.size(); }
+
+  [[nodiscard]] auto root() const -> cursor { return {this, 0}; }
+  [[nodiscard]] auto at(node_id node) const -> cursor { return {this, node}; }
+  auto operator[](node_id node) const -> const T & {
+    return nodes_[node].data;
+  }
+
+  // Every node in pre-order.
+  [[nodiscard]] auto nodes() const -> std::span<const node> { return nodes_; }
+
+  [[nodiscard]] auto memory_usage() const -> std::size_t {
+    return nodes_.capacity() * sizeof(node);
+  }
+
+ private:
+  std::vector<node> nodes_;
+};
+
+// Copies `source` into pre-order form. Only children lists are followed,
+// so a hash-consed DAG is expanded back into a tree.
+template <class T, class Allocator>
+auto freeze(const tree<T, Allocator> &source) -> frozen_tree<T> {
+  using node = typename frozen_tree<T>::node;
+  std::vector<node> nodes;
+  if (!source.root()) {
+    return frozen_tree<T>{};
+  }
+  const auto &data = source.nodes();
+  nodes.reserve(data.size());
+
+  // Emit in pre-order, remembering each node's frozen parent so subtree
+  // sizes can be summed bottom up afterwards.
+  std::vector<std::size_t> parents;
+  parents.reserve(data.size());
+  std::vector<std::pair<node_id, std::size_t>> stack{{*source.root(), 0}};
+  while (!stack.empty()) {
+    auto [id, parent] = stack.back();
+    stack.pop_back();
+    nodes.push_back({data[id].data, 1, data[id].children.size()});
+    parents.push_back(parent);
+    std::size_t self = nodes.size() - 1;
+    for (auto child = data[id].children.rbegin();
+         child != data[id].children.rend(); ++child) {
+      stack.emplace_back(*child, self);
+    }
+  }
+  for (std::size_t idx = nodes.size() - 1; idx > 0; --idx) {
+    nodes[parents[idx]].subtree_size += nodes[idx].subtree_size;
+  }
+  return frozen_tree<T>{std::move(nodes)};
+}
+
+}  // namespace treeceratops
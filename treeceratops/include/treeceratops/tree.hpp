@@ -1,7 +1,15 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
 #include <memory>
 #include <optional>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace treeceratops {
@@ -17,9 +25,33 @@ struct node_type_ {
   std::vector<node_id> children;
 };
 
+// Cached shape of the subtree below a node. depth is a level counted from
+// an arbitrary base; a node's depth in the tree is its level minus the
+// root's, so pushing a new root does not have to touch every node.
+struct node_metadata {
+  std::size_t size = 1;
+  std::size_t depth = 0;
+  std::size_t height = 0;
+};
+
+// Heap bytes held by a tree, by component, from container capacities.
+// Memory owned by the node values themselves is not included.
+struct tree_memory {
+  std::size_t nodes = 0;
+  std::size_t child_lists = 0;
+  std::size_t metadata = 0;
+
+  [[nodiscard]] auto total() const -> std::size_t {
+    return nodes + child_lists + metadata;
+  }
+};
+
 template <class T, class Allocator>
 class tree;
 
+// Pre-order iterator. With a const Ttree it is a const_iterator: it only
+// hands out const references, and any number of threads may walk the same
+// tree through const iterators as long as nothing modifies it.
 template <class T, class Allocator, class Ttree>
 class tree_iterator {
  public:
@@ -27,16 +59,27 @@ class tree_iterator {
   template <class T1, class Allocator1, class Ttree1>
   friend class tree_iterator;
 
+  using value_type = T;
+  using difference_type = std::ptrdiff_t;
+  using reference =
+      std::conditional_t<std::is_const_v<Ttree>, const T &, T &>;
+  using pointer = std::conditional_t<std::is_const_v<Ttree>, const T *, T *>;
+  using iterator_category = std::forward_iterator_tag;
+
   tree_iterator() = default;
 
   tree_iterator(Ttree *tree, node_id node) : tree_{tree}, node_{node} {}
 
-  auto operator*() -> T & { return tree_->data_[node_].data; }
-  auto operator*() const -> const T & { return tree_->data_[node_].data; }
-  auto operator->() -> T * { return &tree_->data_[node_].data; }
-  auto operator->() const -> const T * { return &tree_->data_[node_].data; }
+  // An iterator converts to the const_iterator of the same node.
+  template <class Ttree1>
+    requires(std::is_const_v<Ttree> && !std::is_const_v<Ttree1>)
+  tree_iterator(const tree_iterator<T, Allocator, Ttree1> &other)
+      : tree_{other.tree_}, node_{other.node_} {}
+
+  auto operator*() const -> reference { return tree_->data_[node_].data; }
+  auto operator->() const -> pointer { return &tree_->data_[node_].data; }
 
-  auto operator[](std::size_t idx) -> tree_iterator {
+  auto operator[](std::size_t idx) const -> tree_iterator {
     return {tree_, tree_->data_[node_].children[idx]};
   }
 
@@ -64,23 +107,35 @@ class tree_iterator {
     return old;
   }
 
+  template <class T1, class Allocator1, class Ttree1>
+  auto operator==(const tree_iterator<T1, Allocator1, Ttree1> &iter) const
+      -> bool {
+    return tree_ == iter.tree_ && node_ == iter.node_;
+  }
+
   template <class T1, class Allocator1, class Ttree1>
   auto operator!=(const tree_iterator<T1, Allocator1, Ttree1> &iter) const
       -> bool {
-    return !(tree_ == iter.tree_ && node_ == iter.node_);
+    return !(*this == iter);
   }
 
-  auto parent() -> tree_iterator {
+  auto parent() const -> tree_iterator {
     if (tree_->data_[node_].parent) {
       return tree_iterator{tree_, *tree_->data_[node_].parent};
     }
     return tree_iterator{};
   }
 
-  auto child(std::size_t idx) -> tree_iterator {
-    return tree_iterator{tree_, *tree_->data_[node_].children[idx]};
+  auto child(std::size_t idx) const -> tree_iterator {
+    return tree_iterator{tree_, tree_->data_[node_].children[idx]};
+  }
+
+  [[nodiscard]] auto child_count() const -> std::size_t {
+    return tree_->data_[node_].children.size();
   }
 
+  [[nodiscard]] auto id() const -> node_id { return node_; }
+
  private:
   Ttree *tree_ = nullptr;
   node_id node_ = 0;
@@ -92,12 +147,19 @@ class tree {
   using node_type = node_type_<T>;
   using iterator = tree_iterator<T, Allocator, tree<T, Allocator>>;
   using const_iterator =
-      const tree_iterator<T, Allocator, const tree<T, Allocator>>;
+      tree_iterator<T, Allocator, const tree<T, Allocator>>;
   friend iterator;
+  friend const_iterator;
 
   // Element Access
   auto at(node_id node) -> T& { return data_.at(node).data; }
+  [[nodiscard]] auto at(node_id node) const -> const T & {
+    return data_.at(node).data;
+  }
   auto operator[](node_id node) -> T& { return data_[node].data; }
+  auto operator[](node_id node) const -> const T & {
+    return data_[node].data;
+  }
 
   // Iterators
   auto begin() -> iterator { return iterator{this, *root_}; }
@@ -106,13 +168,48 @@ class tree {
   [[nodiscard]] auto end() const -> const_iterator { return const_iterator{}; }
 
   // Capacity
-  auto empty() -> bool{ return root_.has_value(); }
-  auto size() -> std::size_t;
+  [[nodiscard]] auto empty() const -> bool { return !root_.has_value(); }
+  [[nodiscard]] auto size() const -> std::size_t { return data_.size(); }
+
+  // Raw node storage, for serialisation
+  [[nodiscard]] auto nodes() const
+      -> const std::vector<node_type, Allocator> & {
+    return data_;
+  }
+  [[nodiscard]] auto root() const -> std::optional<node_id> { return root_; }
+
+  [[nodiscard]] auto memory_usage() const -> tree_memory {
+    tree_memory usage;
+    usage.nodes = data_.capacity() * sizeof(node_type);
+    for (const auto &node : data_) {
+      usage.child_lists += node.children.capacity() * sizeof(node_id);
+    }
+    usage.metadata = meta_.capacity() * sizeof(node_metadata);
+    return usage;
+  }
+
+  // Changes whenever a modifier changes the shape of the tree, and is never
+  // shared by two trees built or modified separately, so a (tree address,
+  // generation) pair identifies one version of the nodes. Writing to a
+  // node's value through an iterator or operator[] does not change it.
+  [[nodiscard]] auto generation() const -> std::uint64_t {
+    return generation_;
+  }
 
   // Modifiers
+  void assign(std::vector<node_type, Allocator> nodes,
+              std::optional<node_id> root) {
+    data_ = std::move(nodes);
+    root_ = root;
+    touch();
+    refresh_metadata();
+  }
+
   void clear() {
     data_.clear();
+    meta_.clear();
     root_ = std::nullopt;
+    touch();
   }
 
   void push_root(const T &value) {
@@ -123,6 +220,17 @@ class tree {
       data_.push_back({{}, {}, {}, value, {}});
     }
     root_ = data_.size() - 1;
+    touch();
+    if (track_metadata_) {
+      meta_.resize(data_.size());
+      auto &top = meta_[*root_];
+      if (const auto &old = data_[*root_].children; !old.empty()) {
+        top = {meta_[old[0]].size + 1, meta_[old[0]].depth - 1,
+               meta_[old[0]].height + 1};
+      } else {
+        top = {};
+      }
+    }
   }
 
   void push_child(const iterator &pos, const T &value) {
@@ -135,39 +243,70 @@ class tree {
       data_.push_back({pos.node_, {}, {}, value, {}});
     }
     data_[pos.node_].children.push_back(node);
+    touch();
+    if (track_metadata_) {
+      add_leaf_metadata(node);
+    }
   }
 
   void make_parent(const iterator &parent_pos, const iterator &child) {
-    auto prev = data_[child.node_].prev;
-    auto next = data_[child.node_].next;
-    auto parent = data_[child.node_].parent;
-    if (prev) {
-      data_[*prev].next = next;
+    auto old_parent = data_[child.node_].parent;
+    unlink(child.node_);
+    auto &node = data_[child.node_];
+    auto &siblings = data_[parent_pos.node_].children;
+    if (!siblings.empty()) {
+      node.prev = siblings.back();
+      data_[siblings.back()].next = child.node_;
     }
-    if (next) {
-      data_[*next].prev = next;
+    siblings.push_back(child.node_);
+    node.parent = parent_pos.node_;
+    touch();
+    if (track_metadata_) {
+      const auto &moved = meta_[child.node_];
+      shrink_ancestors(old_parent, moved.size);
+      grow_ancestors(parent_pos.node_, moved.size, moved.height);
+      std::size_t shift = meta_[parent_pos.node_].depth + 1 - moved.depth;
+      if (shift != 0) {
+        for_each_below(child.node_, [&](node_id below, std::size_t) {
+          meta_[below].depth += shift;
+        });
+      }
     }
-    if (parent) {
-      std::erase(data_[*parent].children, child.node_);
+  }
+
+  // Unlinks the subtree at pos from its parent and siblings. Its nodes stay
+  // in storage, unreachable from the root, so every other id stays valid.
+  void detach(const iterator &pos) {
+    auto parent = data_[pos.node_].parent;
+    unlink(pos.node_);
+    touch();
+    if (track_metadata_) {
+      shrink_ancestors(parent, meta_[pos.node_].size);
     }
-    data_[child.node_].next = std::nullopt;
-    data_[parent_pos.node_].children.emplace_back(child.node_);
-    data_[child.node_].parent = parent_pos.node_;
   }
 
   auto insert(const_iterator pos, const T &value) -> iterator;
 
   template <std::size_t Idx, class TIt>
   auto child(const TIt &pos) -> TIt{
-    return child_inner<Idx, TIt>(TIt{this, data_[pos.node_].children[0]});
+    return TIt{this, data_[pos.node_].children[Idx]};
+  }
+  template <std::size_t Idx>
+  [[nodiscard]] auto child(const const_iterator &pos) const
+      -> const_iterator {
+    return const_iterator{this, data_[pos.node_].children[Idx]};
   }
 
   auto last_child(const iterator &pos) -> iterator{
     return iterator{this, data_[pos.node_].children.back()};
   }
 
-  auto depth(iterator pos) -> int{
-    assert(pos.tree_ = this);
+  [[nodiscard]] auto depth(const_iterator pos) const -> int {
+    assert(pos.tree_ == this);
+    if (track_metadata_) {
+      return static_cast<int>(meta_[pos.node_].depth -
+                              meta_[*root_].depth);
+    }
     int count = 0;
 
     while (pos != begin()) {
@@ -178,18 +317,187 @@ class tree {
     return count;
   }
 
+  // Subtree metadata. When tracking is on, size, depth and height are kept
+  // per node and every modifier leaves them current: pushing a root is
+  // O(1), pushing a child or detaching updates the ancestors in O(depth),
+  // reparenting also shifts the depths of the moved subtree, and only
+  // assigning rebuilds them in one O(n) pass. Queries are then O(1) reads.
+  // When tracking is off the queries walk the subtree instead. Either way
+  // they are const and change nothing, so any number of threads may query
+  // a tree that nothing modifies.
+  void track_metadata(bool enable) {
+    track_metadata_ = enable;
+    meta_.clear();
+    if (enable) {
+      rebuild_metadata();
+    }
+  }
+
+  [[nodiscard]] auto tracks_metadata() const -> bool {
+    return track_metadata_;
+  }
+
+  [[nodiscard]] auto subtree_size(const const_iterator &pos) const
+      -> std::size_t {
+    if (track_metadata_) {
+      return meta_[pos.node_].size;
+    }
+    std::size_t count = 0;
+    for_each_below(pos.node_, [&](node_id, std::size_t) { ++count; });
+    return count;
+  }
+
+  [[nodiscard]] auto height(const const_iterator &pos) const -> std::size_t {
+    if (track_metadata_) {
+      return meta_[pos.node_].height;
+    }
+    std::size_t deepest = 0;
+    for_each_below(pos.node_, [&](node_id, std::size_t level) {
+      deepest = std::max(deepest, level);
+    });
+    return deepest;
+  }
+
+  // Splits the subtree at pos into disjoint subtrees of roughly
+  // subtree_size(pos) / parts nodes each, for handing to parallel workers.
+  // Nodes whose subtree had to be split further are not part of any unit
+  // and are left to the caller; there are at most O(parts * height) of
+  // them.
+  [[nodiscard]] auto partition(const const_iterator &pos,
+                               std::size_t parts) const
+      -> std::vector<const_iterator> {
+    std::vector<const_iterator> units;
+    parts = std::max<std::size_t>(parts, 1);
+    std::size_t target = std::max<std::size_t>(1, subtree_size(pos) / parts);
+    std::vector<node_id> stack{pos.node_};
+    while (!stack.empty()) {
+      node_id node = stack.back();
+      stack.pop_back();
+      if (subtree_size(const_iterator{this, node}) <= target ||
+          data_[node].children.empty()) {
+        units.push_back(const_iterator{this, node});
+        continue;
+      }
+      for (auto child = data_[node].children.rbegin();
+           child != data_[node].children.rend(); ++child) {
+        stack.push_back(*child);
+      }
+    }
+    return units;
+  }
+
  private:
-  template <std::size_t Idx, class TIt>
-  auto child_inner(const TIt &pos) -> TIt {
-    if constexpr (Idx == 0) {
-      return pos;
-    } else {
-      return child_inner<Idx - 1, TIt>(TIt{this, *data_[pos.node_].next});
+  void touch() {
+    static std::atomic<std::uint64_t> next{0};
+    generation_ = next.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+
+  void unlink(node_id child) {
+    auto &node = data_[child];
+    if (node.prev) {
+      data_[*node.prev].next = node.next;
+    }
+    if (node.next) {
+      data_[*node.next].prev = node.prev;
+    }
+    if (node.parent) {
+      // The moved node is nearly always one of the last children, so search
+      // from the back rather than scanning every sibling.
+      auto &siblings = data_[*node.parent].children;
+      auto found = std::find(siblings.rbegin(), siblings.rend(), child);
+      if (found != siblings.rend()) {
+        siblings.erase(std::next(found).base());
+      }
+    }
+    node.parent = std::nullopt;
+    node.prev = std::nullopt;
+    node.next = std::nullopt;
+  }
+
+  void refresh_metadata() {
+    if (track_metadata_) {
+      rebuild_metadata();
+    }
+  }
+
+  void add_leaf_metadata(node_id node) {
+    node_id parent = *data_[node].parent;
+    meta_.resize(data_.size());
+    meta_[node] = {1, meta_[parent].depth + 1, 0};
+    grow_ancestors(parent, 1, 0);
+  }
+
+  // Accounts for a subtree of the given size and height added below up.
+  void grow_ancestors(std::optional<node_id> up, std::size_t size,
+                      std::size_t height) {
+    for (; up; up = data_[*up].parent) {
+      ++height;
+      meta_[*up].size += size;
+      meta_[*up].height = std::max(meta_[*up].height, height);
+      height = meta_[*up].height;
+    }
+  }
+
+  // Accounts for a subtree of the given size removed from below up, whose
+  // child lists no longer contain it. Heights are recomputed from the
+  // children until one ancestor's height is unchanged.
+  void shrink_ancestors(std::optional<node_id> up, std::size_t size) {
+    bool changed = true;
+    for (; up; up = data_[*up].parent) {
+      meta_[*up].size -= size;
+      if (changed) {
+        std::size_t height = 0;
+        for (node_id child : data_[*up].children) {
+          height = std::max(height, meta_[child].height + 1);
+        }
+        changed = height != meta_[*up].height;
+        meta_[*up].height = height;
+      }
+    }
+  }
+
+  void rebuild_metadata() {
+    meta_.assign(data_.size(), node_metadata{});
+    if (!root_) {
+      return;
+    }
+    std::vector<node_id> order;
+    order.reserve(data_.size());
+    for_each_below(*root_, [&](node_id node, std::size_t level) {
+      meta_[node].depth = level;
+      order.push_back(node);
+    });
+    for (auto node = order.rbegin(); node != order.rend(); ++node) {
+      if (auto parent = data_[*node].parent) {
+        meta_[*parent].size += meta_[*node].size;
+        meta_[*parent].height =
+            std::max(meta_[*parent].height, meta_[*node].height + 1);
+      }
+    }
+  }
+
+  // Pre-order walk with an explicit stack, calling fn(node, level) where
+  // level is the distance from start.
+  template <class Fn>
+  void for_each_below(node_id start, Fn &&fn) const {
+    std::vector<std::pair<node_id, std::size_t>> stack{{start, 0}};
+    while (!stack.empty()) {
+      auto [node, level] = stack.back();
+      stack.pop_back();
+      fn(node, level);
+      for (auto child = data_[node].children.rbegin();
+           child != data_[node].children.rend(); ++child) {
+        stack.emplace_back(*child, level + 1);
+      }
     }
   }
 
   std::vector<node_type, Allocator> data_;
   std::optional<node_id> root_;
+
+  std::vector<node_metadata> meta_;
+  bool track_metadata_ = false;
+  std::uint64_t generation_ = 0;
 };
 
 }  // namespace treeceratops